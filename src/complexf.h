@@ -24,6 +24,16 @@
 #define OOKIEDOKIE_COMPLEXF_H_
 
 #include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Alignment of planar sample buffers, in bytes. This is sufficient for
+ * aligned loads of a full AVX-512 register.
+ */
+#define COMPLEXF_PLANAR_ALIGNMENT 64
 
 /**
  * Simple complex number representation
@@ -33,6 +43,18 @@ struct complexf {
     float imag; /** Imaginary component */
 };
 
+/**
+ * Planar complex sample buffer, with the real and imaginary components
+ * of each sample stored in separate arrays.
+ *
+ * Buffers allocated via complexf_planar_alloc() are aligned to
+ * COMPLEXF_PLANAR_ALIGNMENT bytes.
+ */
+struct complexf_planar {
+    float *real;    /** Real components */
+    float *imag;    /** Imaginary components */
+};
+
 /**
  * Compute power of provided complex value
  *
@@ -58,42 +80,133 @@ static inline float complexf_magnitude(const struct complexf *x)
 }
 
 /**
- * Convert an array of SC16Q11 values (bladeRF ADC/DAC format) to
- * complexf values.
+ * Allocate a planar sample buffer
+ *
+ * @param[out]  buf     Buffer to initialize
+ * @param[in]   n       Number of samples the buffer shall hold
  *
- * @param[in    in      Input  SC16Q11 values (interleaved IQ)
- * @param[out]  out     Output complex f values.
- * @param[in]   n       Length of both `in` and `out`
+ * @return true on success, false on allocation failure. On failure, both
+ *         arrays are NULL.
  */
-static inline void sc16q11_to_complexf(const int16_t *in,
-                                       struct complexf *out, unsigned int n)
+static inline bool complexf_planar_alloc(struct complexf_planar *buf,
+                                         size_t n)
 {
-    unsigned int i, j;
+    void *real, *imag;
+    const size_t len = (n != 0 ? n : 1) * sizeof(float);
+
+    buf->real = buf->imag = NULL;
+
+    if (posix_memalign(&real, COMPLEXF_PLANAR_ALIGNMENT, len) != 0) {
+        return false;
+    }
 
-    for (i = j = 0; i < (2 * n); i += 2, j++) {
-        out[j].real = (float) in[i]   * (1.0f / 2048.0f);
-        out[j].imag = (float) in[i+1] * (1.0f / 2048.0f);
+    if (posix_memalign(&imag, COMPLEXF_PLANAR_ALIGNMENT, len) != 0) {
+        free(real);
+        return false;
     }
+
+    buf->real = (float *) real;
+    buf->imag = (float *) imag;
+    return true;
 }
 
 /**
- * Convert an array of complexf values to SC16Q11
- * values (bladeRF ADC/DAC format)
+ * Free the arrays of a planar sample buffer allocated via
+ * complexf_planar_alloc()
  *
- * @param[in    in      Input SC16Q11 values (interleaved IQ)
- * @param[out]  out     Output complex f values.
- * @param[in]   n       Length of both `in` and `out`
+ * @param   buf     Buffer to free. May be NULL.
  */
-static inline void complexf_to_sc16q11(const struct complexf *in,
-                                       int16_t *out, unsigned int n)
+static inline void complexf_planar_free(struct complexf_planar *buf)
 {
-    unsigned int i, j;
+    if (buf) {
+        free(buf->real);
+        free(buf->imag);
+        buf->real = buf->imag = NULL;
+    }
+}
+
+/**
+ * Get a view of a planar buffer, starting at the specified sample
+ *
+ * @param   buf     Planar buffer
+ * @param   offset  Index of the first sample in the view
+ *
+ * @return Planar buffer referring to the samples of `buf`, from `offset`
+ */
+static inline struct complexf_planar
+complexf_planar_offset(const struct complexf_planar *buf, size_t offset)
+{
+    struct complexf_planar ret;
+
+    ret.real = buf->real + offset;
+    ret.imag = buf->imag + offset;
+    return ret;
+}
 
-    for (i = j = 0; i < n; i++, j += 2) {
-        out[j]   = (int16_t) (in[i].real * 2048.0f);
-        out[j+1] = (int16_t) (in[i].imag * 2048.0f);
+/**
+ * Convert interleaved complexf values to a planar buffer
+ *
+ * @param[in]   in      Input complexf values
+ * @param[out]  out     Output planar buffer
+ * @param[in]   n       Number of samples to convert
+ */
+static inline void complexf_deinterleave(const struct complexf *in,
+                                         const struct complexf_planar *out,
+                                         size_t n)
+{
+    size_t i;
+    float * restrict re = out->real;
+    float * restrict im = out->imag;
+
+    for (i = 0; i < n; i++) {
+        re[i] = in[i].real;
+        im[i] = in[i].imag;
+    }
+}
+
+/**
+ * Convert a planar buffer to interleaved complexf values
+ *
+ * @param[in]   in      Input planar buffer
+ * @param[out]  out     Output complexf values
+ * @param[in]   n       Number of samples to convert
+ */
+static inline void complexf_interleave(const struct complexf_planar *in,
+                                       struct complexf *out, size_t n)
+{
+    size_t i;
+    const float * restrict re = in->real;
+    const float * restrict im = in->imag;
+
+    for (i = 0; i < n; i++) {
+        out[i].real = re[i];
+        out[i].imag = im[i];
     }
 }
 
+/**
+ * Find the peak magnitude of the real and imaginary components of the
+ * samples in a planar buffer
+ *
+ * @param[in]   in      Input planar buffer
+ * @param[in]   n       Number of samples to examine
+ *
+ * @return Largest absolute component, or 0 if `n` is 0
+ */
+static inline float complexf_planar_peak(const struct complexf_planar *in,
+                                         size_t n)
+{
+    size_t i;
+    float peak = 0.0f;
+    const float * restrict re = in->real;
+    const float * restrict im = in->imag;
+
+    for (i = 0; i < n; i++) {
+        const float mag = fmaxf(fabsf(re[i]), fabsf(im[i]));
+        peak = mag > peak ? mag : peak;
+    }
+
+    return peak;
+}
 
 #endif
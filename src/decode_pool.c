@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#if ENABLE_DECODE_THREADS
+#   include <pthread.h>
+#endif
+
+#include "decode_pool.h"
+#include "log.h"
+
+/* A pulse at which a device may be woken */
+struct wake {
+    unsigned int run;           /* Index of the pulse's run in the block */
+    uint64_t start;             /* Sample number of the start of the run */
+};
+
+struct decoder {
+    struct device *device;
+
+    /* The following are only used for devices with a preamble range.
+     * See device_preamble(). */
+    bool indexed;
+    bool awake;                 /* Processing a burst */
+    bool in_pulse;              /* Became idle at the end of the previous
+                                 * block, partway through its last pulse */
+
+    struct wake *wake;          /* Pulses in the current block at which the
+                                 * device may be woken */
+    unsigned int num_wake;
+    unsigned int wake_len;      /* Allocated length of `wake` */
+};
+
+/* Maps a pulse length to the devices whose preamble range contains it.
+ * Segment i spans the lengths [bounds[i], bounds[i + 1]), and is contained
+ * by the devices seg_devs[seg_start[i]] to seg_devs[seg_start[i + 1] - 1]. */
+struct dispatch_index {
+    uint64_t *bounds;
+    unsigned int num_bounds;
+    unsigned int *seg_start;
+    unsigned int *seg_devs;
+};
+
+struct decode_pool {
+    struct decoder *decoders;
+    unsigned int num_devices;
+
+    bool dispatch;
+    struct dispatch_index index;
+
+    /* Current block */
+    const struct dig_run *runs;
+    unsigned int num_runs;
+    const struct keyval_list **values;
+    bool carry;                 /* A pulse began in the previous block */
+    bool cont;                  /* ...and the first run continues it */
+
+    uint64_t start;             /* Sample number of the block's first sample */
+    uint64_t end;               /* Sample number following its last sample */
+
+    /* Stream state between blocks */
+    bool prev_level;            /* Level of the last sample */
+    uint64_t pending;           /* Length of the trailing pulse so far */
+
+#if ENABLE_DECODE_THREADS
+    pthread_t *threads;
+    unsigned int num_threads;       /* # of threads successfully started */
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_avail;      /* Signals a new batch, or shutdown */
+    pthread_cond_t work_done;       /* Signals completion of a batch */
+
+    /* These are protected by `lock` */
+    uint64_t batch;                 /* Incremented for each batch */
+    unsigned int next;              /* Next device to process */
+    unsigned int remaining;         /* # of devices not yet processed */
+    bool shutdown;
+#endif
+};
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static bool build_index(struct decode_pool *p)
+{
+    struct dispatch_index *idx = &p->index;
+    unsigned int i, k, n, num_segs;
+    size_t num_entries = 0;
+    uint64_t min, max;
+
+    idx->bounds = malloc(2 * p->num_devices * sizeof(idx->bounds[0]));
+    if (!idx->bounds) {
+        perror("malloc");
+        return false;
+    }
+
+    /* Each device's range begins a segment, and ends before another */
+    for (k = 0, n = 0; k < p->num_devices; k++) {
+        if (p->decoders[k].indexed) {
+            device_preamble(p->decoders[k].device, &min, &max);
+            idx->bounds[n++] = min;
+            idx->bounds[n++] = (max == UINT64_MAX) ? max : max + 1;
+        }
+    }
+
+    qsort(idx->bounds, n, sizeof(idx->bounds[0]), compare_u64);
+
+    for (i = 0, idx->num_bounds = 0; i < n; i++) {
+        if (idx->num_bounds == 0 ||
+            idx->bounds[i] != idx->bounds[idx->num_bounds - 1]) {
+            idx->bounds[idx->num_bounds++] = idx->bounds[i];
+        }
+    }
+
+    num_segs = (idx->num_bounds != 0) ? idx->num_bounds - 1 : 0;
+
+    idx->seg_start = calloc(num_segs + 1, sizeof(idx->seg_start[0]));
+    if (!idx->seg_start) {
+        perror("calloc");
+        return false;
+    }
+
+    /* Segments are contained entirely within or outside of each range */
+    for (i = 0; i < num_segs; i++) {
+        for (k = 0; k < p->num_devices; k++) {
+            if (p->decoders[k].indexed) {
+                device_preamble(p->decoders[k].device, &min, &max);
+                if (min <= idx->bounds[i] && idx->bounds[i] <= max) {
+                    num_entries++;
+                }
+            }
+        }
+    }
+
+    idx->seg_devs = malloc((num_entries + 1) * sizeof(idx->seg_devs[0]));
+    if (!idx->seg_devs) {
+        perror("malloc");
+        return false;
+    }
+
+    for (i = 0, n = 0; i < num_segs; i++) {
+        idx->seg_start[i] = n;
+
+        for (k = 0; k < p->num_devices; k++) {
+            if (p->decoders[k].indexed) {
+                device_preamble(p->decoders[k].device, &min, &max);
+                if (min <= idx->bounds[i] && idx->bounds[i] <= max) {
+                    idx->seg_devs[n++] = k;
+                }
+            }
+        }
+    }
+
+    idx->seg_start[num_segs] = n;
+    return true;
+}
+
+/* Record that the devices whose preamble range contains a pulse of length
+ * `len` may be woken at run `r`, which starts at sample `start` */
+static bool index_pulse(struct decode_pool *p, uint64_t len, unsigned int r,
+                        uint64_t start)
+{
+    const struct dispatch_index *idx = &p->index;
+    unsigned int lo = 0, hi = idx->num_bounds, i;
+
+    if (idx->num_bounds == 0 || len < idx->bounds[0]) {
+        return true;
+    }
+
+    /* Find the last bound <= len */
+    while (hi - lo > 1) {
+        const unsigned int mid = lo + (hi - lo) / 2;
+        if (idx->bounds[mid] <= len) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Beyond the end of the last range */
+    if (lo == idx->num_bounds - 1) {
+        return true;
+    }
+
+    for (i = idx->seg_start[lo]; i < idx->seg_start[lo + 1]; i++) {
+        struct decoder *dec = &p->decoders[idx->seg_devs[i]];
+
+        if (dec->num_wake == dec->wake_len) {
+            const unsigned int new_len = dec->wake_len ? 2 * dec->wake_len : 64;
+            struct wake *tmp = realloc(dec->wake, new_len * sizeof(tmp[0]));
+            if (!tmp) {
+                perror("realloc");
+                return false;
+            }
+
+            dec->wake = tmp;
+            dec->wake_len = new_len;
+        }
+
+        dec->wake[dec->num_wake].run = r;
+        dec->wake[dec->num_wake].start = start;
+        dec->num_wake++;
+    }
+
+    return true;
+}
+
+/* Process the current block with the specified device */
+static void decode(struct decode_pool *p, unsigned int k)
+{
+    struct decoder *dec = &p->decoders[k];
+    const struct dig_run *runs = p->runs;
+    const unsigned int count = p->num_runs;
+    unsigned int pos = 0, w, n;
+    bool idle;
+
+    if (!dec->indexed) {
+        p->values[k] = device_process(dec->device, runs, count);
+        return;
+    }
+
+    p->values[k] = device_begin_block(dec->device);
+
+    if (dec->awake) {
+        idle = device_process_burst(dec->device, runs, count, p->start,
+                                    false, &n);
+        dec->awake = !idle;
+        pos = n;
+    }
+
+    for (w = 0; w < dec->num_wake && !dec->awake; w++) {
+        const unsigned int r = dec->wake[w].run;
+
+        if (r < pos) {
+            continue;
+        }
+
+        if (r == 0 && p->carry) {
+            /* The device already saw the start of this pulse */
+            if (dec->in_pulse) {
+                continue;
+            }
+
+            /* Pass it the whole pulse, including the previous block's part */
+            const uint64_t len = p->pending + (p->cont ? runs[0].length : 0);
+            const struct dig_run pulse = {
+                .length = (len > UINT_MAX) ? UINT_MAX : (unsigned int) len,
+                .level = true,
+            };
+
+            idle = device_process_burst(dec->device, &pulse, 1,
+                                        p->start - p->pending, true, &n);
+            pos = p->cont ? 1 : 0;
+
+            if (!idle && pos < count) {
+                idle = device_process_burst(dec->device, &runs[pos],
+                                            count - pos,
+                                            p->start +
+                                                (p->cont ? runs[0].length : 0),
+                                            false, &n);
+                pos += n;
+            }
+        } else {
+            idle = device_process_burst(dec->device, &runs[r], count - r,
+                                        dec->wake[w].start, true, &n);
+            pos = r + n;
+        }
+
+        dec->awake = !idle;
+    }
+
+    device_end_block(dec->device, p->end);
+
+    /* Note whether the device has already seen the start of a trailing
+     * pulse, which the next block may continue */
+    if (count != 0 && !dec->awake) {
+        if (pos == count) {
+            dec->in_pulse = runs[count - 1].level;
+        } else if (!(p->cont && count == 1)) {
+            dec->in_pulse = false;
+        }
+    }
+}
+
+#if ENABLE_DECODE_THREADS
+/* Process devices from the current batch until none remain unclaimed.
+ * `lock` must be held, and is held again upon return. */
+static void process_batch(struct decode_pool *p)
+{
+    while (p->next < p->num_devices) {
+        const unsigned int i = p->next++;
+
+        pthread_mutex_unlock(&p->lock);
+        decode(p, i);
+        pthread_mutex_lock(&p->lock);
+
+        if (--p->remaining == 0) {
+            pthread_cond_signal(&p->work_done);
+        }
+    }
+}
+
+static void * decode_worker(void *arg)
+{
+    struct decode_pool *p = (struct decode_pool *) arg;
+    uint64_t batch = 0;
+
+    pthread_mutex_lock(&p->lock);
+
+    while (true) {
+        while (!p->shutdown && p->batch == batch) {
+            pthread_cond_wait(&p->work_avail, &p->lock);
+        }
+
+        if (p->shutdown) {
+            break;
+        }
+
+        batch = p->batch;
+        process_batch(p);
+    }
+
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+#endif
+
+struct decode_pool * decode_pool_init(struct device **devices,
+                                      unsigned int num_devices,
+                                      unsigned int num_threads,
+                                      bool dispatch)
+{
+    struct decode_pool *p;
+    unsigned int i;
+    uint64_t min, max;
+
+    p = calloc(1, sizeof(p[0]));
+    if (!p) {
+        perror("calloc");
+        return NULL;
+    }
+
+    p->num_devices = num_devices;
+    p->decoders = calloc(num_devices, sizeof(p->decoders[0]));
+    if (!p->decoders) {
+        perror("calloc");
+        goto out;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        p->decoders[i].device = devices[i];
+        p->decoders[i].indexed = dispatch &&
+                                 device_preamble(devices[i], &min, &max);
+
+        /* The device may be resuming a burst (see device_restore()), so let
+         * it run until it first becomes idle */
+        p->decoders[i].awake = true;
+
+        if (p->decoders[i].indexed) {
+            p->dispatch = true;
+            log_debug("%s: Dispatching pulses of %"PRIu64" to %"PRIu64
+                      " samples.\n", device_name(devices[i]), min, max);
+        } else if (dispatch) {
+            log_debug("%s: Preamble not indexable; passing all pulses.\n",
+                      device_name(devices[i]));
+        }
+    }
+
+    if (p->dispatch && !build_index(p)) {
+        goto out;
+    }
+
+    /* There's no use in having more threads than devices to hand them */
+    if (num_devices == 0) {
+        num_threads = 0;
+    } else if (num_threads > num_devices - 1) {
+        num_threads = num_devices - 1;
+    }
+
+    if (num_threads == 0) {
+        return p;
+    }
+
+#if ENABLE_DECODE_THREADS
+    /* decode_pool_deinit() destroys the lock and conditions only if the
+     * threads array was allocated, so they must be initialized after it */
+    p->threads = calloc(num_threads, sizeof(p->threads[0]));
+    if (!p->threads) {
+        perror("calloc");
+        goto out;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_avail, NULL);
+    pthread_cond_init(&p->work_done, NULL);
+
+    for (p->num_threads = 0; p->num_threads < num_threads; p->num_threads++) {
+        if (pthread_create(&p->threads[p->num_threads], NULL,
+                           decode_worker, p) != 0) {
+
+            log_error("Error: Failed to create decoder worker thread.\n");
+            goto out;
+        }
+    }
+
+    log_debug("Decoding %u devices on %u worker threads.\n",
+              num_devices, num_threads);
+
+    return p;
+#else
+    log_error("Error: Multi-threaded decoding requires building with "
+              "ENABLE_DECODE_THREADS.\n");
+#endif
+
+out:
+    decode_pool_deinit(p);
+    return NULL;
+}
+
+bool decode_pool_process(struct decode_pool *p,
+                         const struct dig_run *runs, unsigned int count,
+                         const struct keyval_list **values)
+{
+    unsigned int i, r;
+    uint64_t start;
+
+    p->runs = runs;
+    p->num_runs = count;
+    p->values = values;
+    p->carry = (count != 0) && p->prev_level;
+    p->cont = p->carry && runs[0].level;
+
+    for (i = 0, p->end = p->start; i < count; i++) {
+        p->end += runs[i].length;
+    }
+
+    /* Find the devices that may accept each complete pulse. A pulse in the
+     * last run may continue into the next block, so it is indexed then. */
+    if (p->dispatch && count != 0) {
+        for (i = 0; i < p->num_devices; i++) {
+            p->decoders[i].num_wake = 0;
+        }
+
+        /* The previous block's trailing pulse ended with it */
+        if (p->carry && !p->cont &&
+            !index_pulse(p, p->pending, 0, p->start - p->pending)) {
+            return false;
+        }
+
+        start = p->start;
+        r = 0;
+
+        if (!runs[0].level) {
+            start += runs[0].length;
+            r = 1;
+        }
+
+        for (; r + 1 < count; r += 2) {
+            const uint64_t len = (r == 0 && p->cont) ?
+                                    p->pending + runs[0].length :
+                                    runs[r].length;
+
+            if (!index_pulse(p, len, r, start)) {
+                return false;
+            }
+
+            start += runs[r].length + runs[r + 1].length;
+        }
+    }
+
+#if ENABLE_DECODE_THREADS
+    if (p->num_threads != 0) {
+        pthread_mutex_lock(&p->lock);
+
+        p->next = 0;
+        p->remaining = p->num_devices;
+        p->batch++;
+
+        pthread_cond_broadcast(&p->work_avail);
+
+        /* Take part in the batch, rather than idling until it completes */
+        process_batch(p);
+
+        while (p->remaining != 0) {
+            pthread_cond_wait(&p->work_done, &p->lock);
+        }
+
+        pthread_mutex_unlock(&p->lock);
+    } else
+#endif
+    {
+        for (i = 0; i < p->num_devices; i++) {
+            decode(p, i);
+        }
+    }
+
+    if (count != 0) {
+        const struct dig_run *last = &runs[count - 1];
+
+        if (!last->level) {
+            p->pending = 0;
+        } else if (count == 1 && p->cont) {
+            p->pending += last->length;
+        } else {
+            p->pending = last->length;
+        }
+
+        p->prev_level = last->level;
+    }
+
+    p->start = p->end;
+
+    return true;
+}
+
+void decode_pool_deinit(struct decode_pool *p)
+{
+    unsigned int i;
+
+    if (p) {
+#if ENABLE_DECODE_THREADS
+        if (p->threads) {
+            pthread_mutex_lock(&p->lock);
+            p->shutdown = true;
+            pthread_cond_broadcast(&p->work_avail);
+            pthread_mutex_unlock(&p->lock);
+
+            for (i = 0; i < p->num_threads; i++) {
+                pthread_join(p->threads[i], NULL);
+            }
+
+            free(p->threads);
+            pthread_cond_destroy(&p->work_done);
+            pthread_cond_destroy(&p->work_avail);
+            pthread_mutex_destroy(&p->lock);
+        }
+#endif
+
+        if (p->decoders) {
+            for (i = 0; i < p->num_devices; i++) {
+                free(p->decoders[i].wake);
+            }
+        }
+
+        free(p->decoders);
+        free(p->index.bounds);
+        free(p->index.seg_start);
+        free(p->index.seg_devs);
+        free(p);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef DECODE_POOL_H_
+#define DECODE_POOL_H_
+
+/* This file provides the decoding of a single stream of received digital
+ * samples by several devices. The devices are independent, so they may be
+ * run concurrently on a pool of worker threads.
+ *
+ * Devices whose state machine begins with a single pulse of bounded length
+ * (see device_preamble()) may also be dispatched: such a device sleeps while
+ * idle, and an index of the devices' preamble ranges is used to wake only the
+ * devices that may accept each pulse. This keeps the per-pulse cost of large
+ * device libraries close to that of the devices actually receiving. */
+
+#include <stdbool.h>
+#include "device.h"
+#include "keyval_list.h"
+#include "threshold.h"
+
+/** Opaque handle to a pool of decoders */
+struct decode_pool;
+
+/**
+ * Create a pool of decoders
+ *
+ * @param   devices     Devices to decode samples for. These must remain
+ *                      valid until decode_pool_deinit() is called.
+ * @param   num_devices Number of devices
+ * @param   num_threads Number of worker threads, in addition to the thread
+ *                      calling decode_pool_process(). 0 decodes for each
+ *                      device in turn on the calling thread. This is reduced
+ *                      if there are too few devices to use all of them.
+ * @param   dispatch    Dispatch pulses to devices by their preamble, rather
+ *                      than passing all samples to every device.
+ *
+ * @return Pool handle on success, or NULL on failure
+ */
+struct decode_pool * decode_pool_init(struct device **devices,
+                                      unsigned int num_devices,
+                                      unsigned int num_threads,
+                                      bool dispatch);
+
+/**
+ * Pass runs of digital samples to every device in the pool, and wait for all
+ * of them to finish.
+ *
+ * @param[in]   pool    Pool handle
+ * @param[in]   runs    Runs of digital input samples, as produced
+ *                      by dig_to_runs()
+ * @param[in]   count   Number of runs in `runs`
+ * @param[out]  values  For each device, in the order provided to
+ *                      decode_pool_init(), the key-value list of messages
+ *                      it decoded. Values are only valid until the next call.
+ *
+ * @return true on success, false if memory could not be allocated
+ */
+bool decode_pool_process(struct decode_pool *pool,
+                         const struct dig_run *runs, unsigned int count,
+                         const struct keyval_list **values);
+
+/**
+ * Stop the pool's worker threads and deallocate the pool. The devices are
+ * not deinitialized.
+ *
+ * @param   pool    Pool handle
+ */
+void decode_pool_deinit(struct decode_pool *pool);
+
+#endif
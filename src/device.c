@@ -71,6 +71,18 @@ struct device
     struct keyval_list *values;
     struct state_machine *sm;
     struct formatter *fmt;
+
+    uint64_t position;              /** Sample at start of current block */
+
+    /* Repeated messages held back to be merged. See device_set_dedup(). */
+    struct {
+        uint64_t window;            /** Max samples between repeats */
+        uint8_t *data;              /** Message data */
+        bool pending;               /** A message is held */
+        unsigned int repeats;       /** # of times the message was received */
+        uint64_t first;             /** Sample of first receipt */
+        uint64_t last;              /** Sample of last receipt */
+    } dedup;
 };
 
 static inline bool add_state(struct state_machine *sm, json_t *state)
@@ -235,12 +247,15 @@ create_state_machine(json_t *device,
         }
     }
 
-    if (sm_initialized(sm)) {
-        log_verbose("State machine initialized.\n");
-        status = 0;
-    } else {
+    if (!sm_initialized(sm)) {
         log_error("State machine is missing states or triggers.\n");
         status = -1;
+    } else if (!sm_compile(sm)) {
+        log_error("Failed to compile state machine.\n");
+        status = -1;
+    } else {
+        log_verbose("State machine initialized.\n");
+        status = 0;
     }
 
 
@@ -631,10 +646,65 @@ out:
     return dev;
 }
 
+/* Append the held message, along with its repeat count and the samples at
+ * which it was first and last received */
+static void emit_pending(struct device *d)
+{
+    char buf[32];
+    struct keyval kv;
+
+    formatter_data_to_keyval(d->fmt, d->dedup.data, d->values);
+
+    snprintf(buf, sizeof(buf), "%u", d->dedup.repeats);
+    kv.key = "Repeats";
+    kv.value = buf;
+    keyval_list_append(d->values, &kv);
+
+    snprintf(buf, sizeof(buf), "%"PRIu64, d->dedup.first);
+    kv.key = "First Sample";
+    keyval_list_append(d->values, &kv);
+
+    snprintf(buf, sizeof(buf), "%"PRIu64, d->dedup.last);
+    kv.key = "Last Sample";
+    keyval_list_append(d->values, &kv);
+
+    d->dedup.pending = false;
+}
+
+/* Handle a message received at the specified sample */
+static void output_message(struct device *d, uint64_t sample)
+{
+    if (d->dedup.window == 0) {
+        formatter_data_to_keyval(d->fmt, d->data, d->values);
+        return;
+    }
+
+    if (d->dedup.pending &&
+        sample - d->dedup.last <= d->dedup.window &&
+        !memcmp(d->dedup.data, d->data, d->data_alloc_len)) {
+
+        d->dedup.repeats++;
+        d->dedup.last = sample;
+        return;
+    }
+
+    if (d->dedup.pending) {
+        emit_pending(d);
+    }
+
+    memcpy(d->dedup.data, d->data, d->data_alloc_len);
+    d->dedup.pending = true;
+    d->dedup.repeats = 1;
+    d->dedup.first = sample;
+    d->dedup.last = sample;
+}
+
 const struct keyval_list * device_process(struct device *d,
-                                          const bool *data, unsigned int count)
+                                          const struct dig_run *runs,
+                                          unsigned int count)
 {
-    unsigned int total_proc, num_proc;
+    unsigned int i, total_proc, num_proc;
+    uint64_t sample = d->position;
     enum sm_process_result proc = SM_PROCESS_RESULT_NO_OUTPUT;
 
     keyval_list_clear(d->values);
@@ -644,19 +714,138 @@ const struct keyval_list * device_process(struct device *d,
      *       to just bail out like this?
      */
     while (total_proc < count && proc != SM_PROCESS_RESULT_ERROR) {
-        proc = sm_process(d->sm, &data[total_proc],
-                          count - total_proc, &num_proc);
+        proc = sm_process_runs(d->sm, &runs[total_proc],
+                               count - total_proc, &num_proc);
 
-        if (proc == SM_PROCESS_RESULT_OUTPUT_READY) {
-            formatter_data_to_keyval(d->fmt, d->data, d->values);
+        for (i = 0; i < num_proc; i++) {
+            sample += runs[total_proc + i].length;
         }
 
         total_proc += num_proc;
+
+        if (proc == SM_PROCESS_RESULT_OUTPUT_READY) {
+            output_message(d, sample + sm_output_offset(d->sm));
+        }
+    }
+
+    for (i = total_proc; i < count; i++) {
+        sample += runs[i].length;
     }
 
+    device_end_block(d, sample);
     return d->values;
 }
 
+bool device_preamble(const struct device *d,
+                     uint64_t *min_len, uint64_t *max_len)
+{
+    return sm_preamble(d->sm, min_len, max_len);
+}
+
+const struct keyval_list * device_begin_block(struct device *d)
+{
+    keyval_list_clear(d->values);
+    return d->values;
+}
+
+bool device_process_burst(struct device *d, const struct dig_run *runs,
+                          unsigned int count, uint64_t start, bool wake,
+                          unsigned int *num_proc)
+{
+    unsigned int i, n;
+    enum sm_process_result proc;
+
+    if (wake) {
+        sm_reset(d->sm);
+    }
+
+    /* Unlike device_process(), keep going after an error. The state machine
+     * has been reset, so it will stop at the end of the run. */
+    for (i = 0; i < count; i++) {
+        do {
+            proc = sm_process_runs(d->sm, &runs[i], 1, &n);
+            if (proc == SM_PROCESS_RESULT_OUTPUT_READY) {
+                output_message(d, start + sm_output_offset(d->sm));
+            }
+        } while (n == 0);
+
+        start += runs[i].length;
+
+        if (sm_idle(d->sm)) {
+            *num_proc = i + 1;
+            return true;
+        }
+    }
+
+    *num_proc = count;
+    return false;
+}
+
+void device_end_block(struct device *d, uint64_t end)
+{
+    d->position = end;
+
+    /* No further repeat can be merged with the held message */
+    if (d->dedup.pending && end - d->dedup.last > d->dedup.window) {
+        emit_pending(d);
+    }
+}
+
+const struct keyval_list * device_flush(struct device *d)
+{
+    keyval_list_clear(d->values);
+
+    if (d->dedup.pending) {
+        emit_pending(d);
+    }
+
+    return d->values;
+}
+
+bool device_set_dedup(struct device *d, uint64_t window)
+{
+    if (window != 0 && d->dedup.data == NULL) {
+        d->dedup.data = calloc(d->data_alloc_len, 1);
+        if (!d->dedup.data) {
+            perror("calloc");
+            return false;
+        }
+    }
+
+    d->dedup.window = window;
+    return true;
+}
+
+const char * device_name(const struct device *d)
+{
+    return d->name;
+}
+
+void device_use_sm_table(struct device *d, bool enable)
+{
+    sm_use_table(d->sm, enable);
+}
+
+bool device_set_hypotheses(struct device *d, unsigned int max)
+{
+    return sm_set_hypotheses(d->sm, max);
+}
+
+size_t device_snapshot_size(const struct device *d)
+{
+    return sm_snapshot_size(d->sm);
+}
+
+size_t device_snapshot(const struct device *d, void *buf, size_t len)
+{
+    return sm_snapshot(d->sm, buf, len);
+}
+
+size_t device_restore(struct device *d, const void *buf, size_t len)
+{
+    return sm_restore(d->sm, buf, len);
+}
+
 bool device_generate(struct device *d, const struct keyval_list *params,
                     struct complexf **samples, unsigned int *num_samples)
 {
@@ -685,6 +874,7 @@ void device_deinit(struct device *dev)
         sm_deinit(dev->sm);
         formatter_deinit(dev->fmt);
         free(dev->data);
+        free(dev->dedup.data);
         free(dev->name);
         free(dev->description);
         free(dev);
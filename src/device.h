@@ -26,8 +26,10 @@
  * samples for a device that utilizes on-off keying. */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "complexf.h"
 #include "keyval_list.h"
+#include "threshold.h"
 
 /**
  * Opaque handle to a device specifications object.
@@ -47,19 +49,179 @@ struct device;
 struct device * device_init(const char *name, unsigned int sample_rate);
 
 
+/**
+ * Get the range of lengths of the first pulse of a message that the device
+ * may accept. See sm_preamble().
+ *
+ * @param[in]   d           Device specification handle
+ * @param[out]  min_len     Minimum pulse length, in samples
+ * @param[out]  max_len     Maximum pulse length, in samples
+ *
+ * @return true if the range is available, false otherwise
+ */
+bool device_preamble(const struct device *d,
+                     uint64_t *min_len, uint64_t *max_len);
+
+/**
+ * Begin processing a block of samples with device_process_burst(), clearing
+ * the messages decoded from the previous block. The block must be ended with
+ * device_end_block().
+ *
+ * @param   d               Device specification handle
+ *
+ * @return A key-value list of decoded message fields, to which the messages
+ *         decoded by subsequent device_process_burst() calls are appended.
+ */
+const struct keyval_list * device_begin_block(struct device *d);
+
+/**
+ * Process received digital samples until the device's state machine becomes
+ * idle (see sm_idle()). This is intended for use with device_preamble(),
+ * such that the samples between the bursts the device may accept need not
+ * be processed.
+ *
+ * Unlike device_process(), an invalid pulse duration does not cause the
+ * remaining runs to be discarded.
+ *
+ * @param[in]   d           Device specification handle
+ * @param[in]   runs        Runs of digital input samples
+ * @param[in]   count       Number of runs in `runs`
+ * @param[in]   start       Sample number of the first sample of `runs`,
+ *                          counted from the start of the received stream
+ * @param[in]   wake        Reset the state machine before processing. The
+ *                          first run must then be the start of a pulse.
+ * @param[out]  num_proc    Number of runs processed
+ *
+ * @return true if the state machine became idle at the end of the last run
+ *         processed, false if all runs were processed without it doing so.
+ */
+bool device_process_burst(struct device *d, const struct dig_run *runs,
+                          unsigned int count, uint64_t start, bool wake,
+                          unsigned int *num_proc);
+
+/**
+ * End a block of samples begun with device_begin_block(). A message held
+ * back to merge its repeats (see device_set_dedup()) is appended to the
+ * block's messages once no further repeat could be merged with it.
+ *
+ * @param   d               Device specification handle
+ * @param   end             Sample number following the last sample of the
+ *                          block, counted from the start of the stream
+ */
+void device_end_block(struct device *d, uint64_t end);
+
+/**
+ * Merge repeated transmissions of a message. Messages with identical data,
+ * each received within `window` samples of the last, are reported once,
+ * followed by "Repeats", "First Sample" and "Last Sample" fields. The latter
+ * two are the sample numbers, counted from the start of the stream, at which
+ * the first and last repeats were received.
+ *
+ * A message is thus reported once `window` samples have passed without a
+ * repeat, or when a different message is received. Its timestamp, if any, is
+ * the time at which it is reported.
+ *
+ * @param   d               Device specification handle
+ * @param   window          Maximum number of samples between repeats, or 0
+ *                          to report every message as it is received
+ *
+ * @return true on success, false on failure
+ */
+bool device_set_dedup(struct device *d, uint64_t window);
+
+/**
+ * Report any message held back by device_set_dedup(), such as when the end of
+ * the received stream has been reached.
+ *
+ * @param   d               Device specification handle
+ *
+ * @return A key-value list of the message's fields, which is only valid until
+ *         the next call to this function or to device_process().
+ */
+const struct keyval_list * device_flush(struct device *d);
+
+/**
+ * Get the name of a device, as specified by its "name" entry
+ *
+ * @param   d               Device specification handle
+ *
+ * @return Device name
+ */
+const char * device_name(const struct device *d);
+
 /**
  * Process a stream of received digital samples
  *
  * @param   d               Device specification handle
- * @param   data            Array of digital input samples
- * @param   count           Number of input samples in `data`
+ * @param   runs            Runs of digital input samples, as produced
+ *                          by dig_to_runs()
+ * @param   count           Number of runs in `runs`
  *
  * @return A key-value list of decoded message fields. Values in this
  *         keyval-list are only valid until the next time this function is
  *         called.
  */
 const struct keyval_list * device_process(struct device *d,
-                                          const bool *data, unsigned int count);
+                                          const struct dig_run *runs,
+                                          unsigned int count);
+
+/**
+ * Select whether the device's state machine processes received samples
+ * using its compiled transition table (the default), or its reference
+ * interpreter. See sm_use_table().
+ *
+ * @param   d               Device specification handle
+ * @param   enable          Use the compiled transition table
+ */
+void device_use_sm_table(struct device *d, bool enable);
+
+/**
+ * Decode concurrent hypotheses of where messages begin, such that a message
+ * starting on a pulse that interrupted another is not lost.
+ * See sm_set_hypotheses().
+ *
+ * @param   d               Device specification handle
+ * @param   max             Maximum number of concurrent hypotheses
+ *
+ * @return true on success, false on failure
+ */
+bool device_set_hypotheses(struct device *d, unsigned int max);
+
+/**
+ * Get the maximum size of a snapshot of the device's receive state
+ *
+ * @param   d               Device specification handle
+ *
+ * @return Snapshot size, in bytes
+ */
+size_t device_snapshot_size(const struct device *d);
+
+/**
+ * Capture the device's receive state, such that decoding may later resume
+ * from this point via device_restore(). See sm_snapshot().
+ *
+ * This must not be called while device_process() or device_process_burst()
+ * is running.
+ *
+ * @param[in]   d           Device specification handle
+ * @param[out]  buf         Buffer to write the snapshot to
+ * @param[in]   len         Length of `buf`, in bytes
+ *
+ * @return Number of bytes written, or 0 on failure
+ */
+size_t device_snapshot(const struct device *d, void *buf, size_t len);
+
+/**
+ * Restore the receive state captured by device_snapshot() for the same
+ * device specification and sample rate. See sm_restore().
+ *
+ * @param   d               Device specification handle
+ * @param   buf             Snapshot
+ * @param   len             Length of `buf`, in bytes
+ *
+ * @return Number of bytes of `buf` consumed, or 0 on failure
+ */
+size_t device_restore(struct device *d, const void *buf, size_t len);
 
 /**
  * Generate complex samples for a single message
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Iterative radix-2, decimation-in-time FFT.
+ *
+ * Each butterfly stage's twiddle factors are stored contiguously, such that
+ * the inner loop accesses them sequentially. */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "fft.h"
+#include "log.h"
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+struct fft {
+    size_t len;
+    size_t *bitrev;             /* Bit-reversed index of each input */
+    struct complexf *twiddles;  /* (len - 1) twiddles: 1 for the first stage,
+                                 * 2 for the second, 4 for the third, ... */
+};
+
+struct fft * fft_init(size_t len)
+{
+    struct fft *fft;
+    size_t i, j, half;
+    unsigned int bits = 0;
+
+    if (len < 2 || (len & (len - 1)) != 0) {
+        log_error("Error: FFT length must be a power of 2 >= 2.\n");
+        return NULL;
+    }
+
+    while (((size_t) 1 << bits) < len) {
+        bits++;
+    }
+
+    fft = calloc(1, sizeof(fft[0]));
+    if (!fft) {
+        goto fail;
+    }
+
+    fft->len = len;
+    fft->bitrev = malloc(len * sizeof(fft->bitrev[0]));
+    fft->twiddles = malloc((len - 1) * sizeof(fft->twiddles[0]));
+
+    if (!fft->bitrev || !fft->twiddles) {
+        goto fail;
+    }
+
+    for (i = 0; i < len; i++) {
+        size_t rev = 0;
+        for (j = 0; j < bits; j++) {
+            rev |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+        fft->bitrev[i] = rev;
+    }
+
+    for (half = 1, i = 0; half < len; half <<= 1) {
+        for (j = 0; j < half; j++, i++) {
+            const double theta = -M_PI * (double) j / (double) half;
+            fft->twiddles[i].real = (float) cos(theta);
+            fft->twiddles[i].imag = (float) sin(theta);
+        }
+    }
+
+    return fft;
+
+fail:
+    log_error("Error: Failed to allocate FFT.\n");
+    fft_deinit(fft);
+    return NULL;
+}
+
+void fft_deinit(struct fft *fft)
+{
+    if (fft) {
+        free(fft->bitrev);
+        free(fft->twiddles);
+        free(fft);
+    }
+}
+
+__attribute__((always_inline))
+static inline void transform(const struct fft *fft, struct complexf *buf,
+                             bool inverse)
+{
+    size_t i, j, half;
+    const struct complexf *w = fft->twiddles;
+    const float sign = inverse ? -1.0f : 1.0f;
+
+    for (i = 0; i < fft->len; i++) {
+        const size_t r = fft->bitrev[i];
+        if (r > i) {
+            const struct complexf tmp = buf[i];
+            buf[i] = buf[r];
+            buf[r] = tmp;
+        }
+    }
+
+    for (half = 1; half < fft->len; w += half, half <<= 1) {
+        for (i = 0; i < fft->len; i += 2 * half) {
+            struct complexf * restrict a = &buf[i];
+            struct complexf * restrict b = &buf[i + half];
+
+            for (j = 0; j < half; j++) {
+                const float wr = w[j].real;
+                const float wi = sign * w[j].imag;
+                const float vr = b[j].real * wr - b[j].imag * wi;
+                const float vi = b[j].real * wi + b[j].imag * wr;
+
+                b[j].real = a[j].real - vr;
+                b[j].imag = a[j].imag - vi;
+                a[j].real += vr;
+                a[j].imag += vi;
+            }
+        }
+    }
+}
+
+void fft_forward(const struct fft *fft, struct complexf *buf)
+{
+    transform(fft, buf, false);
+}
+
+void fft_inverse(const struct fft *fft, struct complexf *buf)
+{
+    transform(fft, buf, true);
+}
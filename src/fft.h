@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef FFT_H_
+#define FFT_H_
+
+/* This file provides a small, self-contained complex FFT, used for
+ * fast convolution of long FIR filters. */
+
+#include <stddef.h>
+#include "complexf.h"
+
+/** Opaque handle to precomputed FFT state */
+struct fft;
+
+/**
+ * Initialize an FFT of the specified length
+ *
+ * @param   len     Transform length. Must be a power of 2.
+ *
+ * @return  Pointer to FFT handle on success, or NULL on failure. The caller
+ *          is responsible for calling fft_deinit().
+ */
+struct fft * fft_init(size_t len);
+
+/**
+ * Deinitialize and deallocate the provided FFT handle
+ *
+ * @param   fft     FFT handle
+ */
+void fft_deinit(struct fft *fft);
+
+/**
+ * Compute the forward transform of the provided data, in place
+ *
+ * @param       fft     FFT handle
+ * @param[in]   buf     Buffer of the length provided to fft_init()
+ */
+void fft_forward(const struct fft *fft, struct complexf *buf);
+
+/**
+ * Compute the inverse transform of the provided data, in place. The result
+ * is not scaled by 1/len.
+ *
+ * @param       fft     FFT handle
+ * @param[in]   buf     Buffer of the length provided to fft_init()
+ */
+void fft_inverse(const struct fft *fft, struct complexf *buf);
+
+#endif
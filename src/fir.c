@@ -20,22 +20,127 @@
  * THE SOFTWARE.
  */
 
+#if ENABLE_FIR_THREADS && defined(__linux__)
+#   define _GNU_SOURCE  /* For pthread_setaffinity_np() */
+#endif
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
+#include <math.h>
 #include <jansson.h>
 
+#if ENABLE_FIR_THREADS
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
 #include "fir.h"
+#include "fir_kernels.h"
+#include "fir_plan.h"
+#include "fft.h"
 #include "find.h"
 #include "log.h"
+#include "sc16q11.h"
+
+#if ENABLE_FIR_THREADS
+#   include "spsc_ring.h"
+#endif
 
 #ifndef ENABLE_FIR_VERBOSE_LOGGING
 #undef log_verbose
 #define log_verbose(...)
 #endif
 
+/* Filter stage implementations */
+enum stage_mode {
+    STAGE_MODE_STREAM,  /* Samples are pushed into a circular state buffer
+                         * one at a time, and an output is computed each time
+                         * the decimation countdown expires */
+
+    STAGE_MODE_BLOCK,   /* Input is processed a block at a time, computing
+                         * only the decimated outputs from a polyphase
+                         * decomposition of the taps */
+
+    STAGE_MODE_FFT,     /* Overlap-save fast convolution, with the output
+                         * of each inverse FFT then being decimated */
+
+    STAGE_MODE_CIC,     /* Cascaded integrator-comb decimator. This is
+                         * used only for, and by, "cic" stages. */
+};
+
+/* Filter stage types, specified by the optional "type" stage entry */
+enum stage_type {
+    STAGE_TYPE_FIR,
+    STAGE_TYPE_HALFBAND,
+    STAGE_TYPE_CIC,
+};
+
+/* Stage mode used when a stage does not specify one.
+ *
+ * Block mode outperforms stream mode on the shipped filters by roughly 2x
+ * (measured with fir_test, 8192 samples per call, on an x86-64 host), so it
+ * is the default. Stream mode may still be faster for long filters with
+ * small decimation factors, where its SIMD kernels are put to better use. */
+#define DEFAULT_STAGE_MODE STAGE_MODE_BLOCK
+
+/* When a stage does not specify a mode, FFT mode is used in place of the
+ * default if its estimated cost is lower. Costs are estimated in real
+ * multiplies per input sample, with those of FFT mode scaled by this value
+ * to account for block mode's inner loops vectorizing far better than the
+ * FFT's butterflies. This was chosen by comparing fir_test throughput of the
+ * two modes across filter lengths, at 8192 samples per call. */
+#define FFT_COST_SCALE 3.5
+
+/* Largest FFT length considered when selecting FFT mode */
+#define FFT_MAX_LEN ((size_t) 1 << 16)
+
+/* Taps that must be zero in a "halfband" stage are required to be no larger
+ * than this, relative to the largest tap. This allows for the rounding error
+ * in filter design tools' output. */
+#define HALFBAND_ZERO_TOLERANCE 1e-9
+
+/* CIC stages operate on integers. Input samples are expected to be within
+ * [-1.0, 1.0), and are converted to CIC_INPUT_BITS-bit values, saturating
+ * values outside of this range. */
+#define CIC_INPUT_BITS  16
+#define CIC_INPUT_SCALE 32768.0f
+
+#define CIC_MAX_ORDER   8
+#define CIC_MAX_DELAY   8
+
+/* Fixed-point stages operate on SC16Q11 samples, as provided by the bladeRF.
+ * Taps are quantized to 16-bit values with up to FIXED_MAX_SHIFT fractional
+ * bits, chosen per stage such that the 32-bit accumulators cannot overflow. */
+#define FIXED_SAMPLE_SCALE  2048.0f
+#define FIXED_MAX_SHIFT     24
+
+/* Number of block-mode outputs computed per pass over the taps. This keeps
+ * the accumulators and the portion of the phase buffers being used in L1. */
+#define BLOCK_TILE_LEN 256
+
+struct fir_stage;
+
+/* Block mode: A pair of mirrored taps of a symmetric filter, folded into a
+ * single tap. `a` and `b` are the offsets of the samples the tap is applied
+ * to, relative to the start of the phase buffers. */
+struct fold_tap {
+    float tap;
+    size_t a;
+    size_t b;
+};
+
+typedef size_t (*perform_fn)(struct fir_stage *f,
+                             const struct complexf_planar *in, size_t n,
+                             const struct complexf_planar *out);
+
+typedef size_t (*perform_fixed_fn)(struct fir_stage *f,
+                                   const int16_t *in, size_t n,
+                                   int16_t *out);
+
 struct fir_stage {
 
     /* Properties */
@@ -43,7 +148,18 @@ struct fir_stage {
     float *taps;
     size_t num_taps;
 
-    /* Current state */
+    enum stage_mode mode;
+    perform_fn perform;
+
+    /* Symmetry exploited by the stage. This is FIR_SYMMETRY_NONE if the taps
+     * are not symmetric or folding has been disabled. */
+    enum fir_symmetry symmetry;
+
+    /* Stream mode: Convolution kernel and the taps arranged as it expects */
+    const struct fir_kernel *kernel;
+    float *kernel_taps;
+
+    /* Stream mode: Current state */
     size_t count;
 
     struct complexf *state;   /* Current state buffer that's twice as long
@@ -53,343 +169,2776 @@ struct fir_stage {
     struct complexf *ins1;    /* Insertion point 1 in state */
     struct complexf *ins2;    /* Insertion point 2 in state */
 
-    struct complexf *output;  /* Output buffer */
-    size_t output_len;        /* Output buffer length, in samples */
+    /* Block mode: Polyphase decomposition of the taps. This consists of
+     * `decimation` subfilters, each `poly_len` taps long, where
+     * poly_taps[p * poly_len + k] = taps[k * decimation + p]. Subfilters are
+     * zero-padded if num_taps is not a multiple of the decimation. */
+    float *poly_taps;
+    size_t poly_len;
+
+    /* Block mode: Folded taps, used in place of poly_taps when the stage
+     * is symmetric. Pairs of zero taps, such as those in a half-band
+     * filter, are omitted. The center tap of an odd-length filter, if
+     * non-zero, is applied separately as a single scale. */
+    struct fold_tap *fold_taps;
+    size_t num_fold_taps;
+    float center_tap;
+    size_t center_offset;
+
+    /* Block mode: Kernel specialized for the number of folded taps of an
+     * even-symmetric stage, or NULL if there is none. Its taps and sample
+     * offsets are those of fold_taps, followed by the center tap, if
+     * non-zero. This is applied as half its value to the center sample,
+     * twice, which yields exactly the same result. */
+    const struct fir_block_kernel *block_kernel;
+    float *block_taps;
+    size_t *block_offsets;
+
+    /* FFT mode: The taps' transform, scaled by 1/fft_len. Each transform
+     * consumes up to fft_step new samples, preceded by (num_taps - 1)
+     * samples of history. */
+    struct fft *fft;
+    size_t fft_len;
+    size_t fft_step;
+    struct complexf *fft_taps;
+
+    /* FFT mode: Current state. The decimation countdown is `count`. */
+    struct complexf *fft_buf;   /* Transform buffer of fft_len samples */
+    struct complexf *fft_hist;  /* Previous (num_taps - 1) input samples */
+
+    /* CIC: Properties and current state. Values wrap in two's complement
+     * arithmetic. This is benign, provided the registers are wide enough to
+     * represent the output, and is why unsigned values are used.
+     *
+     * Integrators are stored as {I, Q} pairs, from first to last. Each comb
+     * has a delay line of cic_delay {I, Q} pairs. The decimation countdown
+     * is `count`. */
+    unsigned int cic_order;
+    unsigned int cic_delay;
+    float cic_scale;            /* Scales output to unity DC gain */
+    uint64_t *cic_integ;
+    uint64_t *cic_comb;
+    unsigned int cic_comb_idx;  /* Oldest entry in each comb's delay line */
+    int32_t *cic_in;            /* Block of input, converted to integers */
+    uint64_t *cic_out;          /* Integrator output, at the output rate */
+
+    /* Fixed point: Taps quantized with `fixed_shift` fractional bits. These
+     * are arranged as poly_taps, or as fold_taps if the stage is folded.
+     * Samples are stored in phase buffers laid out as those of block mode.
+     * The CIC state above is used as-is. */
+    perform_fixed_fn perform_fixed;
+    fir_fixed_mac_fn fixed_mac;
+    int16_t *fixed_taps;
+    int16_t fixed_center_tap;
+    unsigned int fixed_shift;
+    int16_t *fixed_phase_buf;
+    int16_t *fixed_output;      /* Output buffer, as interleaved IQ */
+
+    /* Block mode: Current state
+     *
+     * Input is divided into frames of `decimation` samples. Each frame
+     * yields one output, computed upon receipt of the frame's last sample.
+     *
+     * The q-th sample of each frame is stored in phase buffer q, with I and Q
+     * stored in separate (planar) arrays. Each phase buffer contains
+     * (poly_len - 1) samples of history, followed by the samples received
+     * in the current call. */
+    float *phase_buf;
+    size_t phase_len;         /* Length of a single I or Q phase buffer */
+    unsigned int fill;        /* Samples received in the current frame */
+
+    struct complexf_planar output;  /* Output buffer */
+    size_t output_len;              /* Output buffer length, in samples */
 };
 
-struct fir_filter {
-    struct fir_stage *stages;
-    size_t num_stages;
-
-    size_t max_input;
-    unsigned int total_decimation;
+#if ENABLE_FIR_THREADS
+/* Pipelined operation: By default, the input to each filtering call is
+ * divided into this many blocks */
+#define PIPELINE_BLOCKS_PER_CALL 8
+
+/* Number of blocks that may be in flight between a pair of groups */
+#define PIPELINE_RING_SLOTS 4
+
+/* Block of samples passed from one group of stages to the next */
+struct fir_block {
+    struct complexf_planar buf;     /* Output of the group's last stage */
+    size_t n;                       /* Number of samples in buf */
+    bool first;                     /* First block of a filtering call */
+    bool quit;                      /* Workers are to exit */
+    const struct complexf_planar *output;   /* Filtering call's output */
 };
 
-struct fir_filter * fir_init(const char *filter_name, size_t max_input)
-{
-    int status = -1;
-
-    size_t i;
-    json_error_t error;
-    FILE *input;
-    json_t *root = NULL;
-    json_t *json_filt, *stages, *stage, *decimation, *taps, *tap;
-    struct fir_filter *fir = NULL;
+/* Worker thread running stages [first, last) */
+struct fir_worker {
+    struct fir_filter *filter;
+    size_t first;
+    size_t last;
 
-    unsigned int total_decimation = 1;
+    struct spsc_ring *in;           /* Blocks from the previous group */
+    struct fir_block *in_blocks;
 
-    input = find_filter_file(filter_name);
-    if (!input) {
-        log_error("Unable to find filter file: %s\n", filter_name);
-        goto out;
-    }
+    struct spsc_ring *out;          /* Blocks to the next group, or the
+                                     * number of outputs written by the
+                                     * last group, per block */
+    struct fir_block *out_blocks;   /* NULL for the last group */
+    size_t *done_counts;            /* Used only by the last group */
 
-    root = json_loadf(input, JSON_REJECT_DUPLICATES, &error);
-    if (!root) {
-        log_error("Error in %s (line %d, column %d):\n  %s\n",
-                 filter_name, error.line, error.column, error.text);
-        goto out;
-    }
+    pthread_t thread;
+    bool running;
+    int cpu;                        /* CPU to pin to, or -1 */
+};
 
-    json_filt = json_object_get(root, "filter");
-    if (!json_filt) {
-        log_error("Error: Failed to find \"filter\" entry in filter file.\n");
-        goto out;
-    }
+/* Stages [0, num_caller_stages) run on the calling thread. Each subsequent
+ * group of stages runs on its own worker thread, receiving blocks from
+ * rings[i] and the blocks[i] slots. */
+struct fir_pipeline {
+    size_t num_caller_stages;
+    size_t block_len;
 
-    log_verbose("Loading filter...\n");
-    stages = json_object_get(json_filt, "stages");
-    if (!stages) {
-        log_error("Error: Failed to find \"stages\" entry in filter file.\n");
-        goto out;
-    }
+    size_t num_workers;
+    struct fir_worker *workers;
+    struct spsc_ring **rings;
+    struct fir_block **blocks;
 
-    if (!json_is_array(stages)) {
-        log_error("Error: \"filter\" entry in filter file is not an array.\n");
-        goto out;
-    }
+    struct spsc_ring *done;         /* Last group -> calling thread */
+    size_t *done_counts;
+};
+#endif
 
-    fir = calloc(1, sizeof(fir[0]));
-    if (!fir) {
-        log_error("Error: Failed to allocate FIR.\n");
-        goto out;
-    }
+struct fir_filter {
+    struct fir_stage *stages;
+    size_t num_stages;
 
-    fir->num_stages = json_array_size(stages);
-    if (fir->num_stages == 0) {
-        log_error("Error: Filter must have 1 or more stages.\n");
-        goto out;
-    }
+    size_t max_input;
+    unsigned int total_decimation;
 
-    fir->stages = calloc(fir->num_stages, sizeof(fir->stages[0]));
-    if (!fir->stages) {
-        goto out;
-    }
+    /* Input to fir_filter_and_decimate(), converted to planar form */
+    struct complexf_planar input;
 
-    for (i = 0; i < fir->num_stages; i++) {
-        size_t len;
-        size_t tap_idx;
+    /* Number of leading stages run by fir_filter_and_decimate_sc16q11() */
+    size_t num_fixed_stages;
 
-        stage = json_array_get(stages, i);
-        if (!stage) {
-            log_error("Error: Failed to get filter stage %zd\n", i);
-            goto out;
-        }
+    /* Envelope detection is performed on the output of stage
+     * `envelope_stage` (1-based), or not at all if this is 0. The stages
+     * that follow operate on the real-valued envelope, in envelope_buf. */
+    enum fir_envelope envelope;
+    size_t envelope_stage;
+    float *envelope_buf;
 
-        decimation = json_object_get(stage, "decimation");
-        if (decimation) {
-            json_int_t val;
+    /* Estimated costs of the stages as written and as planned, if the
+     * filter's "optimize" entry is true */
+    bool planned;
+    double written_cost;
+    double planned_cost;
 
-            if (!json_is_integer(decimation)) {
-                log_error("Error: Decimation must be an integer.\n");
-                goto out;
-            }
+    /* Worker threads, if fir_enable_pipeline() has been called */
+    struct fir_pipeline *pipeline;
+};
 
-            val = json_integer_value(decimation);
-            if (val <= 0 || val >= UINT_MAX) {
-                log_error("Error: Decimation value is outside of allowed range.\n");
-                goto out;
-            }
+static size_t perform_stage(struct fir_stage *f,
+                            const struct complexf_planar *in, size_t n,
+                            const struct complexf_planar *out);
 
-            fir->stages[i].decimation = (unsigned int) val;
-        } else {
-            fir->stages[i].decimation = 1;
-        }
+static size_t perform_block_stage(struct fir_stage *f,
+                                  const struct complexf_planar *in, size_t n,
+                                  const struct complexf_planar *out);
 
-        total_decimation *= fir->stages[i].decimation;
+static size_t perform_fft_stage(struct fir_stage *f,
+                                const struct complexf_planar *in, size_t n,
+                                const struct complexf_planar *out);
 
-        taps = json_object_get(stage, "taps");
-        if (!taps) {
-            log_error("Error: Filter stage is missing \"taps\" entry.\n");
-            goto out;
-        }
+static size_t perform_cic_stage(struct fir_stage *f,
+                                const struct complexf_planar *in, size_t n,
+                                const struct complexf_planar *out);
 
-        if (!json_is_array(taps)) {
-            log_error("Error: Filter \"taps\" must be an array.\n");
-            goto out;
-        }
+static size_t perform_block_stage_real(struct fir_stage *f,
+                                       const float *in, size_t n, float *out);
 
-        fir->stages[i].num_taps = json_array_size(taps);
-        if (fir->stages[i].num_taps <= 0) {
-            log_error("Error: "
-                      "Filter stage %zd must have 1 or more taps.\n", i + 1);
-            goto out;
-        }
+static size_t perform_block_stage_fixed(struct fir_stage *f,
+                                        const int16_t *in, size_t n,
+                                        int16_t *out);
 
-        /* Allocate twice the num_taps we need so we can use two insertion
-         * points instead of moving elements around for a "shift" operation */
-        len = 2 * fir->stages[i].num_taps * sizeof(fir->stages[i].state[0]);
-        fir->stages[i].state = malloc(len);
+static size_t perform_cic_stage_fixed(struct fir_stage *f,
+                                      const int16_t *in, size_t n,
+                                      int16_t *out);
 
-        if (!fir->stages[i].state) {
-            log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
-            goto out;
-        }
+static void pipeline_deinit(struct fir_filter *filter);
 
-        len = fir->stages[i].num_taps * sizeof(fir->stages[i].taps[0]);
-        fir->stages[i].taps = malloc(len);
+static inline float * phase_real(const struct fir_stage *f, unsigned int q)
+{
+    return &f->phase_buf[2 * q * f->phase_len];
+}
 
-        if (!fir->stages[i].taps) {
-            log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
-            goto out;
-        }
+static inline float * phase_imag(const struct fir_stage *f, unsigned int q)
+{
+    return &f->phase_buf[(2 * q + 1) * f->phase_len];
+}
 
-        /* Output buffer needs to fit: integer_ceil(total_num_taps / decimation) */
-        fir->stages[i].output_len =
-            (max_input + total_decimation - 1) / total_decimation;
+static inline int16_t * fixed_phase_real(const struct fir_stage *f,
+                                         unsigned int q)
+{
+    return &f->fixed_phase_buf[2 * q * f->phase_len];
+}
 
-        log_verbose("Stage %zd output buffer length: %zd\n",
-                    i + 1, fir->stages[i].output_len);
+static inline int16_t * fixed_phase_imag(const struct fir_stage *f,
+                                         unsigned int q)
+{
+    return &f->fixed_phase_buf[(2 * q + 1) * f->phase_len];
+}
 
-        len = fir->stages[i].output_len * sizeof(fir->stages[i].output[0]);
+static const char * kernel_variant(const struct fir_kernel *kernel)
+{
+    switch (kernel->symmetry) {
+        case FIR_SYMMETRY_NONE:
+            return "unfolded";
 
-        if (len <= 0) {
-            log_error("Bug: Invalid output buffer length encountered.\n");
-            goto out;
-        }
+        case FIR_SYMMETRY_HALFBAND:
+            return "half-band";
 
-        fir->stages[i].output = malloc(len);
-        if (!fir->stages[i].output) {
-            log_error("Failed to allocate output buffer.\n");
-            goto out;
-        }
+        default:
+            return "folded";
+    }
+}
 
-        json_array_foreach(taps, tap_idx, tap) {
-            if (!json_is_number(tap)) {
-                log_error("Error: tap %zd in stage %zd is an invalid value.\n",
-                          tap_idx + 1, i + 1);
-                goto out;
-            }
+static bool set_stage_kernel(struct fir_stage *stage,
+                             const struct fir_kernel *kernel)
+{
+    float *taps = fir_kernel_prepare_taps(kernel, stage->taps, stage->num_taps);
 
-            fir->stages[i].taps[tap_idx] = (float) json_number_value(tap);
-        }
+    if (!taps) {
+        log_error("Error: Failed to allocate kernel taps.\n");
+        return false;
     }
 
-    fir->max_input = max_input;
-    fir->total_decimation = total_decimation;
+    free(stage->kernel_taps);
+    stage->kernel_taps = taps;
+    stage->kernel = kernel;
+    return true;
+}
 
-    fir_reset(fir);
-    status = 0;
+static bool init_stream_stage(struct fir_stage *stage, size_t i)
+{
+    size_t len;
 
-out:
-    if (input) {
-        fclose(input);
-    }
+    /* Allocate twice the num_taps we need so we can use two insertion
+     * points instead of moving elements around for a "shift" operation */
+    len = 2 * stage->num_taps * sizeof(stage->state[0]);
+    stage->state = malloc(len);
 
-    if (root) {
-        json_decref(root);
+    if (!stage->state) {
+        log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
+        return false;
     }
 
-    if (status != 0) {
-        fir_deinit(fir);
-        fir = NULL;
+    if (!set_stage_kernel(stage, fir_kernel_best(stage->num_taps,
+                                                 stage->symmetry))) {
+        return false;
     }
 
-    return fir;
+    stage->perform = perform_stage;
+    return true;
 }
 
-void fir_deinit(struct fir_filter *fir)
+/* Offset of the sample that tap `t` is applied to, for the first output of
+ * a block, relative to the start of the phase buffers. */
+static inline size_t tap_offset(const struct fir_stage *f, size_t t)
 {
-    size_t i;
+    const unsigned int q = f->decimation - 1 - (t % f->decimation);
+    return (phase_real(f, q) - f->phase_buf) + (f->poly_len - 1) -
+           (t / f->decimation);
+}
 
-    if (!fir) {
-        return;
+static bool init_fold_taps(struct fir_stage *stage, size_t i)
+{
+    size_t t, n;
+    const size_t half = stage->num_taps / 2;
+
+    stage->fold_taps = calloc(half + 1, sizeof(stage->fold_taps[0]));
+    if (!stage->fold_taps) {
+        log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
+        return false;
     }
 
-    if (fir->stages) {
-        for (i = 0; i < fir->num_stages; i++) {
-            free(fir->stages[i].state);
-            free(fir->stages[i].taps);
-            free(fir->stages[i].output);
+    /* The newest sample of each pair is `a`, such that the odd-symmetric
+     * case computes taps[t] * (x[n - t] - x[n - (N - 1 - t)]) */
+    for (t = n = 0; t < half; t++) {
+        if (stage->taps[t] != 0) {
+            stage->fold_taps[n].tap = stage->taps[t];
+            stage->fold_taps[n].a   = tap_offset(stage, t);
+            stage->fold_taps[n].b   = tap_offset(stage, stage->num_taps - 1 - t);
+            n++;
         }
+    }
 
-        free(fir->stages);
+    stage->num_fold_taps = n;
+
+    if (stage->num_taps & 1) {
+        stage->center_tap    = stage->taps[half];
+        stage->center_offset = tap_offset(stage, half);
     }
 
-    free(fir);
+    return true;
 }
 
-void fir_reset(struct fir_filter *filter)
+static bool init_block_kernel(struct fir_stage *stage, size_t i)
 {
-    size_t i;
-    size_t s;
+    size_t t;
+    const size_t n = stage->num_fold_taps + (stage->center_tap != 0);
 
-    struct fir_stage *stage;
+    if (stage->symmetry == FIR_SYMMETRY_ODD) {
+        return true;
+    }
 
-    for (s = 0; s < filter->num_stages; s++) {
-        stage = &filter->stages[s];
+    stage->block_kernel = fir_kernel_block(n);
+    if (!stage->block_kernel) {
+        return true;
+    }
 
-        for (i = 0; i < (2 * stage->num_taps); i++) {
-            stage->state[i].real = stage->state[i].imag = 0.0f;
-        }
+    stage->block_taps    = malloc(n * sizeof(stage->block_taps[0]));
+    stage->block_offsets = malloc(2 * n * sizeof(stage->block_offsets[0]));
 
-        for (i = 0; i < stage->output_len; i++) {
-            stage->output[i].real = stage->output[i].imag = 0.0f;
-        }
+    if (!stage->block_taps || !stage->block_offsets) {
+        log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
+        return false;
+    }
 
-        stage->count = stage->decimation;
+    for (t = 0; t < stage->num_fold_taps; t++) {
+        stage->block_taps[t]            = stage->fold_taps[t].tap;
+        stage->block_offsets[2 * t]     = stage->fold_taps[t].a;
+        stage->block_offsets[2 * t + 1] = stage->fold_taps[t].b;
+    }
 
-        stage->ins1 = &stage->state[0];
-        stage->ins2 = &stage->state[stage->num_taps];
+    if (stage->center_tap != 0) {
+        stage->block_taps[t]            = stage->center_tap / 2;
+        stage->block_offsets[2 * t]     = stage->center_offset;
+        stage->block_offsets[2 * t + 1] = stage->center_offset;
     }
-}
 
-unsigned int fir_get_total_decimation(struct fir_filter *f)
-{
-    return f->total_decimation;
+    return true;
 }
 
-static inline bool update(struct fir_stage *f, struct complexf *out)
+static bool init_block_stage(struct fir_stage *stage, size_t i,
+                             size_t max_stage_input)
 {
-    bool updated_output = false;
+    size_t p, k, len;
+    const unsigned int d = stage->decimation;
 
-    f->count--;
-
-    /* Perform convolution when decimation countdown reaches 0 */
-    if (f->count == 0) {
-        size_t i;
-        const struct complexf *x = f->ins2;
+    stage->poly_len = (stage->num_taps + d - 1) / d;
 
-        out->real = out->imag = 0;
+    stage->poly_taps = calloc(d * stage->poly_len, sizeof(stage->poly_taps[0]));
+    if (!stage->poly_taps) {
+        log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
+        return false;
+    }
 
-        for (i = 0; i < f->num_taps; i++, x--) {
-            out->real += f->taps[i] * x->real;
-            out->imag += f->taps[i] * x->imag;
+    for (p = 0; p < d; p++) {
+        for (k = 0; (k * d + p) < stage->num_taps; k++) {
+            stage->poly_taps[p * stage->poly_len + k] = stage->taps[k * d + p];
         }
+    }
 
+    /* History, plus all the frames that may be completed in a single call,
+     * plus the frame that may be left incomplete at the end of a call.
+     * This is rounded up to keep each phase buffer aligned. */
+    stage->phase_len = (stage->poly_len - 1) +
+                       (max_stage_input + d - 1) / d + 1;
 
-        updated_output = true;
-        f->count = f->decimation;
-    }
+    stage->phase_len = (stage->phase_len + 15) & ~((size_t) 15);
 
-    f->ins1++;
-    f->ins2++;
+    len = 2 * d * stage->phase_len * sizeof(stage->phase_buf[0]);
+    stage->phase_buf = fir_kernel_alloc(len);
+    if (!stage->phase_buf) {
+        log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
+        return false;
+    }
 
-    if (f->ins2 == &f->state[2 * f->num_taps]) {
-        f->ins1 = &f->state[0];
-        f->ins2 = &f->state[f->num_taps];
+    if (stage->symmetry != FIR_SYMMETRY_NONE) {
+        if (!init_fold_taps(stage, i) || !init_block_kernel(stage, i)) {
+            return false;
+        }
     }
 
-    return updated_output;
+    stage->perform = perform_block_stage;
+    return true;
 }
 
-static size_t inline perform_stage(struct fir_stage *f,
-                                   const struct complexf *in, size_t n,
-                                   struct complexf *out)
+/* Estimated real multiplies per input sample in block mode */
+static double block_cost(const struct fir_stage *stage)
 {
-    size_t i;
-    size_t num_out = 0;
+    return fir_plan_block_cost(stage->num_taps, stage->decimation,
+                               stage->symmetry);
+}
 
-    for (i = 0; i < n; i++) {
-        *f->ins1 = *f->ins2 = in[i];
-        if (update(f, out)) {
-            log_verbose("out[%zd] = %f + %fj\n", num_out, out->real, out->imag);
-            out++;
-            num_out++;
-        }
+/* Estimated real multiplies per input sample in FFT mode, for a transform
+ * of length `len`. This consists of the forward and inverse radix-2
+ * transforms and the multiplication by the taps' transform. */
+static double fft_cost(const struct fir_stage *stage, size_t len,
+                       size_t max_stage_input)
+{
+    size_t step = len - (stage->num_taps - 1);
+
+    if (step > max_stage_input) {
+        step = max_stage_input;
     }
 
-    return num_out;
+    return FFT_COST_SCALE * (4.0 * len * log2((double) len) + 4.0 * len) / step;
 }
 
-size_t fir_filter_and_decimate(struct fir_filter *filter,
-                               const struct complexf *fn_input, size_t count,
-                               struct complexf *fn_output)
+/* Select the FFT length with the lowest estimated cost */
+static size_t select_fft_len(const struct fir_stage *stage,
+                             size_t max_stage_input, double *best)
 {
-    const struct complexf *input;
-    struct complexf *output;
-    size_t s;
-    size_t n_in;
-    size_t n_out = count;
+    size_t len, ret = 0;
+    double cost;
 
-    for (s = 0; s < filter->num_stages; s++) {
+    *best = HUGE_VAL;
 
-        /* Select output from previous stage or fn input for first stage */
-        if (s == 0) {
-            input = fn_input;
-            log_verbose("Stage %zd input is fn_input (%p)\n", s + 1, input);
-        } else {
-            input = filter->stages[s-1].output;
-            log_verbose("Stage %zd input is Stage %zd output (%p) \n",
-                        s + 1, s, input);
+    for (len = 2; len <= FFT_MAX_LEN; len <<= 1) {
+        if (len < stage->num_taps) {
+            continue;
         }
 
-        /* Write output to next stage, or function output on last stage */
-        if (s == (filter->num_stages - 1)) {
-            output = fn_output;
-            log_verbose("Stage %zd output is fn output (%p)\n",
-                        s + 1, output);
-        } else {
-            output = filter->stages[s].output;
-            log_verbose("Stage %zd output is internal buffer (%p)\n",
-                        s + 1, output);
+        cost = fft_cost(stage, len, max_stage_input);
+        if (cost < *best) {
+            *best = cost;
+            ret = len;
+        }
+
+        /* Larger transforms would not be filled */
+        if ((len - (stage->num_taps - 1)) >= max_stage_input) {
+            break;
         }
+    }
 
-        n_in  = n_out;
-        n_out = perform_stage(&filter->stages[s], input, n_in, output);
+    return ret;
+}
 
-        log_verbose("Stage %zd: %zd in, %zd out\n", s + 1, n_in, n_out);
+static bool init_fft_stage(struct fir_stage *stage, size_t i,
+                           size_t max_stage_input)
+{
+    size_t t;
+    double cost;
+    const size_t hist_len = stage->num_taps - 1;
+
+    stage->fft_len = select_fft_len(stage, max_stage_input, &cost);
+    if (stage->fft_len == 0) {
+        log_error("Error: Filter stage %zd is too long for FFT mode.\n", i + 1);
+        return false;
     }
 
-    return n_out;
+    stage->fft_step = stage->fft_len - hist_len;
+
+    stage->fft = fft_init(stage->fft_len);
+    if (!stage->fft) {
+        return false;
+    }
+
+    stage->fft_taps = calloc(stage->fft_len, sizeof(stage->fft_taps[0]));
+    stage->fft_buf  = malloc(stage->fft_len * sizeof(stage->fft_buf[0]));
+
+    /* Ensure a valid pointer is returned for a single-tap filter */
+    stage->fft_hist = malloc((hist_len + 1) * sizeof(stage->fft_hist[0]));
+
+    if (!stage->fft_taps || !stage->fft_buf || !stage->fft_hist) {
+        log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
+        return false;
+    }
+
+    for (t = 0; t < stage->num_taps; t++) {
+        stage->fft_taps[t].real = stage->taps[t] / stage->fft_len;
+    }
+
+    fft_forward(stage->fft, stage->fft_taps);
+
+    stage->perform = perform_fft_stage;
+    return true;
+}
+
+static bool get_stage_mode(json_t *stage, enum stage_mode *mode,
+                           bool *specified)
+{
+    const char *str;
+    json_t *tmp = json_object_get(stage, "mode");
+
+    *specified = (tmp != NULL);
+
+    if (!tmp) {
+        *mode = DEFAULT_STAGE_MODE;
+        return true;
+    }
+
+    str = json_string_value(tmp);
+    if (!str) {
+        log_error("Error: Filter stage \"mode\" must be a string.\n");
+        return false;
+    }
+
+    if (!strcasecmp(str, "stream")) {
+        *mode = STAGE_MODE_STREAM;
+    } else if (!strcasecmp(str, "block")) {
+        *mode = STAGE_MODE_BLOCK;
+    } else if (!strcasecmp(str, "fft")) {
+        *mode = STAGE_MODE_FFT;
+    } else {
+        log_error("Error: Invalid filter stage mode: %s\n", str);
+        return false;
+    }
+
+    return true;
+}
+
+static bool get_stage_fold(json_t *stage, bool *fold)
+{
+    json_t *tmp = json_object_get(stage, "fold_symmetric");
+
+    if (!tmp) {
+        *fold = true;
+        return true;
+    }
+
+    if (!json_is_boolean(tmp)) {
+        log_error("Error: Filter stage \"fold_symmetric\" must be a boolean.\n");
+        return false;
+    }
+
+    *fold = json_is_true(tmp);
+    return true;
+}
+
+static bool get_stage_type(json_t *stage, enum stage_type *type)
+{
+    const char *str;
+    json_t *tmp = json_object_get(stage, "type");
+
+    *type = STAGE_TYPE_FIR;
+
+    if (!tmp) {
+        return true;
+    }
+
+    str = json_string_value(tmp);
+    if (!str) {
+        log_error("Error: Filter stage \"type\" must be a string.\n");
+        return false;
+    }
+
+    if (!strcasecmp(str, "halfband")) {
+        *type = STAGE_TYPE_HALFBAND;
+    } else if (!strcasecmp(str, "cic")) {
+        *type = STAGE_TYPE_CIC;
+    } else if (strcasecmp(str, "fir")) {
+        log_error("Error: Invalid filter stage type: %s\n", str);
+        return false;
+    }
+
+    return true;
+}
+
+/* Get an optional, bounded integer property of a stage */
+static bool get_stage_uint(json_t *stage, const char *key,
+                           unsigned int min, unsigned int max,
+                           unsigned int def, unsigned int *value)
+{
+    json_int_t val;
+    json_t *tmp = json_object_get(stage, key);
+
+    if (!tmp) {
+        *value = def;
+        return true;
+    }
+
+    if (!json_is_integer(tmp)) {
+        log_error("Error: Filter stage \"%s\" must be an integer.\n", key);
+        return false;
+    }
+
+    val = json_integer_value(tmp);
+    if (val < min || val > max) {
+        log_error("Error: Filter stage \"%s\" must be in [%u, %u].\n",
+                  key, min, max);
+        return false;
+    }
+
+    *value = (unsigned int) val;
+    return true;
+}
+
+static bool init_cic_stage(struct fir_stage *f, json_t *stage, size_t i,
+                           size_t max_stage_input)
+{
+    unsigned int bits;
+    double gain;
+
+    if (json_object_get(stage, "taps") || json_object_get(stage, "mode")) {
+        log_error("Error: CIC filter stage %zd may not specify \"taps\" "
+                  "or \"mode\".\n", i + 1);
+        return false;
+    }
+
+    if (!get_stage_uint(stage, "order", 1, CIC_MAX_ORDER, 0, &f->cic_order)) {
+        return false;
+    } else if (f->cic_order == 0) {
+        log_error("Error: CIC filter stage %zd is missing \"order\".\n", i + 1);
+        return false;
+    }
+
+    if (!get_stage_uint(stage, "differential_delay", 1, CIC_MAX_DELAY, 1,
+                        &f->cic_delay)) {
+        return false;
+    }
+
+    /* Register growth is order * log2(decimation * delay) bits */
+    gain = pow((double) f->decimation * f->cic_delay, f->cic_order);
+    bits = CIC_INPUT_BITS + (unsigned int) ceil(log2(gain));
+
+    if (bits > 64) {
+        log_error("Error: CIC filter stage %zd requires %u-bit registers. "
+                  "Reduce its order or decimation.\n", i + 1, bits);
+        return false;
+    }
+
+    f->cic_scale = (float) (1.0 / (CIC_INPUT_SCALE * gain));
+
+    f->cic_integ = calloc(2 * f->cic_order, sizeof(f->cic_integ[0]));
+    f->cic_comb  = calloc(2 * f->cic_order * f->cic_delay,
+                          sizeof(f->cic_comb[0]));
+    f->cic_in    = malloc(2 * max_stage_input * sizeof(f->cic_in[0]));
+    f->cic_out   = malloc(2 * f->output_len * sizeof(f->cic_out[0]));
+
+    if (!f->cic_integ || !f->cic_comb || !f->cic_in || !f->cic_out) {
+        log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
+        return false;
+    }
+
+    f->mode = STAGE_MODE_CIC;
+    f->perform = perform_cic_stage;
+    return true;
+}
+
+/* Zero the taps that are expected to be zero in a half-band filter, after
+ * verifying they are sufficiently close to zero. */
+static bool init_halfband_taps(struct fir_stage *stage, size_t i)
+{
+    size_t t;
+    float max = 0;
+    enum fir_symmetry symmetry;
+
+    if ((stage->num_taps & 1) == 0) {
+        log_error("Error: Half-band filter stage %zd must have an odd "
+                  "number of taps.\n", i + 1);
+        return false;
+    }
+
+    for (t = 0; t < stage->num_taps; t++) {
+        if (fabsf(stage->taps[t]) > max) {
+            max = fabsf(stage->taps[t]);
+        }
+    }
+
+    for (t = 0; t < stage->num_taps; t++) {
+        if (fir_kernel_halfband_zero(stage->num_taps, t)) {
+            if (fabsf(stage->taps[t]) > HALFBAND_ZERO_TOLERANCE * max) {
+                log_error("Error: Tap %zd in half-band filter stage %zd "
+                          "must be zero.\n", t + 1, i + 1);
+                return false;
+            }
+
+            stage->taps[t] = 0;
+        }
+    }
+
+    symmetry = fir_kernel_symmetry(stage->taps, stage->num_taps);
+
+    /* 3-tap filters have no zero taps, and are not detected as half-band */
+    if (symmetry != FIR_SYMMETRY_HALFBAND && symmetry != FIR_SYMMETRY_EVEN) {
+        log_error("Error: Half-band filter stage %zd taps are not "
+                  "symmetric.\n", i + 1);
+        return false;
+    }
+
+    stage->symmetry = FIR_SYMMETRY_HALFBAND;
+    return true;
+}
+
+/* Read the optional "optimize" and "optimize_tolerance" filter entries */
+static bool get_optimize(json_t *json_filt, bool *optimize, double *tolerance)
+{
+    json_t *tmp = json_object_get(json_filt, "optimize");
+
+    *optimize = false;
+    *tolerance = FIR_PLAN_DEFAULT_TOLERANCE;
+
+    if (tmp) {
+        if (!json_is_boolean(tmp)) {
+            log_error("Error: \"optimize\" must be a boolean.\n");
+            return false;
+        }
+
+        *optimize = json_is_true(tmp);
+    }
+
+    tmp = json_object_get(json_filt, "optimize_tolerance");
+    if (tmp) {
+        if (!json_is_number(tmp) || json_number_value(tmp) <= 0) {
+            log_error("Error: \"optimize_tolerance\" must be a positive "
+                      "number.\n");
+            return false;
+        }
+
+        *tolerance = json_number_value(tmp);
+    }
+
+    return true;
+}
+
+/* Read the optional "envelope_after_stage" and "envelope" filter entries */
+static bool get_envelope(json_t *json_filt, struct fir_filter *fir)
+{
+    const char *str;
+    json_int_t val;
+    json_t *stage = json_object_get(json_filt, "envelope_after_stage");
+    json_t *type  = json_object_get(json_filt, "envelope");
+
+    if (!stage) {
+        if (type) {
+            log_error("Error: \"envelope\" requires "
+                      "\"envelope_after_stage\".\n");
+            return false;
+        }
+
+        fir->envelope = FIR_ENVELOPE_NONE;
+        return true;
+    }
+
+    if (!json_is_integer(stage)) {
+        log_error("Error: \"envelope_after_stage\" must be an integer.\n");
+        return false;
+    }
+
+    val = json_integer_value(stage);
+    if (val < 1 || (size_t) val > fir->num_stages) {
+        log_error("Error: \"envelope_after_stage\" must be a stage number, "
+                  "1 through %zd.\n", fir->num_stages);
+        return false;
+    }
+
+    fir->envelope_stage = (size_t) val;
+    fir->envelope = FIR_ENVELOPE_MAGNITUDE;
+
+    if (type) {
+        str = json_string_value(type);
+        if (!str) {
+            log_error("Error: \"envelope\" must be a string.\n");
+            return false;
+        }
+
+        if (!strcasecmp(str, "magnitude")) {
+            fir->envelope = FIR_ENVELOPE_MAGNITUDE;
+        } else if (!strcasecmp(str, "power")) {
+            fir->envelope = FIR_ENVELOPE_POWER;
+        } else {
+            log_error("Error: Invalid envelope: %s\n", str);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct fir_filter * fir_init(const char *filter_name, size_t max_input)
+{
+    int status = -1;
+
+    size_t i;
+    json_error_t error;
+    FILE *input;
+    json_t *root = NULL;
+    json_t *planned = NULL;
+    json_t *json_filt, *stages, *stage, *decimation, *taps, *tap;
+    struct fir_filter *fir = NULL;
+    bool optimize;
+    double tolerance;
+
+    unsigned int total_decimation = 1;
+
+    input = find_filter_file(filter_name);
+    if (!input) {
+        log_error("Unable to find filter file: %s\n", filter_name);
+        goto out;
+    }
+
+    root = json_loadf(input, JSON_REJECT_DUPLICATES, &error);
+    if (!root) {
+        log_error("Error in %s (line %d, column %d):\n  %s\n",
+                 filter_name, error.line, error.column, error.text);
+        goto out;
+    }
+
+    json_filt = json_object_get(root, "filter");
+    if (!json_filt) {
+        log_error("Error: Failed to find \"filter\" entry in filter file.\n");
+        goto out;
+    }
+
+    log_verbose("Loading filter...\n");
+    stages = json_object_get(json_filt, "stages");
+    if (!stages) {
+        log_error("Error: Failed to find \"stages\" entry in filter file.\n");
+        goto out;
+    }
+
+    if (!json_is_array(stages)) {
+        log_error("Error: \"filter\" entry in filter file is not an array.\n");
+        goto out;
+    }
+
+    fir = calloc(1, sizeof(fir[0]));
+    if (!fir) {
+        log_error("Error: Failed to allocate FIR.\n");
+        goto out;
+    }
+
+    fir->num_stages = json_array_size(stages);
+    if (fir->num_stages == 0) {
+        log_error("Error: Filter must have 1 or more stages.\n");
+        goto out;
+    }
+
+    if (!get_envelope(json_filt, fir)) {
+        goto out;
+    }
+
+    if (!get_optimize(json_filt, &optimize, &tolerance)) {
+        goto out;
+    }
+
+    if (optimize) {
+        planned = fir_plan_stages(stages, tolerance, &fir->envelope_stage,
+                                  &fir->written_cost, &fir->planned_cost);
+        if (!planned) {
+            goto out;
+        }
+
+        log_debug("Planned filter has %zd stage(s). Estimated real "
+                  "multiplies per input sample: %.2f as written, %.2f as "
+                  "planned.\n",
+                  json_array_size(planned), fir->written_cost,
+                  fir->planned_cost);
+
+        stages = planned;
+        fir->num_stages = json_array_size(stages);
+        fir->planned = true;
+    }
+
+    fir->stages = calloc(fir->num_stages, sizeof(fir->stages[0]));
+    if (!fir->stages) {
+        goto out;
+    }
+
+    for (i = 0; i < fir->num_stages; i++) {
+        size_t len;
+        size_t tap_idx;
+        size_t max_stage_input;
+        bool fold;
+        enum stage_type type;
+        bool mode_specified;
+
+        /* Stages following envelope detection operate on real values */
+        const bool real = (fir->envelope_stage != 0 && i >= fir->envelope_stage);
+
+        /* Stage input is limited by the decimation of the prior stages */
+        max_stage_input = (max_input + total_decimation - 1) / total_decimation;
+
+        stage = json_array_get(stages, i);
+        if (!stage) {
+            log_error("Error: Failed to get filter stage %zd\n", i);
+            goto out;
+        }
+
+        decimation = json_object_get(stage, "decimation");
+        if (decimation) {
+            json_int_t val;
+
+            if (!json_is_integer(decimation)) {
+                log_error("Error: Decimation must be an integer.\n");
+                goto out;
+            }
+
+            val = json_integer_value(decimation);
+            if (val <= 0 || val >= UINT_MAX) {
+                log_error("Error: Decimation value is outside of allowed range.\n");
+                goto out;
+            }
+
+            fir->stages[i].decimation = (unsigned int) val;
+        } else {
+            fir->stages[i].decimation = 1;
+        }
+
+        total_decimation *= fir->stages[i].decimation;
+
+        /* Output buffer needs to fit: integer_ceil(total_num_taps / decimation) */
+        fir->stages[i].output_len =
+            (max_input + total_decimation - 1) / total_decimation;
+
+        log_verbose("Stage %zd output buffer length: %zd\n",
+                    i + 1, fir->stages[i].output_len);
+
+        if (fir->stages[i].output_len == 0) {
+            log_error("Bug: Invalid output buffer length encountered.\n");
+            goto out;
+        }
+
+        if (!complexf_planar_alloc(&fir->stages[i].output,
+                                   fir->stages[i].output_len)) {
+            log_error("Failed to allocate output buffer.\n");
+            goto out;
+        }
+
+        if (!get_stage_type(stage, &type)) {
+            goto out;
+        }
+
+        if (real && type == STAGE_TYPE_CIC) {
+            log_error("Error: Filter stage %zd follows envelope detection, "
+                      "and may not be a CIC stage.\n", i + 1);
+            goto out;
+        }
+
+        if (type == STAGE_TYPE_CIC) {
+            if (!init_cic_stage(&fir->stages[i], stage, i, max_stage_input)) {
+                goto out;
+            }
+
+            log_debug("Filter stage %zd: CIC, order=%u, decimation=%u, "
+                      "differential delay=%u\n", i + 1,
+                      fir->stages[i].cic_order, fir->stages[i].decimation,
+                      fir->stages[i].cic_delay);
+            continue;
+        }
+
+        taps = json_object_get(stage, "taps");
+        if (!taps) {
+            log_error("Error: Filter stage is missing \"taps\" entry.\n");
+            goto out;
+        }
+
+        if (!json_is_array(taps)) {
+            log_error("Error: Filter \"taps\" must be an array.\n");
+            goto out;
+        }
+
+        fir->stages[i].num_taps = json_array_size(taps);
+        if (fir->stages[i].num_taps <= 0) {
+            log_error("Error: "
+                      "Filter stage %zd must have 1 or more taps.\n", i + 1);
+            goto out;
+        }
+
+        if (!get_stage_mode(stage, &fir->stages[i].mode, &mode_specified)) {
+            goto out;
+        }
+
+        if (!get_stage_fold(stage, &fold)) {
+            goto out;
+        }
+
+        len = fir->stages[i].num_taps * sizeof(fir->stages[i].taps[0]);
+        fir->stages[i].taps = malloc(len);
+
+        if (!fir->stages[i].taps) {
+            log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
+            goto out;
+        }
+
+        json_array_foreach(taps, tap_idx, tap) {
+            if (!json_is_number(tap)) {
+                log_error("Error: tap %zd in stage %zd is an invalid value.\n",
+                          tap_idx + 1, i + 1);
+                goto out;
+            }
+
+            fir->stages[i].taps[tap_idx] = (float) json_number_value(tap);
+        }
+
+        if (type == STAGE_TYPE_HALFBAND) {
+            if (!init_halfband_taps(&fir->stages[i], i)) {
+                goto out;
+            }
+        } else if (fold) {
+            fir->stages[i].symmetry =
+                fir_kernel_symmetry(fir->stages[i].taps,
+                                    fir->stages[i].num_taps);
+        } else {
+            fir->stages[i].symmetry = FIR_SYMMETRY_NONE;
+        }
+
+        if (real && fir->stages[i].mode != STAGE_MODE_BLOCK) {
+            log_error("Error: Filter stage %zd follows envelope detection, "
+                      "and must use block mode.\n", i + 1);
+            goto out;
+        }
+
+        if (!mode_specified && !real) {
+            double cost;
+
+            if (select_fft_len(&fir->stages[i], max_stage_input, &cost) != 0 &&
+                cost < block_cost(&fir->stages[i])) {
+                fir->stages[i].mode = STAGE_MODE_FFT;
+            }
+        }
+
+        switch (fir->stages[i].mode) {
+            case STAGE_MODE_BLOCK:
+                if (!init_block_stage(&fir->stages[i], i, max_stage_input)) {
+                    goto out;
+                }
+
+                log_debug("Filter stage %zd: %zd taps, decimation=%u, "
+                          "block mode, symmetry=%s, %s%s%s%s\n", i + 1,
+                          fir->stages[i].num_taps, fir->stages[i].decimation,
+                          fir_symmetry_str(fir->stages[i].symmetry),
+                          fir->stages[i].fold_taps ? "folded" : "unfolded",
+                          fir->stages[i].block_kernel ?
+                            ", specialized kernel=" : "",
+                          fir->stages[i].block_kernel ?
+                            fir->stages[i].block_kernel->name : "",
+                          real ? ", real" : "");
+                break;
+
+            case STAGE_MODE_FFT:
+                if (!init_fft_stage(&fir->stages[i], i, max_stage_input)) {
+                    goto out;
+                }
+
+                log_debug("Filter stage %zd: %zd taps, decimation=%u, "
+                          "FFT mode, %zd-point FFT\n", i + 1,
+                          fir->stages[i].num_taps, fir->stages[i].decimation,
+                          fir->stages[i].fft_len);
+                break;
+
+            default:
+                if (!init_stream_stage(&fir->stages[i], i)) {
+                    goto out;
+                }
+
+                log_debug("Filter stage %zd: %zd taps, decimation=%u, "
+                          "stream mode, symmetry=%s, kernel=%s (%s)\n", i + 1,
+                          fir->stages[i].num_taps, fir->stages[i].decimation,
+                          fir_symmetry_str(fir->stages[i].symmetry),
+                          fir->stages[i].kernel->name,
+                          kernel_variant(fir->stages[i].kernel));
+        }
+    }
+
+    if (fir->envelope_stage != 0) {
+        const size_t n = fir->stages[fir->envelope_stage - 1].output_len;
+
+        fir->envelope_buf = malloc(n * sizeof(fir->envelope_buf[0]));
+        if (!fir->envelope_buf) {
+            log_error("Error: Failed to allocate envelope buffer.\n");
+            goto out;
+        }
+
+        log_debug("Envelope (%s) detection after stage %zd\n",
+                  fir->envelope == FIR_ENVELOPE_POWER ? "power" : "magnitude",
+                  fir->envelope_stage);
+    }
+
+    if (!complexf_planar_alloc(&fir->input, max_input)) {
+        log_error("Error: Failed to allocate input buffer.\n");
+        goto out;
+    }
+
+    fir->max_input = max_input;
+    fir->total_decimation = total_decimation;
+
+    fir_reset(fir);
+    status = 0;
+
+out:
+    if (input) {
+        fclose(input);
+    }
+
+    if (planned) {
+        json_decref(planned);
+    }
+
+    if (root) {
+        json_decref(root);
+    }
+
+    if (status != 0) {
+        fir_deinit(fir);
+        fir = NULL;
+    }
+
+    return fir;
+}
+
+void fir_deinit(struct fir_filter *fir)
+{
+    size_t i;
+
+    if (!fir) {
+        return;
+    }
+
+    pipeline_deinit(fir);
+
+    if (fir->stages) {
+        for (i = 0; i < fir->num_stages; i++) {
+            free(fir->stages[i].state);
+            free(fir->stages[i].taps);
+            free(fir->stages[i].kernel_taps);
+            free(fir->stages[i].poly_taps);
+            free(fir->stages[i].fold_taps);
+            free(fir->stages[i].block_taps);
+            free(fir->stages[i].block_offsets);
+            fft_deinit(fir->stages[i].fft);
+            free(fir->stages[i].fft_taps);
+            free(fir->stages[i].fft_buf);
+            free(fir->stages[i].fft_hist);
+            free(fir->stages[i].cic_integ);
+            free(fir->stages[i].cic_comb);
+            free(fir->stages[i].cic_in);
+            free(fir->stages[i].cic_out);
+            free(fir->stages[i].fixed_taps);
+            free(fir->stages[i].fixed_phase_buf);
+            free(fir->stages[i].fixed_output);
+            free(fir->stages[i].phase_buf);
+            complexf_planar_free(&fir->stages[i].output);
+        }
+
+        free(fir->stages);
+    }
+
+    complexf_planar_free(&fir->input);
+    free(fir->envelope_buf);
+    free(fir);
+}
+
+void fir_reset(struct fir_filter *filter)
+{
+    size_t i;
+    size_t s;
+
+    struct fir_stage *stage;
+
+    for (s = 0; s < filter->num_stages; s++) {
+        stage = &filter->stages[s];
+
+        memset(stage->output.real, 0,
+               stage->output_len * sizeof(stage->output.real[0]));
+
+        memset(stage->output.imag, 0,
+               stage->output_len * sizeof(stage->output.imag[0]));
+
+        if (stage->mode == STAGE_MODE_BLOCK) {
+            memset(stage->phase_buf, 0, 2 * stage->decimation *
+                                        stage->phase_len *
+                                        sizeof(stage->phase_buf[0]));
+
+            if (stage->fixed_phase_buf) {
+                memset(stage->fixed_phase_buf, 0,
+                       2 * stage->decimation * stage->phase_len *
+                       sizeof(stage->fixed_phase_buf[0]));
+            }
+
+            stage->fill = 0;
+        } else if (stage->mode == STAGE_MODE_CIC) {
+            memset(stage->cic_integ, 0,
+                   2 * stage->cic_order * sizeof(stage->cic_integ[0]));
+
+            memset(stage->cic_comb, 0, 2 * stage->cic_order *
+                                       stage->cic_delay *
+                                       sizeof(stage->cic_comb[0]));
+
+            stage->cic_comb_idx = 0;
+            stage->count = stage->decimation;
+        } else if (stage->mode == STAGE_MODE_FFT) {
+            memset(stage->fft_hist, 0,
+                   (stage->num_taps - 1) * sizeof(stage->fft_hist[0]));
+
+            stage->count = stage->decimation;
+        } else {
+            for (i = 0; i < (2 * stage->num_taps); i++) {
+                stage->state[i].real = stage->state[i].imag = 0.0f;
+            }
+
+            stage->count = stage->decimation;
+
+            stage->ins1 = &stage->state[0];
+            stage->ins2 = &stage->state[stage->num_taps];
+        }
+    }
+}
+
+unsigned int fir_get_total_decimation(struct fir_filter *f)
+{
+    return f->total_decimation;
+}
+
+enum fir_envelope fir_get_envelope(const struct fir_filter *f)
+{
+    return f->envelope;
+}
+
+bool fir_set_kernel(struct fir_filter *filter, const char *name)
+{
+    size_t s;
+    const struct fir_kernel *kernel;
+
+    if (!fir_kernel_get(name, FIR_SYMMETRY_NONE)) {
+        log_error("FIR kernel \"%s\" is invalid or not supported.\n", name);
+        return false;
+    }
+
+    for (s = 0; s < filter->num_stages; s++) {
+        struct fir_stage *stage = &filter->stages[s];
+
+        if (stage->mode != STAGE_MODE_STREAM) {
+            continue;
+        }
+
+        /* Not all kernels have folded variants */
+        kernel = fir_kernel_get(name, stage->symmetry);
+        if (!kernel) {
+            kernel = fir_kernel_get(name, FIR_SYMMETRY_NONE);
+        }
+
+        if (!set_stage_kernel(stage, kernel)) {
+            return false;
+        }
+
+        log_debug("Filter stage %zd kernel: %s (%s)\n", s + 1, kernel->name,
+                  kernel_variant(kernel));
+    }
+
+    return true;
+}
+
+static const char * stage_mode_str(enum stage_mode mode)
+{
+    switch (mode) {
+        case STAGE_MODE_STREAM:
+            return "stream";
+
+        case STAGE_MODE_BLOCK:
+            return "block";
+
+        case STAGE_MODE_FFT:
+            return "FFT";
+
+        case STAGE_MODE_CIC:
+            return "CIC";
+
+        default:
+            return "unknown";
+    }
+}
+
+/* Estimated real multiplies per input sample of the filter required by a
+ * stage, given the decimation of the stages preceding it */
+static double stage_cost(const struct fir_filter *filter, size_t i,
+                         unsigned int decimation)
+{
+    const struct fir_stage *stage = &filter->stages[i];
+    const size_t max_stage_input =
+        (filter->max_input + decimation - 1) / decimation;
+    double cost;
+
+    switch (stage->mode) {
+        case STAGE_MODE_CIC:
+            cost = 0;
+            break;
+
+        case STAGE_MODE_FFT:
+            cost = fft_cost(stage, stage->fft_len, max_stage_input);
+            break;
+
+        default:
+            cost = block_cost(stage);
+
+            /* Stages following envelope detection operate on real values */
+            if (filter->envelope_stage != 0 && i >= filter->envelope_stage) {
+                cost /= 2;
+            }
+    }
+
+    return cost / decimation;
+}
+
+void fir_print_plan(const struct fir_filter *filter, FILE *out,
+                    unsigned int samplerate)
+{
+    size_t i;
+    double cost, total = 0;
+    unsigned int decimation = 1;
+
+    fprintf(out, "Stage  Taps  Decimation  Mode    Symmetry  Fixed  "
+                 "Multiplies/sample\n");
+
+    for (i = 0; i < filter->num_stages; i++) {
+        const struct fir_stage *stage = &filter->stages[i];
+
+        cost = stage_cost(filter, i, decimation);
+        total += cost;
+
+        fprintf(out, "%-5zd  %-4zd  %-10u  %-6s  %-8s  %-5s  %.2f\n",
+                i + 1, stage->num_taps, stage->decimation,
+                stage_mode_str(stage->mode),
+                stage->mode == STAGE_MODE_CIC ?
+                    "-" : fir_symmetry_str(stage->symmetry),
+                i < filter->num_fixed_stages ? "yes" : "no",
+                cost);
+
+        decimation *= stage->decimation;
+
+        /* Envelope detection squares and sums I and Q */
+        if (i + 1 == filter->envelope_stage) {
+            char label[64];
+
+            cost = 2.0 / decimation;
+            total += cost;
+
+            snprintf(label, sizeof(label), "(%s envelope detection)",
+                     filter->envelope == FIR_ENVELOPE_POWER ?
+                        "power" : "magnitude");
+
+            fprintf(out, "       %-43s%.2f\n", label, cost);
+        }
+    }
+
+    fprintf(out, "Total: %.2f real multiplies per input sample", total);
+    if (samplerate != 0) {
+        fprintf(out, " (%.1f million per second at %u Hz)",
+                total * samplerate / 1e6, samplerate);
+    }
+    fprintf(out, "\n");
+
+    if (filter->planned) {
+        fprintf(out, "As written: %.2f real multiplies per input sample",
+                filter->written_cost);
+        if (samplerate != 0) {
+            fprintf(out, " (%.1f million per second)",
+                    filter->written_cost * samplerate / 1e6);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/* Quantize a tap with `shift` fractional bits */
+static inline long fixed_tap(float tap, unsigned int shift)
+{
+    return lrint(ldexp(tap, (int) shift));
+}
+
+/* Select the number of fractional bits used to quantize a block stage's taps.
+ * This is the largest value for which each tap fits in 16 bits, and for which
+ * the accumulators cannot overflow with full-scale input, or 0 if there is no
+ * such value. */
+static unsigned int fixed_tap_shift(const struct fir_stage *stage)
+{
+    size_t t;
+    unsigned int shift;
+
+    for (shift = FIXED_MAX_SHIFT; shift > 0; shift--) {
+        int64_t sum = (int64_t) 1 << (shift - 1);   /* Rounding */
+        bool fits = true;
+
+        for (t = 0; t < stage->num_taps && fits; t++) {
+            const long q = labs(fixed_tap(stage->taps[t], shift));
+
+            sum += (int64_t) q * -INT16_MIN;
+            fits = (q <= INT16_MAX) && (sum <= INT32_MAX);
+        }
+
+        if (fits) {
+            return shift;
+        }
+    }
+
+    return 0;
+}
+
+static bool init_fixed_taps(struct fir_stage *stage, size_t i)
+{
+    size_t t, n;
+
+    stage->fixed_shift = fixed_tap_shift(stage);
+
+    if (stage->fold_taps) {
+        n = stage->num_fold_taps;
+    } else {
+        n = stage->decimation * stage->poly_len;
+    }
+
+    stage->fixed_taps = calloc(n, sizeof(stage->fixed_taps[0]));
+    if (!stage->fixed_taps) {
+        log_error("Error: Failed to allocate filter %zd taps.\n", i + 1);
+        return false;
+    }
+
+    for (t = 0; t < n; t++) {
+        const float tap = stage->fold_taps ? stage->fold_taps[t].tap :
+                                             stage->poly_taps[t];
+
+        stage->fixed_taps[t] = (int16_t) fixed_tap(tap, stage->fixed_shift);
+    }
+
+    stage->fixed_center_tap =
+        (int16_t) fixed_tap(stage->center_tap, stage->fixed_shift);
+
+    return true;
+}
+
+static bool fixed_point_supported(const struct fir_stage *stage)
+{
+    return stage->mode == STAGE_MODE_CIC ||
+           (stage->mode == STAGE_MODE_BLOCK && fixed_tap_shift(stage) != 0);
+}
+
+static bool init_fixed_stage(struct fir_stage *stage, size_t i)
+{
+    size_t len;
+
+    if (stage->mode == STAGE_MODE_BLOCK) {
+        if (!init_fixed_taps(stage, i)) {
+            return false;
+        }
+
+        len = 2 * stage->decimation * stage->phase_len *
+              sizeof(stage->fixed_phase_buf[0]);
+
+        stage->fixed_phase_buf = fir_kernel_alloc(len);
+        if (!stage->fixed_phase_buf) {
+            log_error("Error: Failed to allocate filter %zd state.\n", i + 1);
+            return false;
+        }
+
+        stage->fixed_mac = fir_kernel_fixed_mac();
+        stage->perform_fixed = perform_block_stage_fixed;
+    } else {
+        stage->perform_fixed = perform_cic_stage_fixed;
+    }
+
+    stage->fixed_output = malloc(2 * stage->output_len *
+                                 sizeof(stage->fixed_output[0]));
+
+    if (!stage->fixed_output) {
+        log_error("Failed to allocate output buffer.\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool fir_enable_fixed_point(struct fir_filter *filter)
+{
+    size_t s, n;
+
+    if (filter->num_fixed_stages != 0) {
+        return true;
+    }
+
+    if (filter->pipeline) {
+        log_error("Error: Fixed point operation must be enabled prior to "
+                  "pipelined operation.\n");
+        return false;
+    }
+
+    /* Only the leading stages that support it are run in fixed point, and
+     * never those following envelope detection */
+    for (n = 0; n < filter->num_stages; n++) {
+        if ((filter->envelope_stage != 0 && n >= filter->envelope_stage) ||
+            !fixed_point_supported(&filter->stages[n])) {
+            break;
+        }
+    }
+
+    if (n == 0) {
+        log_debug("Filter stage 1 does not support fixed point operation.\n");
+        return false;
+    }
+
+    for (s = 0; s < n; s++) {
+        if (!init_fixed_stage(&filter->stages[s], s)) {
+            return false;
+        }
+
+        if (filter->stages[s].mode == STAGE_MODE_BLOCK) {
+            log_debug("Filter stage %zd: fixed point, Q%u taps\n",
+                      s + 1, filter->stages[s].fixed_shift);
+        } else {
+            log_debug("Filter stage %zd: fixed point\n", s + 1);
+        }
+    }
+
+    if (n < filter->num_stages) {
+        log_debug("Filter stages %zd-%zd: floating point\n",
+                  n + 1, filter->num_stages);
+    }
+
+    filter->num_fixed_stages = n;
+    fir_reset(filter);
+    return true;
+}
+
+static inline bool update(struct fir_stage *f, struct complexf *out)
+{
+    bool updated_output = false;
+
+    f->count--;
+
+    /* Perform convolution when decimation countdown reaches 0 */
+    if (f->count == 0) {
+        /* ins2 is the newest sample in a contiguous window of num_taps */
+        const struct complexf *x = f->ins2 - (f->num_taps - 1);
+
+        f->kernel->convolve(f->kernel_taps, x, f->num_taps, out);
+
+        updated_output = true;
+        f->count = f->decimation;
+    }
+
+    f->ins1++;
+    f->ins2++;
+
+    if (f->ins2 == &f->state[2 * f->num_taps]) {
+        f->ins1 = &f->state[0];
+        f->ins2 = &f->state[f->num_taps];
+    }
+
+    return updated_output;
+}
+
+static size_t perform_stage(struct fir_stage *f,
+                            const struct complexf_planar *in, size_t n,
+                            const struct complexf_planar *out)
+{
+    size_t i;
+    size_t num_out = 0;
+    struct complexf x, y;
+    const float *in_re = in->real;
+    const float *in_im = in->imag;
+    float *out_re = out->real;
+    float *out_im = out->imag;
+
+    for (i = 0; i < n; i++) {
+        x.real = in_re[i];
+        x.imag = in_im[i];
+        *f->ins1 = *f->ins2 = x;
+
+        if (update(f, &y)) {
+            log_verbose("out[%zd] = %f + %fj\n", num_out, y.real, y.imag);
+            out_re[num_out] = y.real;
+            out_im[num_out] = y.imag;
+            num_out++;
+        }
+    }
+
+    return num_out;
+}
+
+static inline int16_t fixed_saturate(int32_t x)
+{
+    x = x > INT16_MAX ? INT16_MAX : x;
+    return (int16_t) (x < INT16_MIN ? INT16_MIN : x);
+}
+
+/* Convert a sample to SC16Q11, rounding and saturating */
+static inline int16_t fixed_sample(float x)
+{
+    x *= FIXED_SAMPLE_SCALE;
+    x = x > INT16_MAX ? INT16_MAX : x;
+    x = x < INT16_MIN ? INT16_MIN : x;
+    return (int16_t) lrintf(x);
+}
+
+/* Accumulate `count` outputs of a symmetric stage, starting with that of
+ * frame `first`. Mirrored samples are summed (or differenced, for odd
+ * symmetry) prior to multiplication by their shared tap. */
+static inline void block_outputs_folded(const struct fir_stage *f,
+                                        size_t first, size_t count,
+                                        float *acc_re, float *acc_im,
+                                        bool odd)
+{
+    size_t t, j;
+    const float *x = f->phase_buf + first;
+
+    for (t = 0; t < f->num_fold_taps; t++) {
+        const float tap = f->fold_taps[t].tap;
+        const float * restrict ar = x + f->fold_taps[t].a;
+        const float * restrict ai = ar + f->phase_len;
+        const float * restrict br = x + f->fold_taps[t].b;
+        const float * restrict bi = br + f->phase_len;
+
+        if (odd) {
+            for (j = 0; j < count; j++) {
+                acc_re[j] += tap * (ar[j] - br[j]);
+                acc_im[j] += tap * (ai[j] - bi[j]);
+            }
+        } else {
+            for (j = 0; j < count; j++) {
+                acc_re[j] += tap * (ar[j] + br[j]);
+                acc_im[j] += tap * (ai[j] + bi[j]);
+            }
+        }
+    }
+
+    if (f->center_tap != 0) {
+        const float tap = f->center_tap;
+        const float * restrict cr = x + f->center_offset;
+        const float * restrict ci = cr + f->phase_len;
+
+        for (j = 0; j < count; j++) {
+            acc_re[j] += tap * cr[j];
+            acc_im[j] += tap * ci[j];
+        }
+    }
+}
+
+/* Compute `count` outputs, starting with that of frame `first`. These are
+ * accumulated in place in `acc_re` and `acc_im`. */
+static inline void block_outputs(const struct fir_stage *f, size_t first,
+                                 size_t count,
+                                 float * restrict acc_re,
+                                 float * restrict acc_im)
+{
+    unsigned int p;
+    size_t j, k;
+    const unsigned int d = f->decimation;
+
+    if (f->block_kernel) {
+        const float *x = f->phase_buf + first;
+
+        f->block_kernel->fn(acc_re, x, f->block_taps, f->block_offsets, count);
+        f->block_kernel->fn(acc_im, x + f->phase_len, f->block_taps,
+                            f->block_offsets, count);
+        return;
+    }
+
+    for (j = 0; j < count; j++) {
+        acc_re[j] = acc_im[j] = 0.0f;
+    }
+
+    if (f->symmetry != FIR_SYMMETRY_NONE) {
+        block_outputs_folded(f, first, count, acc_re, acc_im,
+                             f->symmetry == FIR_SYMMETRY_ODD);
+        return;
+    }
+
+    /* Subfilter p is applied to the phase containing the sample that is
+     * p samples older than the last sample in each frame. Operating on
+     * one tap at a time across all outputs allows this to vectorize. */
+    for (p = 0; p < d; p++) {
+        const float *h = &f->poly_taps[p * f->poly_len];
+        const float *x_re = phase_real(f, d - 1 - p) + (f->poly_len - 1) + first;
+        const float *x_im = phase_imag(f, d - 1 - p) + (f->poly_len - 1) + first;
+
+        for (k = 0; k < f->poly_len; k++) {
+            const float tap = h[k];
+            const float * restrict xr = x_re - k;
+            const float * restrict xi = x_im - k;
+
+            for (j = 0; j < count; j++) {
+                acc_re[j] += tap * xr[j];
+                acc_im[j] += tap * xi[j];
+            }
+        }
+    }
+}
+
+static size_t perform_block_stage(struct fir_stage *f,
+                                  const struct complexf_planar *in, size_t n,
+                                  const struct complexf_planar *out)
+{
+    unsigned int q;
+    size_t i, j, slot;
+    const unsigned int d = f->decimation;
+    const size_t hist_len = f->poly_len - 1;
+    const size_t num_out = (f->fill + n) / d;
+
+    /* Distribute input samples to their phase buffers. The first input sample
+     * lands in the current (possibly partially filled) frame. */
+    for (q = 0; q < d; q++) {
+        float *x_re = phase_real(f, q);
+        float *x_im = phase_imag(f, q);
+
+        if (q >= f->fill) {
+            i = q - f->fill;
+            slot = hist_len;
+        } else {
+            i = q + d - f->fill;
+            slot = hist_len + 1;
+        }
+
+        for (; i < n; i += d, slot++) {
+            x_re[slot] = in->real[i];
+            x_im[slot] = in->imag[i];
+        }
+    }
+
+    for (j = 0; j < num_out; j += BLOCK_TILE_LEN) {
+        const size_t count = (num_out - j) < BLOCK_TILE_LEN ?
+                                (num_out - j) : BLOCK_TILE_LEN;
+
+        block_outputs(f, j, count, &out->real[j], &out->imag[j]);
+    }
+
+    /* Retain history and the incomplete frame for the next call */
+    if (num_out != 0) {
+        for (q = 0; q < d; q++) {
+            memmove(phase_real(f, q), phase_real(f, q) + num_out,
+                    (hist_len + 1) * sizeof(f->phase_buf[0]));
+
+            memmove(phase_imag(f, q), phase_imag(f, q) + num_out,
+                    (hist_len + 1) * sizeof(f->phase_buf[0]));
+        }
+    }
+
+    f->fill = (f->fill + n) % d;
+
+    return num_out;
+}
+
+/* Real-valued equivalent of block_outputs(), used by stages following
+ * envelope detection */
+static void block_outputs_real(const struct fir_stage *f, size_t first,
+                               size_t count, float *out)
+{
+    unsigned int p;
+    size_t t, j, k;
+    const unsigned int d = f->decimation;
+
+    if (f->block_kernel) {
+        f->block_kernel->fn(out, f->phase_buf + first, f->block_taps,
+                            f->block_offsets, count);
+        return;
+    }
+
+    for (j = 0; j < count; j++) {
+        out[j] = 0.0f;
+    }
+
+    if (f->symmetry != FIR_SYMMETRY_NONE) {
+        const float *x = f->phase_buf + first;
+        const float sign = (f->symmetry == FIR_SYMMETRY_ODD) ? -1.0f : 1.0f;
+
+        for (t = 0; t < f->num_fold_taps; t++) {
+            const float tap = f->fold_taps[t].tap;
+            const float * restrict a = x + f->fold_taps[t].a;
+            const float * restrict b = x + f->fold_taps[t].b;
+
+            for (j = 0; j < count; j++) {
+                out[j] += tap * (a[j] + sign * b[j]);
+            }
+        }
+
+        if (f->center_tap != 0) {
+            const float * restrict c = x + f->center_offset;
+
+            for (j = 0; j < count; j++) {
+                out[j] += f->center_tap * c[j];
+            }
+        }
+
+        return;
+    }
+
+    for (p = 0; p < d; p++) {
+        const float *h = &f->poly_taps[p * f->poly_len];
+        const float *x = phase_real(f, d - 1 - p) + (f->poly_len - 1) + first;
+
+        for (k = 0; k < f->poly_len; k++) {
+            const float tap = h[k];
+            const float * restrict xk = x - k;
+
+            for (j = 0; j < count; j++) {
+                out[j] += tap * xk[j];
+            }
+        }
+    }
+}
+
+/* Real-valued equivalent of perform_block_stage(). Only the "real" phase
+ * buffers are used. */
+static size_t perform_block_stage_real(struct fir_stage *f,
+                                       const float *in, size_t n, float *out)
+{
+    unsigned int q;
+    size_t i, j, slot;
+    const unsigned int d = f->decimation;
+    const size_t hist_len = f->poly_len - 1;
+    const size_t num_out = (f->fill + n) / d;
+
+    for (q = 0; q < d; q++) {
+        float *x = phase_real(f, q);
+
+        if (q >= f->fill) {
+            i = q - f->fill;
+            slot = hist_len;
+        } else {
+            i = q + d - f->fill;
+            slot = hist_len + 1;
+        }
+
+        for (; i < n; i += d, slot++) {
+            x[slot] = in[i];
+        }
+    }
+
+    for (j = 0; j < num_out; j += BLOCK_TILE_LEN) {
+        const size_t count = (num_out - j) < BLOCK_TILE_LEN ?
+                                (num_out - j) : BLOCK_TILE_LEN;
+
+        block_outputs_real(f, j, count, &out[j]);
+    }
+
+    if (num_out != 0) {
+        for (q = 0; q < d; q++) {
+            memmove(phase_real(f, q), phase_real(f, q) + num_out,
+                    (hist_len + 1) * sizeof(f->phase_buf[0]));
+        }
+    }
+
+    f->fill = (f->fill + n) % d;
+
+    return num_out;
+}
+
+/* Fixed-point equivalent of block_outputs(), producing interleaved IQ. The
+ * accumulators are initialized with the rounding constant for the final
+ * shift. Taps are applied in pairs, which fixed_mac() handles efficiently. */
+static inline void block_outputs_fixed(const struct fir_stage *f,
+                                       size_t first, size_t count,
+                                       int16_t *out)
+{
+    int32_t acc_re[BLOCK_TILE_LEN];
+    int32_t acc_im[BLOCK_TILE_LEN];
+    unsigned int p;
+    size_t t, j, k;
+    const unsigned int d = f->decimation;
+    const int32_t round = (int32_t) 1 << (f->fixed_shift - 1);
+
+    for (j = 0; j < count; j++) {
+        acc_re[j] = acc_im[j] = round;
+    }
+
+    if (f->fold_taps) {
+        const int16_t *x = f->fixed_phase_buf + first;
+        const bool odd = (f->symmetry == FIR_SYMMETRY_ODD);
+
+        for (t = 0; t < f->num_fold_taps; t++) {
+            const int16_t tap = f->fixed_taps[t];
+            const int16_t *ar = x + f->fold_taps[t].a;
+            const int16_t *br = x + f->fold_taps[t].b;
+
+            f->fixed_mac(acc_re, ar, br, tap, odd ? -tap : tap, count);
+            f->fixed_mac(acc_im, ar + f->phase_len, br + f->phase_len,
+                         tap, odd ? -tap : tap, count);
+        }
+
+        if (f->fixed_center_tap != 0) {
+            const int16_t *cr = x + f->center_offset;
+
+            f->fixed_mac(acc_re, cr, cr, f->fixed_center_tap, 0, count);
+            f->fixed_mac(acc_im, cr + f->phase_len, cr + f->phase_len,
+                         f->fixed_center_tap, 0, count);
+        }
+
+        goto out;
+    }
+
+    for (p = 0; p < d; p++) {
+        const int16_t *h = &f->fixed_taps[p * f->poly_len];
+        const int16_t *x_re = fixed_phase_real(f, d - 1 - p) +
+                              (f->poly_len - 1) + first;
+        const int16_t *x_im = fixed_phase_imag(f, d - 1 - p) +
+                              (f->poly_len - 1) + first;
+
+        for (k = 0; (k + 1) < f->poly_len; k += 2) {
+            f->fixed_mac(acc_re, x_re - k, x_re - k - 1, h[k], h[k + 1], count);
+            f->fixed_mac(acc_im, x_im - k, x_im - k - 1, h[k], h[k + 1], count);
+        }
+
+        if (k < f->poly_len) {
+            f->fixed_mac(acc_re, x_re - k, x_re - k, h[k], 0, count);
+            f->fixed_mac(acc_im, x_im - k, x_im - k, h[k], 0, count);
+        }
+    }
+
+out:
+    for (j = 0; j < count; j++) {
+        out[2 * j]     = fixed_saturate(acc_re[j] >> f->fixed_shift);
+        out[2 * j + 1] = fixed_saturate(acc_im[j] >> f->fixed_shift);
+    }
+}
+
+static size_t perform_block_stage_fixed(struct fir_stage *f,
+                                        const int16_t *in, size_t n,
+                                        int16_t *out)
+{
+    unsigned int q;
+    size_t i, j, slot;
+    const unsigned int d = f->decimation;
+    const size_t hist_len = f->poly_len - 1;
+    const size_t num_out = (f->fill + n) / d;
+
+    for (q = 0; q < d; q++) {
+        int16_t *x_re = fixed_phase_real(f, q);
+        int16_t *x_im = fixed_phase_imag(f, q);
+
+        if (q >= f->fill) {
+            i = q - f->fill;
+            slot = hist_len;
+        } else {
+            i = q + d - f->fill;
+            slot = hist_len + 1;
+        }
+
+        for (; i < n; i += d, slot++) {
+            x_re[slot] = in[2 * i];
+            x_im[slot] = in[2 * i + 1];
+        }
+    }
+
+    for (j = 0; j < num_out; j += BLOCK_TILE_LEN) {
+        const size_t count = (num_out - j) < BLOCK_TILE_LEN ?
+                                (num_out - j) : BLOCK_TILE_LEN;
+
+        block_outputs_fixed(f, j, count, &out[2 * j]);
+    }
+
+    if (num_out != 0) {
+        for (q = 0; q < d; q++) {
+            memmove(fixed_phase_real(f, q), fixed_phase_real(f, q) + num_out,
+                    (hist_len + 1) * sizeof(f->fixed_phase_buf[0]));
+
+            memmove(fixed_phase_imag(f, q), fixed_phase_imag(f, q) + num_out,
+                    (hist_len + 1) * sizeof(f->fixed_phase_buf[0]));
+        }
+    }
+
+    f->fill = (f->fill + n) % d;
+
+    return num_out;
+}
+
+static size_t perform_fft_stage(struct fir_stage *f,
+                                const struct complexf_planar *in, size_t n,
+                                const struct complexf_planar *out)
+{
+    size_t i, j, k;
+    size_t num_out = 0;
+    const size_t hist_len = f->num_taps - 1;
+    const size_t sample_size = sizeof(f->fft_buf[0]);
+    struct complexf_planar x_in;
+
+    for (i = 0; i < n; i += k) {
+        k = (n - i) < f->fft_step ? (n - i) : f->fft_step;
+        x_in = complexf_planar_offset(in, i);
+
+        /* Only outputs [hist_len, hist_len + k) are valid linear convolution
+         * results. Any remainder of the buffer is zeroed, but unused. */
+        memcpy(f->fft_buf, f->fft_hist, hist_len * sample_size);
+        complexf_interleave(&x_in, &f->fft_buf[hist_len], k);
+        memset(&f->fft_buf[hist_len + k], 0,
+               (f->fft_step - k) * sample_size);
+
+        fft_forward(f->fft, f->fft_buf);
+
+        for (j = 0; j < f->fft_len; j++) {
+            const struct complexf x = f->fft_buf[j];
+            const struct complexf h = f->fft_taps[j];
+
+            f->fft_buf[j].real = x.real * h.real - x.imag * h.imag;
+            f->fft_buf[j].imag = x.real * h.imag + x.imag * h.real;
+        }
+
+        fft_inverse(f->fft, f->fft_buf);
+
+        /* Decimate, continuing the countdown from the previous block */
+        for (j = f->count - 1; j < k; j += f->decimation, num_out++) {
+            out->real[num_out] = f->fft_buf[hist_len + j].real;
+            out->imag[num_out] = f->fft_buf[hist_len + j].imag;
+        }
+
+        f->count = j - k + 1;
+
+        /* Retain the most recent input samples as history */
+        if (k >= hist_len) {
+            x_in = complexf_planar_offset(in, i + k - hist_len);
+            complexf_interleave(&x_in, f->fft_hist, hist_len);
+        } else {
+            memmove(f->fft_hist, &f->fft_hist[k], (hist_len - k) * sample_size);
+            complexf_interleave(&x_in, &f->fft_hist[hist_len - k], k);
+        }
+    }
+
+    return num_out;
+}
+
+static inline int32_t cic_input(float x)
+{
+    /* Offset the value to be non-negative, such that truncation rounds to
+     * the nearest integer. This is written to allow the conversion loop to
+     * vectorize, which it does not with copysignf() or lrintf(). */
+    x = x * CIC_INPUT_SCALE + (CIC_INPUT_SCALE + 0.5f);
+    x = x > (2 * CIC_INPUT_SCALE - 1) ? (2 * CIC_INPUT_SCALE - 1) : x;
+    x = x < 0 ? 0 : x;
+
+    return (int32_t) x - (int32_t) CIC_INPUT_SCALE;
+}
+
+/* Run the integrators over a block of input, storing the last integrator's
+ * output for each input sample that yields an output. Returns the number of
+ * outputs.
+ *
+ * This is specialized for each order, such that the integrators may be kept
+ * in registers. */
+__attribute__((always_inline))
+static inline size_t cic_integrate(struct fir_stage *f, const int32_t *x,
+                                   size_t n, uint64_t *y, unsigned int order)
+{
+    size_t i;
+    unsigned int k;
+    size_t num_out = 0;
+    size_t next = f->count - 1;
+    uint64_t integ[2 * CIC_MAX_ORDER];
+
+    for (k = 0; k < 2 * order; k++) {
+        integ[k] = f->cic_integ[k];
+    }
+
+    for (i = 0; i < n; i++) {
+        uint64_t re = (uint64_t) (int64_t) x[2 * i];
+        uint64_t im = (uint64_t) (int64_t) x[2 * i + 1];
+
+        for (k = 0; k < order; k++) {
+            re = integ[2 * k]     += re;
+            im = integ[2 * k + 1] += im;
+        }
+
+        if (i == next) {
+            y[2 * num_out]     = re;
+            y[2 * num_out + 1] = im;
+            num_out++;
+            next += f->decimation;
+        }
+    }
+
+    for (k = 0; k < 2 * order; k++) {
+        f->cic_integ[k] = integ[k];
+    }
+
+    /* Continue the decimation countdown in the next block */
+    f->count = next - n + 1;
+
+    return num_out;
+}
+
+/* Run the CIC over a block of `n` inputs in cic_in, leaving its outputs in
+ * cic_out. Returns the number of outputs. */
+static size_t cic_decimate(struct fir_stage *f, size_t n)
+{
+    size_t i, num_out;
+    unsigned int k;
+    const int32_t *x = f->cic_in;
+    uint64_t *y = f->cic_out;
+
+    switch (f->cic_order) {
+        case 1: num_out = cic_integrate(f, x, n, y, 1); break;
+        case 2: num_out = cic_integrate(f, x, n, y, 2); break;
+        case 3: num_out = cic_integrate(f, x, n, y, 3); break;
+        case 4: num_out = cic_integrate(f, x, n, y, 4); break;
+        case 5: num_out = cic_integrate(f, x, n, y, 5); break;
+        case 6: num_out = cic_integrate(f, x, n, y, 6); break;
+        case 7: num_out = cic_integrate(f, x, n, y, 7); break;
+        default: num_out = cic_integrate(f, x, n, y, CIC_MAX_ORDER); break;
+    }
+
+    /* The combs run at the output rate */
+    for (i = 0; i < num_out; i++) {
+        uint64_t re = y[2 * i];
+        uint64_t im = y[2 * i + 1];
+
+        for (k = 0; k < f->cic_order; k++) {
+            uint64_t *z = &f->cic_comb[2 * (k * f->cic_delay + f->cic_comb_idx)];
+            const uint64_t prev_re = z[0];
+            const uint64_t prev_im = z[1];
+
+            z[0] = re;
+            z[1] = im;
+
+            re -= prev_re;
+            im -= prev_im;
+        }
+
+        if (++f->cic_comb_idx == f->cic_delay) {
+            f->cic_comb_idx = 0;
+        }
+
+        y[2 * i]     = re;
+        y[2 * i + 1] = im;
+    }
+
+    return num_out;
+}
+
+static size_t perform_cic_stage(struct fir_stage *f,
+                                const struct complexf_planar *in, size_t n,
+                                const struct complexf_planar *out)
+{
+    size_t i, num_out;
+
+    for (i = 0; i < n; i++) {
+        f->cic_in[2 * i]     = cic_input(in->real[i]);
+        f->cic_in[2 * i + 1] = cic_input(in->imag[i]);
+    }
+
+    num_out = cic_decimate(f, n);
+
+    for (i = 0; i < num_out; i++) {
+        out->real[i] = (float) (int64_t) f->cic_out[2 * i]     * f->cic_scale;
+        out->imag[i] = (float) (int64_t) f->cic_out[2 * i + 1] * f->cic_scale;
+    }
+
+    return num_out;
+}
+
+static size_t perform_cic_stage_fixed(struct fir_stage *f,
+                                      const int16_t *in, size_t n,
+                                      int16_t *out)
+{
+    size_t i, num_out;
+    const int32_t scale = (int32_t) (CIC_INPUT_SCALE / FIXED_SAMPLE_SCALE);
+    const int32_t min = -(int32_t) CIC_INPUT_SCALE;
+    const int32_t max = (int32_t) CIC_INPUT_SCALE - 1;
+
+    /* Saturate as cic_input() does, such that results match those of
+     * perform_cic_stage() for the same input */
+    for (i = 0; i < 2 * n; i++) {
+        int32_t x = in[i] * scale;
+        x = x > max ? max : x;
+        f->cic_in[i] = x < min ? min : x;
+    }
+
+    num_out = cic_decimate(f, n);
+
+    for (i = 0; i < 2 * num_out; i++) {
+        out[i] = fixed_sample((float) (int64_t) f->cic_out[i] * f->cic_scale);
+    }
+
+    return num_out;
+}
+
+/* Detect the envelope of `n` samples, writing it to `out` */
+static void envelope(const struct fir_filter *filter,
+                     const struct complexf_planar *input, size_t n,
+                     float *out)
+{
+    size_t i;
+    const float *re = input->real;
+    const float *im = input->imag;
+
+    /* `out` may be the real component of the input */
+    if (filter->envelope == FIR_ENVELOPE_POWER) {
+        for (i = 0; i < n; i++) {
+            out[i] = re[i] * re[i] + im[i] * im[i];
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            out[i] = sqrtf(re[i] * re[i] + im[i] * im[i]);
+        }
+    }
+}
+
+/* Run stages [first, last) in floating point. The input is the output of
+ * stage `first` - 1, or the filter's input if `first` is 0, and the output is
+ * that of stage `last` - 1. Envelope detection is performed prior to stage
+ * `envelope_stage`, or on the output of the last stage of the filter.
+ *
+ * After envelope detection, samples are real-valued and only the real
+ * component of buffers is used. The imaginary component of the filter's
+ * output is then zero. */
+static size_t run_stages(struct fir_filter *filter, size_t first, size_t last,
+                         const struct complexf_planar *input, size_t n,
+                         const struct complexf_planar *output)
+{
+    size_t s;
+    const struct complexf_planar *x = input;
+    const struct complexf_planar *y;
+    struct complexf_planar env = { filter->envelope_buf, NULL };
+    const bool envelope_last = (last == filter->num_stages &&
+                                filter->envelope_stage == last);
+
+    for (s = first; s < last; s++) {
+        struct fir_stage *stage = &filter->stages[s];
+        const size_t n_in = n;
+
+        /* Only used when verbose logging is enabled */
+        (void) n_in;
+
+        if (filter->envelope_stage != 0 && s == filter->envelope_stage) {
+            envelope(filter, x, n, env.real);
+            x = &env;
+        }
+
+        /* Write the last stage's output directly to the function output.
+         * If its envelope is to be written there, this is done in place. */
+        if (s == last - 1) {
+            y = output;
+        } else {
+            y = &stage->output;
+        }
+
+        if (filter->envelope_stage != 0 && s >= filter->envelope_stage) {
+            n = perform_block_stage_real(stage, x->real, n, y->real);
+            log_verbose("Stage %zd: real, %zd in, %zd out\n", s + 1, n_in, n);
+        } else {
+            n = stage->perform(stage, x, n, y);
+            log_verbose("Stage %zd: %zd in, %zd out\n", s + 1, n_in, n);
+        }
+
+        x = y;
+    }
+
+    if (envelope_last) {
+        envelope(filter, x, n, output->real);
+    }
+
+    if (filter->envelope_stage != 0 && last == filter->num_stages) {
+        memset(output->imag, 0, n * sizeof(output->imag[0]));
+    }
+
+    return n;
+}
+
+/* Run the fixed-point stages, leaving their output in the output buffer of
+ * the last of these, as SC16Q11 values. Returns the number of outputs. */
+static size_t filter_fixed_stages(struct fir_filter *filter,
+                                  const int16_t *input, size_t n,
+                                  const int16_t **output)
+{
+    size_t s;
+    struct fir_stage *stage;
+
+    for (s = 0; s < filter->num_fixed_stages; s++) {
+        stage = &filter->stages[s];
+        n = stage->perform_fixed(stage, input, n, stage->fixed_output);
+        input = stage->fixed_output;
+
+        log_verbose("Stage %zd: fixed point, %zd out\n", s + 1, n);
+    }
+
+    *output = input;
+    return n;
+}
+
+/* Run stages [0, last) on SC16Q11 input, where `last` is at least the
+ * number of fixed-point stages */
+static size_t run_stages_sc16q11(struct fir_filter *filter,
+                                 const int16_t *input, size_t n, size_t last,
+                                 const struct complexf_planar *output)
+{
+    const int16_t *fixed_output;
+    struct fir_stage *stage;
+
+    n = filter_fixed_stages(filter, input, n, &fixed_output);
+
+    /* Samples are converted to floating point only once they have passed
+     * through all of the fixed-point stages */
+    if (last == filter->num_fixed_stages &&
+        !(last == filter->num_stages && filter->envelope_stage == last)) {
+        sc16q11_to_complexf_planar(fixed_output, output, n);
+        return n;
+    }
+
+    stage = &filter->stages[filter->num_fixed_stages - 1];
+    sc16q11_to_complexf_planar(fixed_output, &stage->output, n);
+    return run_stages(filter, filter->num_fixed_stages, last,
+                      &stage->output, n, output);
+}
+
+#if ENABLE_FIR_THREADS
+/* Run stages [first, last) on each block received from the previous group,
+ * passing the result to the next group. The last group writes to the output
+ * of the filtering call, and reports the number of samples written. */
+static void * pipeline_worker(void *arg)
+{
+    struct fir_worker *w = (struct fir_worker *) arg;
+    struct fir_block *in, *out;
+    struct complexf_planar dest;
+    size_t slot, n;
+    size_t offset = 0;
+
+    for (;;) {
+        in = &w->in_blocks[spsc_ring_peek(w->in)];
+
+        if (in->quit) {
+            if (w->out_blocks) {
+                out = &w->out_blocks[spsc_ring_acquire(w->out)];
+                out->quit = true;
+                spsc_ring_publish(w->out);
+            }
+
+            spsc_ring_release(w->in);
+            break;
+        }
+
+        if (w->out_blocks) {
+            out = &w->out_blocks[spsc_ring_acquire(w->out)];
+            out->n = run_stages(w->filter, w->first, w->last,
+                                &in->buf, in->n, &out->buf);
+            out->first = in->first;
+            out->quit = false;
+            out->output = in->output;
+
+            spsc_ring_release(w->in);
+            spsc_ring_publish(w->out);
+        } else {
+            if (in->first) {
+                offset = 0;
+            }
+
+            dest = complexf_planar_offset(in->output, offset);
+            n = run_stages(w->filter, w->first, w->last, &in->buf, in->n,
+                           &dest);
+            offset += n;
+
+            spsc_ring_release(w->in);
+
+            slot = spsc_ring_acquire(w->out);
+            w->done_counts[slot] = n;
+            spsc_ring_publish(w->out);
+        }
+    }
+
+    return NULL;
+}
+
+/* Filter `count` samples of either planar or SC16Q11 input, a block at a
+ * time. The first group of stages is run on each block by the calling
+ * thread, concurrently with the workers running the remaining groups on
+ * prior blocks. */
+static size_t pipeline_run(struct fir_filter *filter,
+                           const struct complexf_planar *input,
+                           const int16_t *input_sc16q11, size_t count,
+                           const struct complexf_planar *output)
+{
+    struct fir_pipeline *p = filter->pipeline;
+    struct fir_block *b;
+    struct complexf_planar src;
+    size_t offset, n, slot;
+    size_t num_blocks = 0;
+    size_t total = 0;
+
+    for (offset = 0; offset < count; offset += n) {
+        n = count - offset;
+        if (n > p->block_len) {
+            n = p->block_len;
+        }
+
+        b = &p->blocks[0][spsc_ring_acquire(p->rings[0])];
+
+        if (input_sc16q11) {
+            b->n = run_stages_sc16q11(filter, input_sc16q11 + 2 * offset, n,
+                                      p->num_caller_stages, &b->buf);
+        } else {
+            src = complexf_planar_offset(input, offset);
+            b->n = run_stages(filter, 0, p->num_caller_stages, &src, n,
+                              &b->buf);
+        }
+
+        b->first = (offset == 0);
+        b->quit = false;
+        b->output = output;
+
+        spsc_ring_publish(p->rings[0]);
+        num_blocks++;
+    }
+
+    for (; num_blocks > 0; num_blocks--) {
+        slot = spsc_ring_peek(p->done);
+        total += p->done_counts[slot];
+        spsc_ring_release(p->done);
+    }
+
+    return total;
+}
+
+static void pipeline_deinit(struct fir_filter *filter)
+{
+    size_t i, s;
+    struct fir_pipeline *p = filter->pipeline;
+
+    if (!p) {
+        return;
+    }
+
+    /* The quit request is passed from each worker to the next */
+    if (p->workers && p->workers[0].running) {
+        struct fir_block *b = &p->blocks[0][spsc_ring_acquire(p->rings[0])];
+        b->quit = true;
+        spsc_ring_publish(p->rings[0]);
+    }
+
+    for (i = 0; i < p->num_workers; i++) {
+        if (p->workers && p->workers[i].running) {
+            pthread_join(p->workers[i].thread, NULL);
+        }
+
+        if (p->rings) {
+            spsc_ring_deinit(p->rings[i]);
+        }
+
+        if (p->blocks && p->blocks[i]) {
+            for (s = 0; s < PIPELINE_RING_SLOTS; s++) {
+                complexf_planar_free(&p->blocks[i][s].buf);
+            }
+
+            free(p->blocks[i]);
+        }
+    }
+
+    spsc_ring_deinit(p->done);
+    free(p->done_counts);
+    free(p->workers);
+    free(p->rings);
+    free(p->blocks);
+    free(p);
+
+    filter->pipeline = NULL;
+}
+
+/* Divide stages [first, num_stages) into `num_groups` contiguous groups,
+ * minimizing the estimated cost of the most expensive group. The first stage
+ * of group g is returned in group_first[g]. */
+static bool balance_groups(const struct fir_filter *filter, size_t first,
+                           size_t num_groups, size_t *group_first)
+{
+    size_t g, i, j;
+    const size_t n = filter->num_stages;
+    unsigned int decimation = 1;
+    double *cost, *best;
+    size_t *split;
+    bool ret = false;
+
+    cost  = calloc(n + 1, sizeof(cost[0]));
+    best  = calloc((num_groups + 1) * (n + 1), sizeof(best[0]));
+    split = calloc((num_groups + 1) * (n + 1), sizeof(split[0]));
+
+    if (!cost || !best || !split) {
+        goto out;
+    }
+
+    /* cost[i] is the cumulative cost of stages [0, i) */
+    for (i = 0; i < n; i++) {
+        cost[i + 1] = cost[i] + stage_cost(filter, i, decimation);
+        decimation *= filter->stages[i].decimation;
+    }
+
+    /* best[g * (n + 1) + j] is the least maximum group cost with which
+     * stages [first, j) may be divided into g groups */
+    for (j = 0; j <= n; j++) {
+        best[j] = (j == first) ? 0 : HUGE_VAL;
+    }
+
+    for (g = 1; g <= num_groups; g++) {
+        for (j = 0; j <= n; j++) {
+            best[g * (n + 1) + j] = HUGE_VAL;
+
+            for (i = first; i < j; i++) {
+                const double prev = best[(g - 1) * (n + 1) + i];
+                const double group = cost[j] - cost[i];
+                const double max = prev > group ? prev : group;
+
+                if (max < best[g * (n + 1) + j]) {
+                    best[g * (n + 1) + j] = max;
+                    split[g * (n + 1) + j] = i;
+                }
+            }
+        }
+    }
+
+    for (g = num_groups, j = n; g > 0; g--) {
+        j = split[g * (n + 1) + j];
+        group_first[g - 1] = j;
+    }
+
+    ret = true;
+
+out:
+    free(cost);
+    free(best);
+    free(split);
+    return ret;
+}
+
+bool fir_enable_pipeline(struct fir_filter *filter, unsigned int num_threads,
+                         const int *cpus, size_t block_len)
+{
+    size_t i, s, first, max_groups, num_blocks;
+    size_t *group_first = NULL;
+    unsigned int decimation;
+    struct fir_pipeline *p;
+    bool ret = false;
+
+    if (num_threads == 0) {
+        return true;
+    }
+
+    if (filter->pipeline) {
+        log_error("Error: Pipelined operation is already enabled.\n");
+        return false;
+    }
+
+    /* Fixed-point stages, which require SC16Q11 input, are always run on
+     * the calling thread */
+    first = filter->num_fixed_stages > 1 ? filter->num_fixed_stages : 1;
+    max_groups = filter->num_stages - first + 1;
+
+    if (num_threads + 1 > max_groups) {
+        log_warning("Filter has too few stages for %u worker threads. "
+                    "Using %zd.\n", num_threads, max_groups - 1);
+        num_threads = (unsigned int) (max_groups - 1);
+
+        if (num_threads == 0) {
+            return true;
+        }
+    }
+
+    if (block_len == 0) {
+        block_len = (filter->max_input + PIPELINE_BLOCKS_PER_CALL - 1) /
+                    PIPELINE_BLOCKS_PER_CALL;
+    } else if (block_len > filter->max_input) {
+        block_len = filter->max_input;
+    }
+
+    p = calloc(1, sizeof(p[0]));
+    if (!p) {
+        log_error("Error: Failed to allocate pipeline.\n");
+        return false;
+    }
+
+    filter->pipeline = p;
+    p->block_len = block_len;
+    p->num_workers = num_threads;
+
+    group_first = calloc(num_threads + 1, sizeof(group_first[0]));
+    p->workers = calloc(num_threads, sizeof(p->workers[0]));
+    p->rings = calloc(num_threads, sizeof(p->rings[0]));
+    p->blocks = calloc(num_threads, sizeof(p->blocks[0]));
+
+    if (!group_first || !p->workers || !p->rings || !p->blocks) {
+        log_error("Error: Failed to allocate pipeline.\n");
+        goto out;
+    }
+
+    /* The calling thread's group is [0, group_first[1]) */
+    if (!balance_groups(filter, 0, num_threads + 1, group_first)) {
+        log_error("Error: Failed to allocate pipeline.\n");
+        goto out;
+    }
+
+    /* Move the first boundary past any fixed-point stages, and the rest
+     * along with it, as needed */
+    for (i = 1; i <= num_threads; i++) {
+        const size_t min = (i == 1) ? first : group_first[i - 1] + 1;
+
+        if (group_first[i] < min) {
+            group_first[i] = min;
+        }
+    }
+
+    p->num_caller_stages = group_first[1];
+
+    /* The last group may run at most this many blocks per call before
+     * the calling thread collects their results */
+    num_blocks = 1;
+    while (num_blocks < (filter->max_input + block_len - 1) / block_len) {
+        num_blocks <<= 1;
+    }
+
+    p->done = spsc_ring_init(num_blocks);
+    p->done_counts = calloc(num_blocks, sizeof(p->done_counts[0]));
+    if (!p->done || !p->done_counts) {
+        log_error("Error: Failed to allocate pipeline.\n");
+        goto out;
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        /* Each block of the ring feeding this group holds the output of the
+         * preceding stage for a block of filter input */
+        decimation = 1;
+        for (s = 0; s < group_first[i + 1]; s++) {
+            decimation *= filter->stages[s].decimation;
+        }
+
+        p->rings[i] = spsc_ring_init(PIPELINE_RING_SLOTS);
+        p->blocks[i] = calloc(PIPELINE_RING_SLOTS, sizeof(p->blocks[i][0]));
+        if (!p->rings[i] || !p->blocks[i]) {
+            log_error("Error: Failed to allocate pipeline.\n");
+            goto out;
+        }
+
+        for (s = 0; s < PIPELINE_RING_SLOTS; s++) {
+            if (!complexf_planar_alloc(&p->blocks[i][s].buf,
+                                       (block_len + decimation - 1) /
+                                       decimation)) {
+                log_error("Error: Failed to allocate pipeline blocks.\n");
+                goto out;
+            }
+        }
+    }
+
+    log_debug("Filter stages 1-%zd: calling thread, %zd-sample blocks\n",
+              p->num_caller_stages, block_len);
+
+    for (i = 0; i < num_threads; i++) {
+        struct fir_worker *w = &p->workers[i];
+
+        w->filter = filter;
+        w->first = group_first[i + 1];
+        w->last = (i + 1 < num_threads) ? group_first[i + 2] :
+                                          filter->num_stages;
+
+        w->in = p->rings[i];
+        w->in_blocks = p->blocks[i];
+
+        if (i + 1 < num_threads) {
+            w->out = p->rings[i + 1];
+            w->out_blocks = p->blocks[i + 1];
+        } else {
+            w->out = p->done;
+            w->done_counts = p->done_counts;
+        }
+
+        w->cpu = cpus ? cpus[i] : -1;
+
+        if (pthread_create(&w->thread, NULL, pipeline_worker, w) != 0) {
+            log_error("Error: Failed to create filter worker thread.\n");
+            goto out;
+        }
+
+        w->running = true;
+
+        if (w->cpu >= 0) {
+#ifdef __linux__
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu, &set);
+
+            if (pthread_setaffinity_np(w->thread, sizeof(set), &set) != 0) {
+                log_warning("Failed to pin filter worker thread %zd "
+                            "to CPU %d.\n", i + 1, w->cpu);
+            }
+#else
+            log_warning("Pinning threads to CPUs is not supported on this "
+                        "platform.\n");
+#endif
+        }
+
+        log_debug("Filter stages %zd-%zd: worker thread %zd%s\n",
+                  w->first + 1, w->last, i + 1,
+                  w->cpu >= 0 ? ", pinned" : "");
+    }
+
+    ret = true;
+
+out:
+    free(group_first);
+
+    if (!ret) {
+        pipeline_deinit(filter);
+    }
+
+    return ret;
+}
+#else
+static void pipeline_deinit(struct fir_filter *filter)
+{
+    (void) filter;
+}
+
+bool fir_enable_pipeline(struct fir_filter *filter, unsigned int num_threads,
+                         const int *cpus, size_t block_len)
+{
+    (void) filter;
+    (void) cpus;
+    (void) block_len;
+
+    if (num_threads == 0) {
+        return true;
+    }
+
+    log_error("Error: Pipelined operation requires building with "
+              "ENABLE_FIR_THREADS.\n");
+    return false;
+}
+#endif
+
+size_t fir_filter_and_decimate_planar(struct fir_filter *filter,
+                                      const struct complexf_planar *fn_input,
+                                      size_t count,
+                                      const struct complexf_planar *fn_output)
+{
+#if ENABLE_FIR_THREADS
+    if (filter->pipeline) {
+        return pipeline_run(filter, fn_input, NULL, count, fn_output);
+    }
+#endif
+
+    return run_stages(filter, 0, filter->num_stages,
+                      fn_input, count, fn_output);
+}
+
+size_t fir_filter_and_decimate(struct fir_filter *filter,
+                               const struct complexf *fn_input, size_t count,
+                               struct complexf *fn_output)
+{
+    size_t n;
+    struct complexf_planar *out =
+        &filter->stages[filter->num_stages - 1].output;
+
+    /* The last stage's output buffer is otherwise unused, and is large
+     * enough to hold the filter's output */
+    complexf_deinterleave(fn_input, &filter->input, count);
+    n = fir_filter_and_decimate_planar(filter, &filter->input, count, out);
+    complexf_interleave(out, fn_output, n);
+
+    return n;
+}
+
+size_t fir_filter_and_decimate_sc16q11_planar(
+                                    struct fir_filter *filter,
+                                    const int16_t *fn_input, size_t count,
+                                    const struct complexf_planar *fn_output)
+{
+#if ENABLE_FIR_THREADS
+    if (filter->pipeline) {
+        return pipeline_run(filter, NULL, fn_input, count, fn_output);
+    }
+#endif
+
+    return run_stages_sc16q11(filter, fn_input, count, filter->num_stages,
+                              fn_output);
+}
+
+size_t fir_filter_and_decimate_sc16q11(struct fir_filter *filter,
+                                       const int16_t *fn_input, size_t count,
+                                       struct complexf *fn_output)
+{
+    size_t n;
+    struct complexf_planar *out =
+        &filter->stages[filter->num_stages - 1].output;
+
+    n = fir_filter_and_decimate_sc16q11_planar(filter, fn_input, count, out);
+    complexf_interleave(out, fn_output, n);
+
+    return n;
 }
@@ -22,11 +22,24 @@
 #ifndef FIR_FILTER_H_
 #define FIR_FILTER_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "complexf.h"
 
 /** Opaque handle to a FIR filter */
 struct fir_filter;
 
+/**
+ * Envelope detection performed by a filter, as specified by its
+ * "envelope_after_stage" and "envelope" entries
+ */
+enum fir_envelope {
+    FIR_ENVELOPE_NONE,      /**< Filter output is complex */
+    FIR_ENVELOPE_MAGNITUDE, /**< Filter output is the filtered magnitude, |x| */
+    FIR_ENVELOPE_POWER,     /**< Filter output is the filtered power, |x|^2 */
+};
+
 /**
  * Load and initialize an FIR filter from the specified JSON file
  *
@@ -65,9 +78,40 @@ void fir_reset(struct fir_filter *filter);
  */
 unsigned int fir_get_total_decimation(struct fir_filter *filter);
 
+/**
+ * Get the envelope detection performed by the filter
+ *
+ * If this is not FIR_ENVELOPE_NONE, the real component of each output
+ * sample is the filtered envelope, and the imaginary component is zero.
+ *
+ * @param   filt    Filter handle
+ *
+ * @return Envelope detection type
+ */
+enum fir_envelope fir_get_envelope(const struct fir_filter *filter);
+
+/**
+ * Override the convolution kernel selected by fir_init(). By default, the
+ * fastest kernel supported by the host CPU is used. This is primarily intended
+ * for testing the SIMD kernels against the scalar reference implementation.
+ *
+ * This only affects filter stages operating in "stream" mode.
+ *
+ * @param   filt    Filter handle
+ * @param   name    Kernel name: "scalar", "sse2", "avx2", or "avx512"
+ *
+ * @return true on success, false if the kernel is not valid or not supported
+ *         on the host CPU
+ */
+bool fir_set_kernel(struct fir_filter *filter, const char *name);
+
 /**
  * Perform filtering and decmation operation
  *
+ * Filtering is performed on planar buffers; this converts the input and
+ * output to and from planar form. fir_filter_and_decimate_planar() avoids
+ * these conversions, and should be preferred.
+ *
  * @param[in]   filter  Filter handle
  * @param[in]   input   Complex input signal
  * @param[in]   count   Number of samples in the input signal
@@ -80,4 +124,123 @@ size_t fir_filter_and_decimate(struct fir_filter *filter,
                                const struct complexf *input, size_t count,
                                struct complexf *output);
 
+/**
+ * Perform filtering and decimation operation on planar buffers
+ *
+ * @param[in]   filter  Filter handle
+ * @param[in]   input   Complex input signal. Buffers allocated via
+ *                      complexf_planar_alloc() are recommended, as their
+ *                      alignment is optimal for SIMD operations.
+ * @param[in]   count   Number of samples in the input signal
+ * @param[out]  output  Filtered output. Buffers must be large enough to
+ *                      fit (count / total_decimation) samples.
+ *
+ * @return Number of items written to output
+ */
+size_t fir_filter_and_decimate_planar(struct fir_filter *filter,
+                                      const struct complexf_planar *input,
+                                      size_t count,
+                                      const struct complexf_planar *output);
+
+/**
+ * Run the filter's stages on multiple threads.
+ *
+ * The stages are divided into (num_threads + 1) contiguous groups with
+ * similar estimated costs. The first group runs on the thread calling the
+ * filtering functions, and each of the others on its own worker thread.
+ * The input to each filtering call is divided into blocks, which are passed
+ * from group to group via lock-free single-producer, single-consumer rings,
+ * such that the groups process successive blocks concurrently.
+ *
+ * The filtering functions still return once all of their input has been
+ * filtered, and their output is identical to that of synchronous operation,
+ * which is the default. Calls must not be made concurrently.
+ *
+ * The rounding of FFT stages' output depends upon how their input is divided
+ * between calls. Filters with FFT stages therefore produce the output of
+ * synchronous calls of `block_len` samples each.
+ *
+ * Fixed-point stages always run on the calling thread. If used,
+ * fir_enable_fixed_point() must be called first.
+ *
+ * @param   filter      Filter handle
+ * @param   num_threads Number of worker threads. This is reduced if the
+ *                      filter has too few stages. 0 leaves the filter
+ *                      synchronous.
+ * @param   cpus        CPU to pin each worker thread to, or -1 to leave a
+ *                      thread unpinned. NULL leaves all threads unpinned.
+ * @param   block_len   Number of input samples per block, or 0 for 1/8 of
+ *                      the `max_input` value provided to fir_init().
+ *
+ * @return true on success, false on failure
+ */
+bool fir_enable_pipeline(struct fir_filter *filter, unsigned int num_threads,
+                         const int *cpus, size_t block_len);
+
+/**
+ * Print the stages of a filter as they will be run, along with the
+ * estimated real multiplies each requires, per input sample of the filter.
+ * If the filter was planned (see its "optimize" entry), the estimated cost of
+ * the stages as written is also printed.
+ *
+ * @param   filter      Filter handle
+ * @param   out         Stream to print to
+ * @param   samplerate  Filter input sample rate, in Hz, used to print the
+ *                      multiplies per second required. 0 omits this.
+ */
+void fir_print_plan(const struct fir_filter *filter, FILE *out,
+                    unsigned int samplerate);
+
+/**
+ * Prepare the filter for use with fir_filter_and_decimate_sc16q11().
+ *
+ * Taps are quantized to 16-bit values, and filtering is performed with
+ * 16-bit samples and 32-bit accumulators. This is supported by block mode
+ * and CIC stages. Only the leading stages that support it are run in fixed
+ * point; any remaining stages operate on the floating-point output of the
+ * last fixed-point stage.
+ *
+ * A filter should be used with either fir_filter_and_decimate() or
+ * fir_filter_and_decimate_sc16q11(), but not both, as the two share state.
+ *
+ * @param   filt    Filter handle
+ *
+ * @return true on success, false if the first filter stage does not support
+ *         fixed point operation or resources could not be allocated
+ */
+bool fir_enable_fixed_point(struct fir_filter *filter);
+
+/**
+ * Perform filtering and decimation operation on SC16Q11 samples, using
+ * fixed point arithmetic. The filter must have been prepared with
+ * fir_enable_fixed_point().
+ *
+ * @param[in]   filter  Filter handle
+ * @param[in]   input   Interleaved SC16Q11 IQ input signal
+ * @param[in]   count   Number of (IQ pair) samples in the input signal
+ * @param[out]  output  Filtered output. Buffer must be large enough to
+ *                      fit (count / total_decimation) samples.
+ *
+ * @return Number of items written to output
+ */
+size_t fir_filter_and_decimate_sc16q11(struct fir_filter *filter,
+                                       const int16_t *input, size_t count,
+                                       struct complexf *output);
+
+/**
+ * Planar equivalent of fir_filter_and_decimate_sc16q11()
+ *
+ * @param[in]   filter  Filter handle
+ * @param[in]   input   Interleaved SC16Q11 IQ input signal
+ * @param[in]   count   Number of (IQ pair) samples in the input signal
+ * @param[out]  output  Filtered output. Buffers must be large enough to
+ *                      fit (count / total_decimation) samples.
+ *
+ * @return Number of items written to output
+ */
+size_t fir_filter_and_decimate_sc16q11_planar(
+                                    struct fir_filter *filter,
+                                    const int16_t *input, size_t count,
+                                    const struct complexf_planar *output);
+
 #endif
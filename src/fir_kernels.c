@@ -0,0 +1,904 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "fir_kernels.h"
+#include "log.h"
+
+#if ENABLE_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define HAVE_X86_KERNELS 1
+#   include <immintrin.h>
+#else
+#   define HAVE_X86_KERNELS 0
+#endif
+
+#ifndef ARRAY_SIZE
+#   define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
+#endif
+
+/* Alignment of kernel taps. This is large enough for an AVX-512
+ * register, which also satisfies the SSE2 and AVX2 kernels. */
+#define KERNEL_ALIGNMENT 64
+
+/* Folded kernels are implemented once and specialized for even and odd
+ * symmetry by passing a constant `odd` argument to an always-inlined body. */
+#define FOLDED_KERNEL(name_, attr_) \
+    attr_ static void name_##_even(const float *taps, \
+                                   const struct complexf *x, \
+                                   size_t num_taps, struct complexf *out) \
+    { \
+        name_(taps, x, num_taps, out, false); \
+    } \
+    \
+    attr_ static void name_##_odd(const float *taps, \
+                                  const struct complexf *x, \
+                                  size_t num_taps, struct complexf *out) \
+    { \
+        name_(taps, x, num_taps, out, true); \
+    }
+
+/* This is the reference implementation. It must remain a straightforward
+ * loop that accumulates in the same order as it always has, as it is used
+ * to verify the SIMD kernels. */
+static void convolve_scalar(const float *taps, const struct complexf *x,
+                            size_t num_taps, struct complexf *out)
+{
+    size_t i;
+    const struct complexf *newest = &x[num_taps - 1];
+
+    out->real = out->imag = 0;
+
+    for (i = 0; i < num_taps; i++, newest--) {
+        out->real += taps[i] * newest->real;
+        out->imag += taps[i] * newest->imag;
+    }
+}
+
+/* Folded form of the above, for linear-phase filters. Mirrored samples are
+ * summed (even symmetry) or differenced (odd symmetry) before being
+ * multiplied by their shared tap, halving the number of multiplies.
+ *
+ * Taps are in FIR_TAPS_FOLDED order. */
+__attribute__((always_inline))
+static inline void convolve_scalar_folded(const float *taps,
+                                          const struct complexf *x,
+                                          size_t num_taps,
+                                          struct complexf *out, bool odd)
+{
+    size_t i;
+    const size_t half = num_taps / 2;
+    const struct complexf *newest = &x[num_taps - 1];
+
+    out->real = out->imag = 0;
+
+    for (i = 0; i < half; i++, newest--) {
+        if (odd) {
+            out->real += taps[i] * (newest->real - x[i].real);
+            out->imag += taps[i] * (newest->imag - x[i].imag);
+        } else {
+            out->real += taps[i] * (newest->real + x[i].real);
+            out->imag += taps[i] * (newest->imag + x[i].imag);
+        }
+    }
+
+    /* The center tap of an odd-symmetric filter is always 0 */
+    if ((num_taps & 1) && !odd) {
+        out->real += taps[half] * x[half].real;
+        out->imag += taps[half] * x[half].imag;
+    }
+}
+
+FOLDED_KERNEL(convolve_scalar_folded, )
+
+/* Half-band form of the folded kernel. Only the mirrored sample pairs that
+ * are an odd distance from the center tap are non-zero. The center tap is
+ * applied as a single scale.
+ *
+ * Taps are in FIR_TAPS_HALFBAND order. */
+static void convolve_scalar_halfband(const float *taps,
+                                     const struct complexf *x,
+                                     size_t num_taps, struct complexf *out)
+{
+    size_t i;
+    const size_t center = (num_taps - 1) / 2;
+    const struct complexf *newest = &x[num_taps - 1];
+
+    out->real = out->imag = 0;
+
+    for (i = 1 - (center & 1); i < center; i += 2, taps++) {
+        out->real += *taps * (newest[-i].real + x[i].real);
+        out->imag += *taps * (newest[-i].imag + x[i].imag);
+    }
+
+    out->real += *taps * x[center].real;
+    out->imag += *taps * x[center].imag;
+}
+
+/* Fixed-point multiply-accumulate of a pair of taps across a block of
+ * outputs, used by fixed-point block mode stages. This is inlined into the
+ * SIMD implementations to handle any remainder, such that it is compiled for
+ * the same target; mixing SSE and AVX encodings is costly. */
+__attribute__((always_inline))
+static inline void fixed_mac_loop(int32_t *acc,
+                                  const int16_t *a, const int16_t *b,
+                                  int16_t tap_a, int16_t tap_b, size_t count)
+{
+    size_t j;
+
+    for (j = 0; j < count; j++) {
+        acc[j] += tap_a * a[j] + tap_b * b[j];
+    }
+}
+
+static void fixed_mac_scalar(int32_t *acc, const int16_t *a, const int16_t *b,
+                             int16_t tap_a, int16_t tap_b, size_t count)
+{
+    fixed_mac_loop(acc, a, b, tap_a, tap_b, count);
+}
+
+/* Block mode kernel body, for exactly `n` folded taps. This computes each
+ * output in full before moving on to the next, rather than making a pass
+ * over the outputs for each tap. Since `n` is a compile-time constant in
+ * each specialization, the loop over the taps is fully unrolled, leaving the
+ * taps and the accumulator in registers. The loop over the outputs is left
+ * to the compiler to vectorize. */
+__attribute__((always_inline))
+static inline void block_folded(float * restrict out, const float *x,
+                                const float *taps, const size_t *offsets,
+                                size_t count, const size_t n)
+{
+    size_t j, t;
+    float h[BLOCK_KERNEL_MAX_TAPS];
+    const float *a[BLOCK_KERNEL_MAX_TAPS];
+    const float *b[BLOCK_KERNEL_MAX_TAPS];
+
+    for (t = 0; t < n; t++) {
+        h[t] = taps[t];
+        a[t] = x + offsets[2 * t];
+        b[t] = x + offsets[2 * t + 1];
+    }
+
+    for (j = 0; j < count; j++) {
+        float acc = 0.0f;
+
+#pragma GCC unroll 32
+        for (t = 0; t < n; t++) {
+            acc += h[t] * (a[t][j] + b[t][j]);
+        }
+
+        out[j] = acc;
+    }
+}
+
+#define BLOCK_KERNEL(n_, suffix_, attr_) \
+    attr_ static void block_folded_##n_##_##suffix_(float *out, \
+                                                    const float *x, \
+                                                    const float *taps, \
+                                                    const size_t *offsets, \
+                                                    size_t count) \
+    { \
+        block_folded(out, x, taps, offsets, count, n_); \
+    }
+
+/* The specializations provided for each target. These cover the shipped
+ * filters, whose 16, 31, 32 and 64 tap stages fold to 8, 16 and 32 taps. */
+#define BLOCK_KERNELS(suffix_, attr_) \
+    BLOCK_KERNEL(4,  suffix_, attr_) \
+    BLOCK_KERNEL(8,  suffix_, attr_) \
+    BLOCK_KERNEL(12, suffix_, attr_) \
+    BLOCK_KERNEL(16, suffix_, attr_) \
+    BLOCK_KERNEL(24, suffix_, attr_) \
+    BLOCK_KERNEL(32, suffix_, attr_)
+
+#define BLOCK_KERNEL_ENTRIES(name_, suffix_) \
+    { name_, 4,  block_folded_4_##suffix_  }, \
+    { name_, 8,  block_folded_8_##suffix_  }, \
+    { name_, 12, block_folded_12_##suffix_ }, \
+    { name_, 16, block_folded_16_##suffix_ }, \
+    { name_, 24, block_folded_24_##suffix_ }, \
+    { name_, 32, block_folded_32_##suffix_ },
+
+BLOCK_KERNELS(generic, )
+
+#if HAVE_X86_KERNELS
+
+/* Accumulate the final (odd) sample, if any, and store the result.
+ * acc must contain {real, imag, x, x} */
+__attribute__((target("sse2")))
+static inline void finish_sse2(__m128 acc, const float *taps, const float *x,
+                               size_t remaining, struct complexf *out)
+{
+    if (remaining) {
+        const __m128 t = _mm_castpd_ps(_mm_load_sd((const double *) taps));
+        const __m128 v = _mm_castpd_ps(_mm_load_sd((const double *) x));
+        acc = _mm_add_ps(acc, _mm_mul_ps(t, v));
+    }
+
+    _mm_storel_pi((__m64 *) out, acc);
+}
+
+/* Sum the pairs of {real, imag} values in the provided vector */
+__attribute__((target("sse2")))
+static inline __m128 hsum_sse2(__m128 acc)
+{
+    return _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+}
+
+__attribute__((target("sse2")))
+static void convolve_sse2(const float *taps, const struct complexf *x,
+                          size_t num_taps, struct complexf *out)
+{
+    size_t i = 0;
+    const float *xf = (const float *) x;
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+
+    /* 2 complex samples per register, 2 registers per iteration */
+    for (; (i + 4) <= num_taps; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                           _mm_loadu_ps(&xf[2 * i])));
+
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(&taps[2 * i + 4]),
+                                           _mm_loadu_ps(&xf[2 * i + 4])));
+    }
+
+    if ((i + 2) <= num_taps) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                           _mm_loadu_ps(&xf[2 * i])));
+        i += 2;
+    }
+
+    acc0 = hsum_sse2(_mm_add_ps(acc0, acc1));
+    finish_sse2(acc0, &taps[2 * i], &xf[2 * i], num_taps - i, out);
+}
+
+__attribute__((target("avx2")))
+static inline __m128 hsum_avx2(__m256 acc)
+{
+    const __m128 lo = _mm256_castps256_ps128(acc);
+    const __m128 hi = _mm256_extractf128_ps(acc, 1);
+    return _mm_add_ps(lo, hi);
+}
+
+__attribute__((target("avx2")))
+static void convolve_avx2(const float *taps, const struct complexf *x,
+                          size_t num_taps, struct complexf *out)
+{
+    size_t i = 0;
+    const float *xf = (const float *) x;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m128 acc;
+
+    /* 4 complex samples per register, 2 registers per iteration */
+    for (; (i + 8) <= num_taps; i += 8) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_load_ps(&taps[2 * i]),
+                                                 _mm256_loadu_ps(&xf[2 * i])));
+
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_load_ps(&taps[2 * i + 8]),
+                                                 _mm256_loadu_ps(&xf[2 * i + 8])));
+    }
+
+    if ((i + 4) <= num_taps) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_load_ps(&taps[2 * i]),
+                                                 _mm256_loadu_ps(&xf[2 * i])));
+        i += 4;
+    }
+
+    acc = hsum_avx2(_mm256_add_ps(acc0, acc1));
+
+    if ((i + 2) <= num_taps) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                         _mm_loadu_ps(&xf[2 * i])));
+        i += 2;
+    }
+
+    finish_sse2(hsum_sse2(acc), &taps[2 * i], &xf[2 * i], num_taps - i, out);
+}
+
+__attribute__((target("avx512f")))
+static void convolve_avx512(const float *taps, const struct complexf *x,
+                            size_t num_taps, struct complexf *out)
+{
+    size_t i = 0;
+    const float *xf = (const float *) x;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m256 lo, hi;
+
+    /* 8 complex samples per register, 2 registers per iteration */
+    for (; (i + 16) <= num_taps; i += 16) {
+        acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_load_ps(&taps[2 * i]),
+                                                 _mm512_loadu_ps(&xf[2 * i])));
+
+        acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(_mm512_load_ps(&taps[2 * i + 16]),
+                                                 _mm512_loadu_ps(&xf[2 * i + 16])));
+    }
+
+    if ((i + 8) <= num_taps) {
+        acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_load_ps(&taps[2 * i]),
+                                                 _mm512_loadu_ps(&xf[2 * i])));
+        i += 8;
+    }
+
+    /* Masked loads take care of the remaining 1-7 samples */
+    if (i < num_taps) {
+        const __mmask16 mask = (__mmask16) ((1u << (2 * (num_taps - i))) - 1);
+        const __m512 t = _mm512_maskz_load_ps(mask, &taps[2 * i]);
+        const __m512 v = _mm512_maskz_loadu_ps(mask, &xf[2 * i]);
+        acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(t, v));
+    }
+
+    acc0 = _mm512_add_ps(acc0, acc1);
+
+    lo = _mm512_castps512_ps256(acc0);
+    hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc0), 1));
+
+    _mm_storel_pi((__m64 *) out, hsum_sse2(hsum_avx2(_mm256_add_ps(lo, hi))));
+}
+
+/* Reverse the order of the two complex samples in a register */
+__attribute__((target("sse2")))
+static inline __m128 reverse_sse2(__m128 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 fold_sse2(__m128 newest, __m128 oldest, bool odd)
+{
+    return odd ? _mm_sub_ps(newest, oldest) : _mm_add_ps(newest, oldest);
+}
+
+/* Accumulate the final unpaired sample pair and the center tap, if any,
+ * and store the result. acc must contain {real, imag, x, x} */
+__attribute__((target("sse2"), always_inline))
+static inline void finish_folded_sse2(__m128 acc, const float *taps,
+                                      const float *xf, size_t i,
+                                      size_t num_taps, struct complexf *out,
+                                      bool odd)
+{
+    const size_t half = num_taps / 2;
+
+    if (i < half) {
+        const __m128 t = _mm_castpd_ps(_mm_load_sd((const double *) &taps[2 * i]));
+        const __m128 n = _mm_castpd_ps(_mm_load_sd((const double *)
+                                            &xf[2 * (num_taps - 1 - i)]));
+        const __m128 o = _mm_castpd_ps(_mm_load_sd((const double *) &xf[2 * i]));
+
+        acc = _mm_add_ps(acc, _mm_mul_ps(t, fold_sse2(n, o, odd)));
+    }
+
+    if ((num_taps & 1) && !odd) {
+        const __m128 t = _mm_castpd_ps(_mm_load_sd((const double *) &taps[2 * half]));
+        const __m128 v = _mm_castpd_ps(_mm_load_sd((const double *) &xf[2 * half]));
+
+        acc = _mm_add_ps(acc, _mm_mul_ps(t, v));
+    }
+
+    _mm_storel_pi((__m64 *) out, acc);
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline void convolve_sse2_folded(const float *taps,
+                                        const struct complexf *x,
+                                        size_t num_taps,
+                                        struct complexf *out, bool odd)
+{
+    size_t i = 0;
+    const size_t half = num_taps / 2;
+    const float *xf = (const float *) x;
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+
+    /* 2 pairs of mirrored samples per register, 2 registers per iteration */
+    for (; (i + 4) <= half; i += 4) {
+        const __m128 n0 = reverse_sse2(_mm_loadu_ps(&xf[2 * (num_taps - 2 - i)]));
+        const __m128 n1 = reverse_sse2(_mm_loadu_ps(&xf[2 * (num_taps - 4 - i)]));
+        const __m128 o0 = _mm_loadu_ps(&xf[2 * i]);
+        const __m128 o1 = _mm_loadu_ps(&xf[2 * i + 4]);
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                           fold_sse2(n0, o0, odd)));
+
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(&taps[2 * i + 4]),
+                                           fold_sse2(n1, o1, odd)));
+    }
+
+    if ((i + 2) <= half) {
+        const __m128 n = reverse_sse2(_mm_loadu_ps(&xf[2 * (num_taps - 2 - i)]));
+        const __m128 o = _mm_loadu_ps(&xf[2 * i]);
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                           fold_sse2(n, o, odd)));
+        i += 2;
+    }
+
+    acc0 = hsum_sse2(_mm_add_ps(acc0, acc1));
+    finish_folded_sse2(acc0, taps, xf, i, num_taps, out, odd);
+}
+
+FOLDED_KERNEL(convolve_sse2_folded, __attribute__((target("sse2"))))
+
+/* Load two complex samples that are not adjacent */
+__attribute__((target("sse2")))
+static inline __m128 load2_sse2(const struct complexf *lo,
+                                const struct complexf *hi)
+{
+    const __m128d v = _mm_load_sd((const double *) lo);
+    return _mm_castpd_ps(_mm_loadh_pd(v, (const double *) hi));
+}
+
+__attribute__((target("sse2")))
+static void convolve_sse2_halfband(const float *taps,
+                                   const struct complexf *x,
+                                   size_t num_taps, struct complexf *out)
+{
+    size_t i, t = 0;
+    const size_t center = (num_taps - 1) / 2;
+    const struct complexf *newest = &x[num_taps - 1];
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 t2;
+
+    i = 1 - (center & 1);
+
+    /* 2 pairs of mirrored samples per register, 2 registers per iteration */
+    for (; (i + 6) < center; i += 8, t += 4) {
+        const __m128 n0 = load2_sse2(newest - i,     newest - i - 2);
+        const __m128 o0 = load2_sse2(&x[i],          &x[i + 2]);
+        const __m128 n1 = load2_sse2(newest - i - 4, newest - i - 6);
+        const __m128 o1 = load2_sse2(&x[i + 4],      &x[i + 6]);
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(&taps[2 * t]),
+                                           _mm_add_ps(n0, o0)));
+
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(&taps[2 * t + 4]),
+                                           _mm_add_ps(n1, o1)));
+    }
+
+    acc0 = hsum_sse2(_mm_add_ps(acc0, acc1));
+
+    for (; i < center; i += 2, t++) {
+        const __m128 n = _mm_castpd_ps(_mm_load_sd((const double *) (newest - i)));
+        const __m128 o = _mm_castpd_ps(_mm_load_sd((const double *) &x[i]));
+
+        t2 = _mm_castpd_ps(_mm_load_sd((const double *) &taps[2 * t]));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(t2, _mm_add_ps(n, o)));
+    }
+
+    t2 = _mm_castpd_ps(_mm_load_sd((const double *) &taps[2 * t]));
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(t2, _mm_castpd_ps(
+                                _mm_load_sd((const double *) &x[center]))));
+
+    _mm_storel_pi((__m64 *) out, acc0);
+}
+
+/* Reverse the order of the four complex samples in a register */
+__attribute__((target("avx2")))
+static inline __m256 reverse_avx2(__m256 v)
+{
+    const __m256d d = _mm256_castps_pd(v);
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(d, _MM_SHUFFLE(0, 1, 2, 3)));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void convolve_avx2_folded(const float *taps,
+                                        const struct complexf *x,
+                                        size_t num_taps,
+                                        struct complexf *out, bool odd)
+{
+    size_t i = 0;
+    const size_t half = num_taps / 2;
+    const float *xf = (const float *) x;
+    __m256 acc256 = _mm256_setzero_ps();
+    __m128 acc;
+
+    /* 4 pairs of mirrored samples per iteration */
+    for (; (i + 4) <= half; i += 4) {
+        const __m256 n = reverse_avx2(_mm256_loadu_ps(&xf[2 * (num_taps - 4 - i)]));
+        const __m256 o = _mm256_loadu_ps(&xf[2 * i]);
+        const __m256 f = odd ? _mm256_sub_ps(n, o) : _mm256_add_ps(n, o);
+
+        acc256 = _mm256_add_ps(acc256,
+                               _mm256_mul_ps(_mm256_load_ps(&taps[2 * i]), f));
+    }
+
+    acc = hsum_avx2(acc256);
+
+    if ((i + 2) <= half) {
+        const __m128 n = reverse_sse2(_mm_loadu_ps(&xf[2 * (num_taps - 2 - i)]));
+        const __m128 o = _mm_loadu_ps(&xf[2 * i]);
+
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(&taps[2 * i]),
+                                         fold_sse2(n, o, odd)));
+        i += 2;
+    }
+
+    finish_folded_sse2(hsum_sse2(acc), taps, xf, i, num_taps, out, odd);
+}
+
+FOLDED_KERNEL(convolve_avx2_folded, __attribute__((target("avx2"))))
+
+/* Interleaving the samples to which each tap is applied allows pmaddwd to
+ * compute both products and their sum, without widening the samples. */
+__attribute__((target("sse2")))
+static void fixed_mac_sse2(int32_t *acc, const int16_t *a, const int16_t *b,
+                           int16_t tap_a, int16_t tap_b, size_t count)
+{
+    size_t j = 0;
+    const __m128i taps = _mm_set1_epi32((int32_t) (uint16_t) tap_a |
+                                        ((int32_t) tap_b << 16));
+
+    for (; (j + 8) <= count; j += 8) {
+        const __m128i va = _mm_loadu_si128((const __m128i *) &a[j]);
+        const __m128i vb = _mm_loadu_si128((const __m128i *) &b[j]);
+        __m128i *out = (__m128i *) &acc[j];
+
+        _mm_storeu_si128(&out[0], _mm_add_epi32(_mm_loadu_si128(&out[0]),
+                         _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), taps)));
+
+        _mm_storeu_si128(&out[1], _mm_add_epi32(_mm_loadu_si128(&out[1]),
+                         _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), taps)));
+    }
+
+    fixed_mac_loop(&acc[j], &a[j], &b[j], tap_a, tap_b, count - j);
+}
+
+/* As above, noting that the AVX2 unpack instructions operate on each 128-bit
+ * lane independently */
+__attribute__((target("avx2")))
+static void fixed_mac_avx2(int32_t *acc, const int16_t *a, const int16_t *b,
+                           int16_t tap_a, int16_t tap_b, size_t count)
+{
+    size_t j = 0;
+    const __m256i taps = _mm256_set1_epi32((int32_t) (uint16_t) tap_a |
+                                           ((int32_t) tap_b << 16));
+
+    for (; (j + 16) <= count; j += 16) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *) &a[j]);
+        const __m256i vb = _mm256_loadu_si256((const __m256i *) &b[j]);
+        const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb),
+                                             taps);
+        const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb),
+                                             taps);
+        __m256i *out = (__m256i *) &acc[j];
+
+        _mm256_storeu_si256(&out[0],
+            _mm256_add_epi32(_mm256_loadu_si256(&out[0]),
+                             _mm256_permute2x128_si256(lo, hi, 0x20)));
+
+        _mm256_storeu_si256(&out[1],
+            _mm256_add_epi32(_mm256_loadu_si256(&out[1]),
+                             _mm256_permute2x128_si256(lo, hi, 0x31)));
+    }
+
+    fixed_mac_loop(&acc[j], &a[j], &b[j], tap_a, tap_b, count - j);
+}
+
+BLOCK_KERNELS(avx2, __attribute__((target("avx2"))))
+
+static bool cpu_supports(const char *name)
+{
+    __builtin_cpu_init();
+
+    if (!strcmp(name, "sse2")) {
+        return __builtin_cpu_supports("sse2");
+    } else if (!strcmp(name, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    } else if (!strcmp(name, "avx512")) {
+        return __builtin_cpu_supports("avx512f");
+    } else {
+        return !strcmp(name, "scalar");
+    }
+}
+
+#else
+
+static bool cpu_supports(const char *name)
+{
+    return !strcmp(name, "scalar");
+}
+
+#endif
+
+#define NONE    FIR_SYMMETRY_NONE
+#define EVEN    FIR_SYMMETRY_EVEN
+#define ODD     FIR_SYMMETRY_ODD
+#define HB      FIR_SYMMETRY_HALFBAND
+
+/* Listed in order of preference. Folded kernels are used only when the
+ * filter is symmetric, and are listed ahead of their unfolded counterparts
+ * only where they have been measured to be faster. The overhead of folding
+ * is not amortized over short filters, and the unfolded AVX2 and AVX-512
+ * kernels outperform the folded AVX2 kernel on the filters tested.
+ *
+ * Half-band kernels skip the zero taps, and are always preferred. */
+static const struct fir_kernel kernels[] = {
+#if HAVE_X86_KERNELS
+    { "sse2",   HB,   FIR_TAPS_HALFBAND_INTERLEAVED, convolve_sse2_halfband,    1 },
+    { "avx512", NONE, FIR_TAPS_INTERLEAVED,        convolve_avx512,             128 },
+    { "avx2",   NONE, FIR_TAPS_INTERLEAVED,        convolve_avx2,               64 },
+    { "avx2",   EVEN, FIR_TAPS_FOLDED_INTERLEAVED, convolve_avx2_folded_even,   64 },
+    { "avx2",   ODD,  FIR_TAPS_FOLDED_INTERLEAVED, convolve_avx2_folded_odd,    64 },
+    { "sse2",   EVEN, FIR_TAPS_FOLDED_INTERLEAVED, convolve_sse2_folded_even,   64 },
+    { "sse2",   ODD,  FIR_TAPS_FOLDED_INTERLEAVED, convolve_sse2_folded_odd,    64 },
+    { "sse2",   NONE, FIR_TAPS_INTERLEAVED,        convolve_sse2,               1 },
+#endif
+    { "scalar", HB,   FIR_TAPS_HALFBAND,           convolve_scalar_halfband,    1 },
+    { "scalar", EVEN, FIR_TAPS_FOLDED,             convolve_scalar_folded_even, 1 },
+    { "scalar", ODD,  FIR_TAPS_FOLDED,             convolve_scalar_folded_odd,  1 },
+
+    /* The unfolded scalar kernel must always be last */
+    { "scalar", NONE, FIR_TAPS_NATURAL,            convolve_scalar,             1 },
+};
+
+#undef NONE
+#undef EVEN
+#undef ODD
+#undef HB
+
+/* Listed in order of preference */
+static const struct fir_block_kernel block_kernels[] = {
+#if HAVE_X86_KERNELS
+    BLOCK_KERNEL_ENTRIES("avx2", avx2)
+#endif
+    BLOCK_KERNEL_ENTRIES("generic", generic)
+};
+
+/* Rank how well a kernel suits the specified symmetry. Lower is better, and
+ * -1 denotes that the kernel cannot be used. */
+static int symmetry_rank(const struct fir_kernel *kernel,
+                         enum fir_symmetry symmetry)
+{
+    if (kernel->symmetry == symmetry) {
+        return 0;
+    } else if (kernel->symmetry == FIR_SYMMETRY_EVEN &&
+               symmetry == FIR_SYMMETRY_HALFBAND) {
+        /* A half-band filter is also even-symmetric */
+        return 1;
+    } else if (kernel->symmetry == FIR_SYMMETRY_NONE) {
+        return 2;
+    } else {
+        return -1;
+    }
+}
+
+const struct fir_kernel * fir_kernel_best(size_t num_taps,
+                                          enum fir_symmetry symmetry)
+{
+    static bool supported[ARRAY_SIZE(kernels)];
+    static bool detected = false;
+    size_t i;
+
+    if (!detected) {
+        for (i = 0; i < ARRAY_SIZE(kernels); i++) {
+            supported[i] = cpu_supports(kernels[i].name);
+            log_verbose("Host %s %s FIR kernel.\n",
+                        supported[i] ? "supports" : "does not support",
+                        kernels[i].name);
+        }
+
+        detected = true;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(kernels); i++) {
+        if (supported[i] && symmetry_rank(&kernels[i], symmetry) >= 0 &&
+            num_taps >= kernels[i].min_taps) {
+            return &kernels[i];
+        }
+    }
+
+    /* The unfolded scalar kernel is always supported */
+    return &kernels[ARRAY_SIZE(kernels) - 1];
+}
+
+const struct fir_kernel * fir_kernel_get(const char *name,
+                                         enum fir_symmetry symmetry)
+{
+    size_t i;
+    int rank;
+    const struct fir_kernel *ret = NULL;
+    int best_rank = INT_MAX;
+
+    for (i = 0; i < ARRAY_SIZE(kernels); i++) {
+        if (strcasecmp(name, kernels[i].name)) {
+            continue;
+        }
+
+        rank = symmetry_rank(&kernels[i], symmetry);
+        if (rank >= 0 && rank < best_rank) {
+            ret = &kernels[i];
+            best_rank = rank;
+        }
+    }
+
+    if (ret && !cpu_supports(ret->name)) {
+        log_debug("Host does not support %s FIR kernel.\n", name);
+        ret = NULL;
+    }
+
+    return ret;
+}
+
+enum fir_symmetry fir_kernel_symmetry(const float *taps, size_t num_taps)
+{
+    size_t i;
+    bool even = true;
+    bool odd  = true;
+
+    for (i = 0; i <= (num_taps - 1) / 2; i++) {
+        const float a = taps[i];
+        const float b = taps[num_taps - 1 - i];
+
+        even = even && (a == b);
+        odd  = odd  && (a == -b);
+    }
+
+    /* A filter consisting of a single non-zero tap is trivially even */
+    if (even) {
+        if ((num_taps & 1) && num_taps >= 5) {
+            for (i = 0; i < num_taps; i++) {
+                if (fir_kernel_halfband_zero(num_taps, i) && taps[i] != 0) {
+                    return FIR_SYMMETRY_EVEN;
+                }
+            }
+
+            return FIR_SYMMETRY_HALFBAND;
+        }
+
+        return FIR_SYMMETRY_EVEN;
+    } else if (odd) {
+        return FIR_SYMMETRY_ODD;
+    } else {
+        return FIR_SYMMETRY_NONE;
+    }
+}
+
+const char * fir_symmetry_str(enum fir_symmetry symmetry)
+{
+    switch (symmetry) {
+        case FIR_SYMMETRY_EVEN:
+            return "even";
+
+        case FIR_SYMMETRY_ODD:
+            return "odd";
+
+        case FIR_SYMMETRY_HALFBAND:
+            return "halfband";
+
+        default:
+            return "none";
+    }
+}
+
+void * fir_kernel_alloc(size_t len)
+{
+    void *ret;
+
+    if (posix_memalign(&ret, KERNEL_ALIGNMENT, len) != 0) {
+        return NULL;
+    }
+
+    return ret;
+}
+
+float * fir_kernel_prepare_taps(const struct fir_kernel *kernel,
+                                const float *taps, size_t num_taps)
+{
+    size_t i;
+    size_t t;
+    const size_t folded_len = (num_taps + 1) / 2;
+    const size_t center = (num_taps - 1) / 2;
+    float *ret = fir_kernel_alloc(2 * num_taps * sizeof(ret[0]));
+
+    if (!ret) {
+        return NULL;
+    }
+
+    switch (kernel->layout) {
+        case FIR_TAPS_NATURAL:
+            memcpy(ret, taps, num_taps * sizeof(ret[0]));
+            break;
+
+        case FIR_TAPS_INTERLEAVED:
+            for (i = 0; i < num_taps; i++) {
+                ret[2 * i] = ret[2 * i + 1] = taps[num_taps - 1 - i];
+            }
+            break;
+
+        case FIR_TAPS_FOLDED:
+            memcpy(ret, taps, folded_len * sizeof(ret[0]));
+            break;
+
+        case FIR_TAPS_FOLDED_INTERLEAVED:
+            for (i = 0; i < folded_len; i++) {
+                ret[2 * i] = ret[2 * i + 1] = taps[i];
+            }
+            break;
+
+        case FIR_TAPS_HALFBAND:
+            for (i = 1 - (center & 1), t = 0; i < center; i += 2, t++) {
+                ret[t] = taps[i];
+            }
+
+            ret[t] = taps[center];
+            break;
+
+        case FIR_TAPS_HALFBAND_INTERLEAVED:
+            for (i = 1 - (center & 1), t = 0; i < center; i += 2, t++) {
+                ret[2 * t] = ret[2 * t + 1] = taps[i];
+            }
+
+            ret[2 * t] = ret[2 * t + 1] = taps[center];
+            break;
+
+        default:
+            log_critical("Bug: Invalid tap layout: %d\n", kernel->layout);
+            free(ret);
+            ret = NULL;
+    }
+
+    return ret;
+}
+
+fir_fixed_mac_fn fir_kernel_fixed_mac(void)
+{
+#if HAVE_X86_KERNELS
+    if (cpu_supports("avx2")) {
+        return fixed_mac_avx2;
+    } else if (cpu_supports("sse2")) {
+        return fixed_mac_sse2;
+    }
+#endif
+
+    return fixed_mac_scalar;
+}
+
+const struct fir_block_kernel * fir_kernel_block(size_t num_taps)
+{
+    size_t i;
+    static bool supported[ARRAY_SIZE(block_kernels)];
+    static bool initialized = false;
+
+    if (!initialized) {
+        for (i = 0; i < ARRAY_SIZE(block_kernels); i++) {
+            supported[i] = !strcmp(block_kernels[i].name, "generic") ||
+                           cpu_supports(block_kernels[i].name);
+        }
+
+        initialized = true;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(block_kernels); i++) {
+        if (supported[i] && block_kernels[i].num_taps == num_taps) {
+            return &block_kernels[i];
+        }
+    }
+
+    return NULL;
+}
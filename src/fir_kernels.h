@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef FIR_KERNELS_H_
+#define FIR_KERNELS_H_
+
+/* This file provides the inner convolution loops used by fir.c, along with
+ * run-time selection of SIMD implementations of these loops. */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "complexf.h"
+
+/**
+ * Tap layouts expected by kernel implementations
+ */
+enum fir_tap_layout {
+    FIR_TAPS_NATURAL,       /**< taps[i] is applied to the i-th newest sample */
+    FIR_TAPS_INTERLEAVED,   /**< Taps are reversed (oldest-first) and each
+                             *   tap is duplicated so that it lines up with
+                             *   both the I and Q of an interleaved sample */
+    FIR_TAPS_FOLDED,        /**< First ceil(num_taps / 2) taps, in natural
+                             *   order, for use with a symmetric filter */
+    FIR_TAPS_FOLDED_INTERLEAVED, /**< FIR_TAPS_FOLDED, with each tap
+                                  *   duplicated as in FIR_TAPS_INTERLEAVED */
+    FIR_TAPS_HALFBAND,      /**< Non-zero taps preceding the center tap, in
+                             *   natural order, followed by the center tap */
+    FIR_TAPS_HALFBAND_INTERLEAVED, /**< FIR_TAPS_HALFBAND, with each tap
+                                    *   duplicated as in
+                                    *   FIR_TAPS_INTERLEAVED */
+};
+
+/**
+ * Filter tap symmetry
+ */
+enum fir_symmetry {
+    FIR_SYMMETRY_NONE,      /**< Taps are not symmetric */
+    FIR_SYMMETRY_EVEN,      /**< taps[i] == taps[num_taps - 1 - i] */
+    FIR_SYMMETRY_ODD,       /**< taps[i] == -taps[num_taps - 1 - i] */
+    FIR_SYMMETRY_HALFBAND,  /**< Even symmetry and an odd number of taps,
+                             *   with every other tap zero, apart from the
+                             *   center tap. See fir_kernel_halfband_zero(). */
+};
+
+/**
+ * Compute a single filter output
+ *
+ * @param[in]   taps        Filter taps, in the layout required by the kernel
+ * @param[in]   x           Window of num_taps contiguous samples, oldest first
+ * @param[in]   num_taps    Number of filter taps
+ * @param[out]  out         Filter output
+ */
+typedef void (*fir_convolve_fn)(const float *taps, const struct complexf *x,
+                                size_t num_taps, struct complexf *out);
+
+/**
+ * Convolution kernel description
+ */
+struct fir_kernel {
+    const char *name;               /**< Kernel name */
+    enum fir_symmetry symmetry;     /**< Tap symmetry required by the kernel.
+                                     *   Symmetric kernels sum mirrored
+                                     *   samples prior to multiplication. */
+    enum fir_tap_layout layout;     /**< Tap layout required by `convolve` */
+    fir_convolve_fn convolve;       /**< Kernel implementation */
+    size_t min_taps;                /**< Minimum filter length for which this
+                                     *   kernel is preferred. The setup cost
+                                     *   of the wider kernels outweighs their
+                                     *   benefit on short filters. */
+};
+
+/**
+ * Get the fastest kernel supported by the host CPU for a filter of the
+ * specified length and symmetry. CPU feature detection is performed on the
+ * first call to this function.
+ *
+ * @param   num_taps    Number of filter taps
+ * @param   symmetry    Symmetry of the filter taps. An unfolded kernel may
+ *                      be returned for symmetric filters, if it is faster.
+ *
+ * @return Kernel description. This will never be NULL; the scalar reference
+ *         implementation is returned if no SIMD extensions are available.
+ */
+const struct fir_kernel * fir_kernel_best(size_t num_taps,
+                                          enum fir_symmetry symmetry);
+
+/**
+ * Look up a kernel by name. Valid names are "scalar", "sse2", "avx2", and
+ * "avx512". This function is case-insensitive.
+ *
+ * If the named kernel has a variant specialized for the specified
+ * symmetry, it is returned. Otherwise, the most specialized variant that is
+ * compatible with the symmetry is returned.
+ *
+ * @param   name        Kernel name
+ * @param   symmetry    Symmetry of the filter taps
+ *
+ * @return Kernel description, or NULL if the name is not valid or the
+ *         kernel is not supported by the host CPU.
+ */
+const struct fir_kernel * fir_kernel_get(const char *name,
+                                         enum fir_symmetry symmetry);
+
+/**
+ * Determine the symmetry of the provided taps. Taps must match exactly in
+ * order to be considered symmetric.
+ *
+ * @param   taps        Taps in FIR_TAPS_NATURAL order
+ * @param   num_taps    Number of taps
+ *
+ * @return Tap symmetry
+ */
+enum fir_symmetry fir_kernel_symmetry(const float *taps, size_t num_taps);
+
+/**
+ * Test whether a tap must be zero in a half-band filter
+ *
+ * @param   num_taps    Number of taps. Must be odd.
+ * @param   i           Tap index
+ *
+ * @return true if tap `i` is an even, non-zero distance from the center tap
+ */
+static inline bool fir_kernel_halfband_zero(size_t num_taps, size_t i)
+{
+    const size_t center = (num_taps - 1) / 2;
+    return i != center && ((i ^ center) & 1) == 0;
+}
+
+/**
+ * @return String representation of the provided symmetry value
+ */
+const char * fir_symmetry_str(enum fir_symmetry symmetry);
+
+/**
+ * Arrange taps in the layout required by the specified kernel
+ *
+ * @param[in]   kernel      Kernel the taps will be used with
+ * @param[in]   taps        Taps in FIR_TAPS_NATURAL order
+ * @param[in]   num_taps    Number of taps
+ *
+ * @return Heap-allocated array of taps on success, NULL on failure. This is
+ *         allocated via fir_kernel_alloc() and must be freed via free().
+ */
+float * fir_kernel_prepare_taps(const struct fir_kernel *kernel,
+                                const float *taps, size_t num_taps);
+
+/**
+ * Fixed-point multiply-accumulate of a pair of taps across a block of
+ * outputs. For each j in [0, count):
+ *
+ *   acc[j] += tap_a * a[j] + tap_b * b[j]
+ *
+ * The caller must ensure that this cannot overflow.
+ *
+ * @param[inout]    acc     Accumulators
+ * @param[in]       a       Samples that tap_a is applied to
+ * @param[in]       b       Samples that tap_b is applied to
+ * @param[in]       tap_a   First tap
+ * @param[in]       tap_b   Second tap
+ * @param[in]       count   Number of accumulators
+ */
+typedef void (*fir_fixed_mac_fn)(int32_t *acc,
+                                 const int16_t *a, const int16_t *b,
+                                 int16_t tap_a, int16_t tap_b, size_t count);
+
+/**
+ * Get the fastest fixed-point multiply-accumulate implementation supported
+ * by the host CPU
+ *
+ * @return Multiply-accumulate implementation. This will never be NULL.
+ */
+fir_fixed_mac_fn fir_kernel_fixed_mac(void);
+
+/**
+ * Maximum number of folded taps for which a block mode kernel may be
+ * specialized
+ */
+#define BLOCK_KERNEL_MAX_TAPS 32
+
+/**
+ * Block mode kernel, specialized for a fixed number of folded taps of an
+ * even-symmetric filter. For each j in [0, count):
+ *
+ *   out[j] = sum(taps[t] * (x[offsets[2t] + j] + x[offsets[2t + 1] + j]))
+ *
+ * The terms are accumulated in order of increasing t, starting from zero.
+ *
+ * @param[out]  out         Outputs
+ * @param[in]   x           Samples
+ * @param[in]   taps        Folded taps
+ * @param[in]   offsets     Offsets into `x` of the samples each tap is
+ *                          applied to, as pairs
+ * @param[in]   count       Number of outputs
+ */
+typedef void (*fir_block_fn)(float *out, const float *x, const float *taps,
+                             const size_t *offsets, size_t count);
+
+/**
+ * Specialized block mode kernel description
+ */
+struct fir_block_kernel {
+    const char *name;   /**< Kernel name: "generic" or the SIMD extension
+                         *   it is compiled for */
+    size_t num_taps;    /**< Number of folded taps */
+    fir_block_fn fn;    /**< Kernel implementation */
+};
+
+/**
+ * Get the fastest block mode kernel specialized for the specified number of
+ * folded taps and supported by the host CPU
+ *
+ * @param   num_taps    Number of folded taps
+ *
+ * @return Kernel description, or NULL if there is no specialization for
+ *         this number of taps
+ */
+const struct fir_block_kernel * fir_kernel_block(size_t num_taps);
+
+/**
+ * Allocate a buffer suitably aligned for the SIMD kernels
+ *
+ * @param   len     Length of the buffer, in bytes
+ *
+ * @return Heap-allocated buffer on success, NULL on failure. This must be
+ *         freed via free().
+ */
+void * fir_kernel_alloc(size_t len);
+
+#endif
@@ -0,0 +1,902 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <jansson.h>
+
+#include "fir_plan.h"
+#include "fir_kernels.h"
+#include "log.h"
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+/* The frequency responses of the filter as written and as planned are
+ * compared at GRID_MIN_POINTS, or GRID_POINTS_PER_TAP per tap of the stage
+ * being split, evenly spaced points from DC to Nyquist. */
+#define GRID_MIN_POINTS     1024
+#define GRID_POINTS_PER_TAP 8
+
+/* Half-band filter lengths are of the form 4k + 3, which have non-zero
+ * outermost taps. Lengths beyond HALFBAND_MAX_TAPS are not considered, and
+ * HALFBAND_LENGTHS_TRIED successively longer filters are tried, starting from
+ * the length estimated for the Kaiser window design. */
+#define HALFBAND_MIN_TAPS       7
+#define HALFBAND_MAX_TAPS       127
+#define HALFBAND_LENGTHS_TRIED  3
+
+/* Stages are split only if they have at least this many taps */
+#define SPLIT_MIN_TAPS 8
+
+/* A stage of the filter being planned */
+struct plan_stage {
+    json_t *json;               /* Stage as written, if it is to be retained
+                                 * as-is, or NULL if it has been planned */
+    bool modifiable;            /* Stage may be fused or split */
+    bool halfband;              /* Stage is a planned half-band stage */
+    unsigned int segment;       /* 0 prior to envelope detection, 1 after */
+
+    float *taps;
+    size_t num_taps;
+    unsigned int decimation;
+    enum fir_symmetry symmetry;
+
+    double cost;                /* Per input sample of this stage */
+};
+
+double fir_plan_block_cost(size_t num_taps, unsigned int decimation,
+                           enum fir_symmetry symmetry)
+{
+    double taps = (double) num_taps;
+
+    if (symmetry == FIR_SYMMETRY_HALFBAND) {
+        taps /= 4;
+    } else if (symmetry != FIR_SYMMETRY_NONE) {
+        taps /= 2;
+    }
+
+    return 2 * taps / decimation;
+}
+
+/* Stages following envelope detection operate on real values, requiring
+ * half the multiplies */
+static double stage_cost(const struct plan_stage *s)
+{
+    const double cost = fir_plan_block_cost(s->num_taps, s->decimation,
+                                            s->symmetry);
+
+    return s->segment != 0 ? cost / 2 : cost;
+}
+
+/* Total cost, in real multiplies per input sample of the first stage */
+static double total_cost(const struct plan_stage *stages, size_t num_stages)
+{
+    size_t i;
+    double decimation = 1;
+    double cost = 0;
+
+    for (i = 0; i < num_stages; i++) {
+        cost += stages[i].cost / decimation;
+        decimation *= stages[i].decimation;
+    }
+
+    return cost;
+}
+
+/* Read a stage as written. Entries that are missing or invalid are left to
+ * fir_init() to report; such stages are simply retained as-is. */
+static bool read_stage(json_t *json, unsigned int segment,
+                       struct plan_stage *s)
+{
+    size_t i;
+    json_t *tmp, *tap;
+    const char *type = NULL;
+
+    s->json = json;
+    s->segment = segment;
+    s->decimation = 1;
+    s->symmetry = FIR_SYMMETRY_NONE;
+
+    tmp = json_object_get(json, "type");
+    if (tmp) {
+        type = json_string_value(tmp);
+    }
+
+    tmp = json_object_get(json, "decimation");
+    if (tmp) {
+        if (!json_is_integer(tmp) || json_integer_value(tmp) <= 0 ||
+            json_integer_value(tmp) >= UINT_MAX) {
+            return true;
+        }
+
+        s->decimation = (unsigned int) json_integer_value(tmp);
+    }
+
+    tmp = json_object_get(json, "taps");
+    if (!json_is_array(tmp) || json_array_size(tmp) == 0) {
+        return true;
+    }
+
+    s->num_taps = json_array_size(tmp);
+    s->taps = malloc(s->num_taps * sizeof(s->taps[0]));
+    if (!s->taps) {
+        log_error("Error: Failed to allocate taps.\n");
+        return false;
+    }
+
+    json_array_foreach(tmp, i, tap) {
+        if (!json_is_number(tap)) {
+            free(s->taps);
+            s->taps = NULL;
+            s->num_taps = 0;
+            return true;
+        }
+
+        s->taps[i] = (float) json_number_value(tap);
+    }
+
+    if (type && !strcasecmp(type, "halfband")) {
+        s->symmetry = FIR_SYMMETRY_HALFBAND;
+    } else if (json_is_false(json_object_get(json, "fold_symmetric"))) {
+        s->symmetry = FIR_SYMMETRY_NONE;
+    } else {
+        s->symmetry = fir_kernel_symmetry(s->taps, s->num_taps);
+    }
+
+    s->cost = stage_cost(s);
+
+    s->modifiable = (type == NULL || !strcasecmp(type, "fir")) &&
+                    json_object_get(json, "mode") == NULL &&
+                    json_object_get(json, "fold_symmetric") == NULL;
+
+    return true;
+}
+
+/* Initialize a planned stage, taking ownership of `taps` */
+static void set_stage(struct plan_stage *s, float *taps, size_t num_taps,
+                      unsigned int decimation, unsigned int segment,
+                      bool halfband)
+{
+    s->json = NULL;
+    s->modifiable = true;
+    s->halfband = halfband;
+    s->segment = segment;
+    s->taps = taps;
+    s->num_taps = num_taps;
+    s->decimation = decimation;
+    s->symmetry = fir_kernel_symmetry(taps, num_taps);
+    s->cost = stage_cost(s);
+}
+
+/*******************************************************************************
+ * Fusion
+ ******************************************************************************/
+
+/* A stage with taps h1 and decimation D1 followed by a stage with taps h2 is
+ * equivalent to a single stage with taps h1 * h2', decimating by the product
+ * of the two decimations, where h2' is h2 with (D1 - 1) zeros inserted
+ * between each of its taps. */
+static float * fuse_taps(const struct plan_stage *a,
+                         const struct plan_stage *b, size_t *num_taps)
+{
+    size_t i, j;
+    double *acc;
+    float *taps;
+    const size_t n = a->num_taps + a->decimation * (b->num_taps - 1);
+
+    acc = calloc(n, sizeof(acc[0]));
+    taps = malloc(n * sizeof(taps[0]));
+
+    if (!acc || !taps) {
+        log_error("Error: Failed to allocate fused taps.\n");
+        free(acc);
+        free(taps);
+        return NULL;
+    }
+
+    for (j = 0; j < b->num_taps; j++) {
+        for (i = 0; i < a->num_taps; i++) {
+            acc[j * a->decimation + i] += (double) a->taps[i] * b->taps[j];
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        taps[i] = (float) acc[i];
+    }
+
+    /* The result of fusing two even-symmetric stages is even-symmetric, but
+     * may not be exactly so after rounding */
+    if (a->symmetry != FIR_SYMMETRY_NONE && a->symmetry != FIR_SYMMETRY_ODD &&
+        b->symmetry != FIR_SYMMETRY_NONE && b->symmetry != FIR_SYMMETRY_ODD) {
+        for (i = 0; i < n / 2; i++) {
+            taps[n - 1 - i] = taps[i];
+        }
+    }
+
+    free(acc);
+    *num_taps = n;
+    return taps;
+}
+
+/* Repeatedly fuse the pair of adjacent stages yielding the greatest savings,
+ * until no such pair remains */
+static bool fuse_stages(struct plan_stage *stages, size_t *num_stages)
+{
+    size_t i, best;
+    size_t num_taps, best_num_taps = 0;
+    float *taps, *best_taps;
+    double savings, best_savings;
+    struct plan_stage fused;
+
+    do {
+        best_taps = NULL;
+        best_savings = 0;
+        best = 0;
+
+        for (i = 0; i + 1 < *num_stages; i++) {
+            struct plan_stage *a = &stages[i];
+            struct plan_stage *b = &stages[i + 1];
+
+            if (!a->modifiable || !b->modifiable || a->segment != b->segment ||
+                a->decimation > UINT_MAX / b->decimation) {
+                continue;
+            }
+
+            taps = fuse_taps(a, b, &num_taps);
+            if (!taps) {
+                free(best_taps);
+                return false;
+            }
+
+            set_stage(&fused, taps, num_taps, a->decimation * b->decimation,
+                      a->segment, false);
+
+            savings = a->cost + b->cost / a->decimation - fused.cost;
+            if (savings > best_savings) {
+                free(best_taps);
+                best_taps = taps;
+                best_num_taps = num_taps;
+                best_savings = savings;
+                best = i;
+            } else {
+                free(taps);
+            }
+        }
+
+        if (best_taps) {
+            log_debug("Filter planner: Fusing stages with %zd and %zd taps "
+                      "into a single %zd-tap stage.\n", stages[best].num_taps,
+                      stages[best + 1].num_taps, best_num_taps);
+
+            set_stage(&fused, best_taps, best_num_taps,
+                      stages[best].decimation * stages[best + 1].decimation,
+                      stages[best].segment, false);
+
+            free(stages[best].taps);
+            free(stages[best + 1].taps);
+            stages[best] = fused;
+
+            memmove(&stages[best + 1], &stages[best + 2],
+                    (*num_stages - best - 2) * sizeof(stages[0]));
+            (*num_stages)--;
+        }
+    } while (best_taps);
+
+    return true;
+}
+
+/*******************************************************************************
+ * Splitting
+ ******************************************************************************/
+
+/* Zero-phase amplitude response of a symmetric filter, at frequency w */
+static double amplitude(const float *taps, size_t num_taps, double w)
+{
+    size_t i;
+    double ret = 0;
+    const double center = (num_taps - 1) / 2.0;
+
+    for (i = 0; i < num_taps; i++) {
+        ret += taps[i] * cos(w * (i - center));
+    }
+
+    return ret;
+}
+
+/* Zeroth-order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+    unsigned int k;
+    double term = 1, sum = 1;
+
+    for (k = 1; k < 64 && term > 1e-12 * sum; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+/* Estimate the length of a half-band filter with the specified ripple and
+ * transition width, designed with a Kaiser window */
+static size_t halfband_len(double ripple, double transition, double *beta)
+{
+    const double atten = -20 * log10(ripple);
+    double len;
+    size_t ret;
+
+    if (atten > 50) {
+        *beta = 0.1102 * (atten - 8.7);
+    } else if (atten > 21) {
+        *beta = 0.5842 * pow(atten - 21, 0.4) + 0.07886 * (atten - 21);
+    } else {
+        *beta = 0;
+    }
+
+    len = ceil((atten - 8) / (2.285 * transition)) + 1;
+    if (len > HALFBAND_MAX_TAPS) {
+        return HALFBAND_MAX_TAPS + 1;
+    }
+
+    ret = (size_t) len;
+    if (ret < HALFBAND_MIN_TAPS) {
+        ret = HALFBAND_MIN_TAPS;
+    }
+
+    /* Round up to the nearest 4k + 3 */
+    return ret + ((3 - ret % 4) + 4) % 4;
+}
+
+/* Design a half-band filter with a Kaiser window, normalized for unity gain
+ * at DC. Taps that should be zero are exactly zero. */
+static void halfband_design(float *taps, size_t num_taps, double beta)
+{
+    size_t i;
+    double sum = 0;
+    const size_t center = (num_taps - 1) / 2;
+    double *h = malloc((center + 1) * sizeof(h[0]));
+
+    if (!h) {
+        return;
+    }
+
+    for (i = 0; i <= center; i++) {
+        const double r = (double) i / center;
+        const double window = bessel_i0(beta * sqrt(1 - r * r)) /
+                              bessel_i0(beta);
+
+        if (i == 0) {
+            h[i] = 0.5;
+        } else if ((i & 1) == 0) {
+            h[i] = 0;
+        } else {
+            h[i] = sin(M_PI * i / 2) / (M_PI * i) * window;
+        }
+
+        sum += (i == 0) ? h[i] : 2 * h[i];
+    }
+
+    for (i = 0; i <= center; i++) {
+        taps[center - i] = taps[center + i] = (float) (h[i] / sum);
+    }
+
+    free(h);
+}
+
+/* Solve the symmetric positive definite system `a x = b` in place, where
+ * `a` is n x n. The solution is returned in `b`. */
+static bool cholesky_solve(double *a, double *b, size_t n)
+{
+    size_t i, j, k;
+
+    for (j = 0; j < n; j++) {
+        double d = a[j * n + j];
+
+        for (k = 0; k < j; k++) {
+            d -= a[j * n + k] * a[j * n + k];
+        }
+
+        if (d <= 0) {
+            return false;
+        }
+
+        a[j * n + j] = sqrt(d);
+
+        for (i = j + 1; i < n; i++) {
+            double v = a[i * n + j];
+
+            for (k = 0; k < j; k++) {
+                v -= a[i * n + k] * a[j * n + k];
+            }
+
+            a[i * n + j] = v / a[j * n + j];
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < i; k++) {
+            b[i] -= a[i * n + k] * b[k];
+        }
+        b[i] /= a[i * n + i];
+    }
+
+    for (i = n; i-- > 0; ) {
+        for (k = i + 1; k < n; k++) {
+            b[i] -= a[k * n + i] * b[k];
+        }
+        b[i] /= a[i * n + i];
+    }
+
+    return true;
+}
+
+/* Frequency grid and responses used when splitting a stage */
+struct split {
+    size_t len;             /* Number of grid points */
+    double *w;              /* Grid frequencies, 0 through pi */
+    double *target;         /* Amplitude response of the stage as written */
+    double *prefix;         /* Amplitude response of the half-band stages
+                             * accepted thus far */
+    double *cascade;        /* Response of prefix and the half-band stage
+                             * being evaluated */
+    double peak;            /* Peak of |target| */
+    double tolerance;       /* Maximum deviation from target */
+
+    double *basis;          /* len x num_taps scratch */
+    double *normal;         /* num_taps x num_taps scratch */
+    double *rhs;            /* num_taps scratch */
+};
+
+/* Fit the taps of a stage, operating at 1 / `scale` times the input rate of
+ * the stage being split, such that it follows the half-band stages in
+ * s->cascade with the least squares error from the target response. Returns
+ * true if the result is within the tolerance of the target. */
+static bool fit_remainder(struct split *s, unsigned int scale,
+                          float *taps, size_t num_taps)
+{
+    size_t i, j, k;
+    double err;
+    const bool odd = (num_taps & 1) != 0;
+    const size_t n = (num_taps + 1) / 2;
+    const size_t center = num_taps / 2;
+
+    /* Basis functions are the response of the cascade to each pair of
+     * mirrored taps */
+    for (k = 0; k < s->len; k++) {
+        for (j = 0; j < n; j++) {
+            const double nu = odd ? (double) j : j + 0.5;
+            const double c = (odd && j == 0) ? 1 : 2;
+
+            s->basis[k * n + j] = s->cascade[k] * c * cos(nu * scale * s->w[k]);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j <= i; j++) {
+            double sum = 0;
+
+            for (k = 0; k < s->len; k++) {
+                sum += s->basis[k * n + i] * s->basis[k * n + j];
+            }
+
+            s->normal[i * n + j] = s->normal[j * n + i] = sum;
+        }
+
+        s->rhs[i] = 0;
+        for (k = 0; k < s->len; k++) {
+            s->rhs[i] += s->basis[k * n + i] * s->target[k];
+        }
+    }
+
+    /* Regularize the system, as taps beyond those required are poorly
+     * determined */
+    for (i = 0; i < n; i++) {
+        s->normal[i * n + i] *= 1 + 1e-9;
+        s->normal[i * n + i] += 1e-12;
+    }
+
+    if (!cholesky_solve(s->normal, s->rhs, n)) {
+        return false;
+    }
+
+    for (j = 0; j < n; j++) {
+        if (odd) {
+            taps[center - j] = taps[center + j] = (float) s->rhs[j];
+        } else {
+            taps[center - 1 - j] = taps[center + j] = (float) s->rhs[j];
+        }
+    }
+
+    for (k = 0; k < s->len; k++) {
+        err = s->cascade[k] * amplitude(taps, num_taps, scale * s->w[k]) -
+              s->target[k];
+
+        if (fabs(err) > s->tolerance) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Find the shortest remainder, of at most `max_taps` taps, meeting the
+ * tolerance. Its length is searched for separately for odd and even lengths,
+ * assuming a longer filter of the same parity would also meet it. */
+static float * find_remainder(struct split *s, unsigned int scale,
+                              size_t max_taps, size_t *num_taps)
+{
+    size_t parity, lo, hi, mid;
+    size_t best_len = 0;
+    float *taps, *best = NULL;
+
+    taps = malloc(max_taps * sizeof(taps[0]));
+    if (!taps) {
+        return NULL;
+    }
+
+    for (parity = 1; parity <= 2; parity++) {
+        lo = parity;
+        hi = (best && best_len - 1 < max_taps) ? best_len - 1 : max_taps;
+        hi -= (hi - parity) & 1;
+
+        if (hi < lo || hi > max_taps || !fit_remainder(s, scale, taps, hi)) {
+            continue;
+        }
+
+        /* Shortest length in [lo, hi] that fits, given that hi does */
+        while (lo < hi) {
+            mid = lo + ((hi - lo) / 2 & ~(size_t) 1);
+
+            if (fit_remainder(s, scale, taps, mid)) {
+                hi = mid;
+            } else {
+                lo = mid + 2;
+            }
+        }
+
+        if (!best || hi < best_len) {
+            free(best);
+            best = malloc(hi * sizeof(best[0]));
+            if (!best) {
+                break;
+            }
+
+            fit_remainder(s, scale, best, hi);
+            best_len = hi;
+        }
+    }
+
+    free(taps);
+    *num_taps = best_len;
+    return best;
+}
+
+/* Attempt to split a stage into a cascade of decimate-by-2 half-band stages
+ * followed by a stage with the remaining decimation. On success, the
+ * stages of the cascade are returned and the stage is unmodified.
+ * Otherwise, 0 is returned. */
+static size_t split_stage(const struct plan_stage *stage, double tolerance,
+                          struct plan_stage *out, size_t max_out)
+{
+    size_t k, n, num_out = 0;
+    size_t num_taps, hb_len, max_taps;
+    double beta, edge, cost, best_cost, chain_cost = 0;
+    unsigned int scale = 1;
+    unsigned int decimation = stage->decimation;
+    float *hb = NULL, *rem = NULL;
+    float *best_hb = NULL, *best_rem = NULL;
+    size_t best_hb_len = 0, best_rem_len = 0;
+    struct split s;
+
+    memset(&s, 0, sizeof(s));
+
+    s.len = stage->num_taps * GRID_POINTS_PER_TAP;
+    if (s.len < GRID_MIN_POINTS) {
+        s.len = GRID_MIN_POINTS;
+    }
+
+    s.w       = malloc(s.len * sizeof(s.w[0]));
+    s.target  = malloc(s.len * sizeof(s.target[0]));
+    s.prefix  = malloc(s.len * sizeof(s.prefix[0]));
+    s.cascade = malloc(s.len * sizeof(s.cascade[0]));
+    s.basis   = malloc(s.len * stage->num_taps * sizeof(s.basis[0]));
+    s.normal  = malloc(stage->num_taps * stage->num_taps * sizeof(s.normal[0]));
+    s.rhs     = malloc(stage->num_taps * sizeof(s.rhs[0]));
+    hb        = malloc(HALFBAND_MAX_TAPS * sizeof(hb[0]));
+
+    if (!s.w || !s.target || !s.prefix || !s.cascade || !s.basis ||
+        !s.normal || !s.rhs || !hb) {
+        log_error("Error: Failed to allocate filter planner buffers.\n");
+        goto out;
+    }
+
+    for (k = 0; k < s.len; k++) {
+        s.w[k] = M_PI * k / (s.len - 1);
+        s.target[k] = amplitude(stage->taps, stage->num_taps, s.w[k]);
+        s.prefix[k] = 1;
+
+        if (fabs(s.target[k]) > s.peak) {
+            s.peak = fabs(s.target[k]);
+        }
+    }
+
+    s.tolerance = tolerance * s.peak;
+
+    /* The band of interest extends to the highest frequency at which the
+     * response exceeds half the tolerance. */
+    edge = 0;
+    for (k = 0; k < s.len; k++) {
+        if (fabs(s.target[k]) > s.tolerance / 2) {
+            edge = s.w[k];
+        }
+    }
+
+    best_cost = stage->cost;
+
+    while ((decimation & 1) == 0 && num_out + 2 <= max_out &&
+           scale * edge < M_PI / 2) {
+
+        /* A half-band stage operating at 1 / scale times the stage's input
+         * rate must pass the band of interest, and attenuate its images. */
+        hb_len = halfband_len(tolerance / 4, M_PI - 2 * scale * edge, &beta);
+
+        best_hb = NULL;
+        best_rem = NULL;
+
+        for (n = 0; n < HALFBAND_LENGTHS_TRIED; n++, hb_len += 4) {
+            const double hb_cost =
+                fir_plan_block_cost(hb_len, 2, FIR_SYMMETRY_HALFBAND) / scale;
+
+            if (hb_len > HALFBAND_MAX_TAPS ||
+                chain_cost + hb_cost >= best_cost) {
+                break;
+            }
+
+            halfband_design(hb, hb_len, beta);
+            for (k = 0; k < s.len; k++) {
+                s.cascade[k] = s.prefix[k] *
+                               amplitude(hb, hb_len, scale * s.w[k]);
+            }
+
+            /* Longest remainder that would reduce the cost */
+            max_taps = 0;
+            while (max_taps < stage->num_taps &&
+                   chain_cost + hb_cost +
+                   fir_plan_block_cost(max_taps + 1, decimation / 2,
+                                       FIR_SYMMETRY_EVEN) / (2 * scale)
+                   < best_cost) {
+                max_taps++;
+            }
+
+            if (max_taps == 0) {
+                break;
+            }
+
+            rem = find_remainder(&s, 2 * scale, max_taps, &num_taps);
+            if (!rem) {
+                continue;
+            }
+
+            cost = chain_cost + hb_cost +
+                   fir_plan_block_cost(num_taps, decimation / 2,
+                                       FIR_SYMMETRY_EVEN) / (2 * scale);
+
+            if (cost < best_cost) {
+                free(best_hb);
+                free(best_rem);
+
+                best_hb = malloc(hb_len * sizeof(best_hb[0]));
+                if (!best_hb) {
+                    free(rem);
+                    goto out;
+                }
+
+                memcpy(best_hb, hb, hb_len * sizeof(hb[0]));
+                best_hb_len = hb_len;
+                best_rem = rem;
+                best_rem_len = num_taps;
+                best_cost = cost;
+            } else {
+                free(rem);
+            }
+        }
+
+        if (!best_hb) {
+            break;
+        }
+
+        /* Accept the half-band stage, replacing any prior remainder */
+        if (num_out > 0) {
+            free(out[num_out - 1].taps);
+            num_out--;
+        }
+
+        set_stage(&out[num_out++], best_hb, best_hb_len, 2, stage->segment,
+                  true);
+        set_stage(&out[num_out++], best_rem, best_rem_len, decimation / 2,
+                  stage->segment, false);
+
+        for (k = 0; k < s.len; k++) {
+            s.prefix[k] *= amplitude(best_hb, best_hb_len, scale * s.w[k]);
+        }
+
+        chain_cost += out[num_out - 2].cost / scale;
+        decimation /= 2;
+        scale *= 2;
+    }
+
+out:
+    free(s.w);
+    free(s.target);
+    free(s.prefix);
+    free(s.cascade);
+    free(s.basis);
+    free(s.normal);
+    free(s.rhs);
+    free(hb);
+    return num_out;
+}
+
+/*******************************************************************************
+ * Planning
+ ******************************************************************************/
+
+static json_t * stage_to_json(const struct plan_stage *s)
+{
+    size_t i;
+    json_t *stage, *taps;
+
+    if (s->json) {
+        return json_deep_copy(s->json);
+    }
+
+    stage = json_object();
+    taps = json_array();
+
+    if (!stage || !taps) {
+        json_decref(stage);
+        json_decref(taps);
+        return NULL;
+    }
+
+    for (i = 0; i < s->num_taps; i++) {
+        json_array_append_new(taps, json_real(s->taps[i]));
+    }
+
+    json_object_set_new(stage, "taps", taps);
+    json_object_set_new(stage, "decimation", json_integer(s->decimation));
+
+    if (s->halfband) {
+        json_object_set_new(stage, "type", json_string("halfband"));
+    }
+
+    return stage;
+}
+
+json_t * fir_plan_stages(json_t *stages, double tolerance,
+                         size_t *envelope_stage,
+                         double *written_cost, double *planned_cost)
+{
+    size_t i, j, n;
+    size_t num_stages = json_array_size(stages);
+    size_t num_planned = 0;
+    size_t max_split;
+    struct plan_stage *plan = NULL, *split = NULL;
+    json_t *ret = NULL;
+
+    /* Each halving of a stage's decimation yields at most one more stage */
+    max_split = sizeof(unsigned int) * CHAR_BIT + 1;
+
+    plan = calloc(num_stages * max_split, sizeof(plan[0]));
+    split = calloc(max_split, sizeof(split[0]));
+    if (!plan || !split) {
+        log_error("Error: Failed to allocate filter plan.\n");
+        goto out;
+    }
+
+    for (i = 0; i < num_stages; i++) {
+        const unsigned int segment =
+            (*envelope_stage != 0 && i >= *envelope_stage) ? 1 : 0;
+
+        if (!read_stage(json_array_get(stages, i), segment, &plan[i])) {
+            num_planned = i;
+            goto out;
+        }
+    }
+
+    num_planned = num_stages;
+    *written_cost = total_cost(plan, num_planned);
+
+    if (!fuse_stages(plan, &num_planned)) {
+        goto out;
+    }
+
+    for (i = 0; i < num_planned; i++) {
+        if (!plan[i].modifiable || plan[i].num_taps < SPLIT_MIN_TAPS ||
+            (plan[i].symmetry != FIR_SYMMETRY_EVEN &&
+             plan[i].symmetry != FIR_SYMMETRY_HALFBAND)) {
+            continue;
+        }
+
+        n = split_stage(&plan[i], tolerance, split, max_split);
+        if (n == 0) {
+            continue;
+        }
+
+        log_debug("Filter planner: Splitting %zd-tap stage into %zd "
+                  "half-band stage(s) and a %zd-tap stage.\n",
+                  plan[i].num_taps, n - 1, split[n - 1].num_taps);
+
+        free(plan[i].taps);
+
+        memmove(&plan[i + n], &plan[i + 1],
+                (num_planned - i - 1) * sizeof(plan[0]));
+        memcpy(&plan[i], split, n * sizeof(plan[0]));
+
+        num_planned += n - 1;
+        i += n - 1;
+    }
+
+    *planned_cost = total_cost(plan, num_planned);
+
+    ret = json_array();
+    if (!ret) {
+        goto out;
+    }
+
+    for (i = 0, j = 0; i < num_planned; i++) {
+        json_t *stage = stage_to_json(&plan[i]);
+
+        if (!stage) {
+            log_error("Error: Failed to create planned filter stage.\n");
+            json_decref(ret);
+            ret = NULL;
+            goto out;
+        }
+
+        json_array_append_new(ret, stage);
+
+        if (plan[i].segment == 0) {
+            j++;
+        }
+    }
+
+    if (*envelope_stage != 0) {
+        *envelope_stage = j;
+    }
+
+out:
+    if (plan) {
+        for (i = 0; i < num_planned; i++) {
+            free(plan[i].taps);
+        }
+    }
+
+    free(plan);
+    free(split);
+    return ret;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef FIR_PLAN_H_
+#define FIR_PLAN_H_
+
+/* This file provides the load-time planner used by fir.c to rewrite a
+ * filter's stages into a cheaper, equivalent cascade, along with the cost
+ * model it uses. */
+
+#include <stddef.h>
+#include <jansson.h>
+#include "fir_kernels.h"
+
+/**
+ * Default maximum deviation of the planned filter's amplitude response from
+ * that of the filter as written, relative to the peak of the latter
+ */
+#define FIR_PLAN_DEFAULT_TOLERANCE 1e-3
+
+/**
+ * Estimate the real multiplies per input sample of a block mode stage
+ *
+ * @param   num_taps    Number of taps
+ * @param   decimation  Decimation factor
+ * @param   symmetry    Symmetry of the taps, which determines how many of
+ *                      them are multiplied
+ *
+ * @return Estimated cost
+ */
+double fir_plan_block_cost(size_t num_taps, unsigned int decimation,
+                           enum fir_symmetry symmetry);
+
+/**
+ * Plan the stages of a filter.
+ *
+ * Each stage is costed in real multiplies per input sample. Adjacent stages
+ * are fused into a single stage where this is cheaper, which does not alter
+ * the filter's response. Even-symmetric stages with an even decimation are
+ * split into one or more half-band decimate-by-2 stages followed by a stage
+ * with the remaining decimation, designed to approximate the original
+ * response. Such a split is used only where it is cheaper, and where the
+ * amplitude response of the result is within `tolerance` of the original.
+ *
+ * Only stages consisting solely of "taps" and "decimation" entries (and
+ * optionally, "type": "fir") are candidates. All others are retained as-is.
+ * Stages are not fused across the point at which envelope detection occurs.
+ *
+ * @param[in]       stages          "stages" array of the filter as written
+ * @param[in]       tolerance       Maximum deviation of the amplitude response,
+ *                                  relative to its peak
+ * @param[inout]    envelope_stage  Number of stages preceding envelope
+ *                                  detection, or 0 if none. This is updated
+ *                                  to reflect the planned stages.
+ * @param[out]      written_cost    Estimated cost of the stages as written,
+ *                                  in real multiplies per filter input sample
+ * @param[out]      planned_cost    Estimated cost of the planned stages
+ *
+ * @return "stages" array of the planned filter on success, or NULL on
+ *         failure. The caller is responsible for calling json_decref() on the
+ *         returned value.
+ */
+json_t * fir_plan_stages(json_t *stages, double tolerance,
+                         size_t *envelope_stage,
+                         double *written_cost, double *planned_cost);
+
+#endif
@@ -54,6 +54,19 @@ struct enum_def {
     spt value;
 };
 
+/* Compiled by formatter_initialized(), this describes how a field's value is
+ * extracted from, or inserted into, message data. A field spans at most 9
+ * bytes, as it may start at any bit of its first byte. */
+struct field_plan {
+    unsigned int byte;          /* First byte of the field */
+    unsigned int shift;         /* Position of the field in its first byte */
+    unsigned int num_bytes;     /* Number of bytes loaded, up to 8 */
+    bool spill;                 /* The field extends into a 9th byte */
+    uint64_t mask;              /* Mask of the field's width */
+    bool reverse;               /* The field's bits are reversed */
+    unsigned int width;
+};
+
 struct formatter_field {
     char *name;
     unsigned int start_bit;
@@ -65,6 +78,11 @@ struct formatter_field {
     spt default_value;
     struct enum_def *enums;
     size_t enum_count;
+
+    struct field_plan plan;
+    struct enum_def *sorted_enums;  /* Enums with distinct values, sorted by
+                                     * value for lookup */
+    size_t sorted_enums_count;
 };
 
 static inline unsigned int get_width(const struct formatter_field *field)
@@ -422,40 +440,125 @@ bool formatter_set_field_default(struct formatter *f, const char *field_name,
     }
 }
 
-static spt get_field_value(struct formatter_field *f, const uint8_t *data)
+/* Load up to 8 bytes as a little endian word. A full word is loaded with a
+ * single unaligned load. */
+static inline uint64_t load_le(const uint8_t *data, unsigned int n)
 {
-    uint64_t tmp = 0;
+    uint64_t word = 0;
     unsigned int i;
-    unsigned int dest_bit;
 
-    if (f->endianness == FORMATTER_ENDIAN_BIG) {
-        dest_bit = f->end_bit - f->start_bit;
-    } else if (f->endianness == FORMATTER_ENDIAN_LITTLE) {
-        dest_bit = 0;
+    if (n == sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
     } else {
-        log_critical ("Bug: Invalid endianness setting: %d\n", f->endianness);
-        return (uint64_t) -1;
+        for (i = 0; i < n; i++) {
+            word |= (uint64_t) data[i] << (8 * i);
+        }
     }
 
-    for (i = f->start_bit; i <= f->end_bit; i++) {
-        const unsigned int byte     = i / 8;
-        const unsigned int src_bit  = i % 8;
+    return word;
+}
 
-        const uint64_t val = (data[byte] >> src_bit) & 0x1;
-        tmp |= val << dest_bit;
+static inline void store_le(uint8_t *data, unsigned int n, uint64_t word)
+{
+    unsigned int i;
 
-        if (f->endianness == FORMATTER_ENDIAN_BIG) {
-            dest_bit--;
-        } else if (f->endianness == FORMATTER_ENDIAN_LITTLE) {
-            dest_bit++;
+    if (n == sizeof(word)) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        memcpy(data, &word, sizeof(word));
+    } else {
+        for (i = 0; i < n; i++) {
+            data[i] = (uint8_t) (word >> (8 * i));
         }
     }
+}
+
+/* Reverse the order of the low `width` bits of a value. Bits are reversed
+ * within each byte, and then the bytes are swapped. */
+static inline uint64_t reverse_bits(uint64_t x, unsigned int width)
+{
+    x = ((x >> 1) & 0x5555555555555555llu) | ((x & 0x5555555555555555llu) << 1);
+    x = ((x >> 2) & 0x3333333333333333llu) | ((x & 0x3333333333333333llu) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fllu) | ((x & 0x0f0f0f0f0f0f0f0fllu) << 4);
+    return __builtin_bswap64(x) >> (64 - width);
+}
+
+/* Message bits are numbered from the LSB of the first byte. A little endian
+ * field's LSB is its first bit, and a big endian field's MSB is. */
+static void compile_plan(struct formatter_field *f, unsigned int max_bit)
+{
+    struct field_plan *p = &f->plan;
+    const unsigned int span = f->end_bit / 8 - f->start_bit / 8 + 1;
+    const unsigned int avail = (max_bit + 7) / 8 - f->start_bit / 8;
+
+    p->byte = f->start_bit / 8;
+    p->shift = f->start_bit % 8;
+    p->width = get_width(f);
+    p->mask = (p->width < 64) ? (1llu << p->width) - 1 : UINT64_MAX;
+    p->reverse = (f->endianness == FORMATTER_ENDIAN_BIG);
+    p->spill = (span > 8);
+
+    /* Load a full word where the data allows it */
+    p->num_bytes = (avail >= 8) ? 8 : span;
+}
+
+static spt get_field_value(const struct formatter_field *f,
+                           const uint8_t *data)
+{
+    const struct field_plan *p = &f->plan;
+    uint64_t tmp = load_le(&data[p->byte], p->num_bytes) >> p->shift;
+
+    if (p->spill) {
+        tmp |= (uint64_t) data[p->byte + 8] << (64 - p->shift);
+    }
+
+    tmp &= p->mask;
+
+    if (p->reverse) {
+        tmp = reverse_bits(tmp, p->width);
+    }
 
     return spt_from_uint64(tmp);
 }
 
+static int compare_enums(const void *a, const void *b)
+{
+    const struct enum_def *x = (const struct enum_def *) a;
+    const struct enum_def *y = (const struct enum_def *) b;
+
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/* Find the first-defined enum with the specified value, via binary search */
+static const struct enum_def * find_enum(const struct formatter_field *field,
+                                         spt value)
+{
+    size_t lo = 0, hi = field->sorted_enums_count;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        if (field->sorted_enums[mid].value < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < field->sorted_enums_count &&
+        field->sorted_enums[lo].value == value) {
+        return &field->sorted_enums[lo];
+    } else {
+        return NULL;
+    }
+}
+
 static void field_data_to_str(char *str, size_t max_chars, spt value,
-                               struct formatter_field *field)
+                              const struct formatter_field *field)
 {
     const unsigned int field_width = get_width(field);
     const uint64_t mask = (field_width < 64) ?
@@ -550,17 +653,11 @@ static void field_data_to_str(char *str, size_t max_chars, spt value,
         }
 
         case FORMATTER_FMT_ENUM: {
-            size_t i;
-            bool have_enum = false;
-
-            for (i = 0; i < field->enum_count && !have_enum; i++) {
-                if (field->enums[i].value == value) {
-                    snprintf(str, max_chars, "%s", field->enums[i].str);
-                    have_enum = true;
-                }
-            }
+            const struct enum_def *e = find_enum(field, value);
 
-            if (!have_enum) {
+            if (e) {
+                snprintf(str, max_chars, "%s", e->str);
+            } else {
                 snprintf(str, max_chars, "0x%"PRIx64, value);
             }
 
@@ -602,6 +699,12 @@ bool formatter_initialized(struct formatter *f)
             return false;
         }
 
+        if (f->fields[i].end_bit >= f->max_bit) {
+            log_error("Field %zd extends beyond the message's %u bits.\n",
+                      i, f->max_bit);
+            return false;
+        }
+
         if (f->fields[i].format == FORMATTER_FMT_ENUM) {
             for (j = 0; j < f->fields[i].enum_count; j++) {
                 if (f->fields[i].enums[j].str == NULL) {
@@ -612,6 +715,44 @@ bool formatter_initialized(struct formatter *f)
         }
     }
 
+    /* Compile each field's extraction plan and enum lookup table */
+    for (i = 0; i < f->num_fields; i++) {
+        struct formatter_field *field = &f->fields[i];
+
+        compile_plan(field, f->max_bit);
+
+        if (field->format == FORMATTER_FMT_ENUM) {
+            free(field->sorted_enums);
+            field->sorted_enums = malloc(field->enum_count *
+                                         sizeof(field->sorted_enums[0]));
+
+            if (!field->sorted_enums) {
+                perror("malloc");
+                return false;
+            }
+
+            /* Of enums sharing a value, the first defined is reported. As
+             * qsort() is not stable, duplicates are removed beforehand. */
+            field->sorted_enums_count = 0;
+            for (j = 0; j < field->enum_count; j++) {
+                const struct enum_def *e = &field->enums[j];
+                size_t k;
+                bool dup = false;
+
+                for (k = 0; k < field->sorted_enums_count && !dup; k++) {
+                    dup = (field->sorted_enums[k].value == e->value);
+                }
+
+                if (!dup) {
+                    field->sorted_enums[field->sorted_enums_count++] = *e;
+                }
+            }
+
+            qsort(field->sorted_enums, field->sorted_enums_count,
+                  sizeof(field->sorted_enums[0]), compare_enums);
+        }
+    }
+
     return true;
 }
 
@@ -755,35 +896,26 @@ static bool str_to_field_bits(const struct formatter_field *field,
 static void apply_field_bits(const struct formatter_field *f,
                              uint64_t input_bits, uint8_t *data)
 {
-    unsigned int i, b;
-    uint64_t src_bit;
+    const struct field_plan *p = &f->plan;
+    const uint64_t mask = p->mask << p->shift;
+    uint64_t bits = input_bits & p->mask;
+    uint64_t word;
 
-    if (f->endianness == FORMATTER_ENDIAN_BIG) {
-        src_bit = f->end_bit - f->start_bit;
-    } else if (f->endianness == FORMATTER_ENDIAN_LITTLE) {
-        src_bit = 0;
-    } else {
-        log_critical ("Bug: Invalid endianness setting: %d\n", f->endianness);
-        return;
+    if (p->reverse) {
+        bits = reverse_bits(bits, p->width);
     }
 
-    for (i = f->start_bit, b = 0; i <= f->end_bit; i++) {
-        const unsigned int byte = i / 8;
-        const unsigned int bit  = i % 8;
+    word = load_le(&data[p->byte], p->num_bytes);
+    word = (word & ~mask) | (bits << p->shift);
+    store_le(&data[p->byte], p->num_bytes, word);
 
-        if (input_bits & (1 << src_bit)) {
-            data[byte] |= (1 << bit);
-        } else {
-            data[byte] &= ~(1 << bit);
-        }
+    if (p->spill) {
+        const uint8_t spill_mask = (uint8_t) (p->mask >> (64 - p->shift));
+        uint8_t *last = &data[p->byte + 8];
 
-        if (f->endianness == FORMATTER_ENDIAN_BIG) {
-            src_bit--;
-        } else if (f->endianness == FORMATTER_ENDIAN_LITTLE) {
-            src_bit++;
-        }
+        *last = (*last & ~spill_mask) |
+                ((uint8_t) (bits >> (64 - p->shift)) & spill_mask);
     }
-
 }
 
 
@@ -903,6 +1035,7 @@ void formatter_deinit(struct formatter *f)
             }
 
             free(f->fields[i].enums);
+            free(f->fields[i].sorted_enums);
             free(f->fields[i].name);
         }
 
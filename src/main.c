@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <errno.h>
 #include <getopt.h>
 
@@ -54,6 +55,20 @@
 #define OPTION_RX_RECORD_DIG    'B'
 #define OPTION_RX_FILTER        'F'
 #define OPTION_RX_FMT           0x81
+#define OPTION_RX_FIXED_POINT   0x82
+#define OPTION_RX_FILTER_PLAN   0x83
+#define OPTION_RX_FILTER_THREADS 0x84
+#define OPTION_RX_FILTER_CPUS   0x85
+#define OPTION_RX_SM_INTERPRET  0x86
+#define OPTION_RX_DECODE_THREADS 0x87
+#define OPTION_RX_NO_DISPATCH   0x88
+#define OPTION_RX_HYPOTHESES    0x89
+#define OPTION_RX_STATE         0x8a
+#define OPTION_RX_DEDUP         0x8b
+#define OPTION_RX_SQUELCH       0x8c
+#define OPTION_RX_ADAPTIVE      0x8d
+#define OPTION_RX_HYSTERESIS    0x8e
+#define OPTION_RX_MIN_WIDTH     0x8f
 
 /* SDR config */
 #define OPTION_SDR_ARGS         'A'
@@ -103,6 +118,20 @@ static const struct option long_options[] = {
     { "rx-rec-dig",             required_argument,  0,  OPTION_RX_RECORD_DIG },
     { "rx-filter",              required_argument,  0,  OPTION_RX_FILTER },
     { "rx-fmt",                 required_argument,  0,  OPTION_RX_FMT },
+    { "rx-fixed-point",         no_argument,        0,  OPTION_RX_FIXED_POINT },
+    { "rx-filter-plan",         no_argument,        0,  OPTION_RX_FILTER_PLAN },
+    { "rx-filter-threads",      required_argument,  0,  OPTION_RX_FILTER_THREADS },
+    { "rx-filter-cpus",         required_argument,  0,  OPTION_RX_FILTER_CPUS },
+    { "rx-sm-interpret",        no_argument,        0,  OPTION_RX_SM_INTERPRET },
+    { "rx-decode-threads",      required_argument,  0,  OPTION_RX_DECODE_THREADS },
+    { "rx-no-dispatch",         no_argument,        0,  OPTION_RX_NO_DISPATCH },
+    { "rx-hypotheses",          required_argument,  0,  OPTION_RX_HYPOTHESES },
+    { "rx-state",               required_argument,  0,  OPTION_RX_STATE },
+    { "rx-dedup",               required_argument,  0,  OPTION_RX_DEDUP },
+    { "rx-squelch",             required_argument,  0,  OPTION_RX_SQUELCH },
+    { "rx-adaptive",            no_argument,        0,  OPTION_RX_ADAPTIVE },
+    { "rx-hysteresis",          required_argument,  0,  OPTION_RX_HYSTERESIS },
+    { "rx-min-width",           required_argument,  0,  OPTION_RX_MIN_WIDTH },
 
     { "sdr-args",               required_argument,  0,  OPTION_SDR_ARGS },
     { "frequency",              required_argument,  0,  OPTION_FREQUENCY },
@@ -134,7 +163,9 @@ static void usage(const char *argv0)
     printf("Required parameters:\n");
     printf("  -r, --rx <SDR type>           Receive data.\n");
     printf("  -t, --tx <SDR type>           Transmit data.\n");
-    printf("  -d, --device <str>            Target OOK device name.\n");
+    printf("  -d, --device <str>            Target OOK device name. When receiving,\n");
+    printf("                                  this may be repeated to decode for\n");
+    printf("                                  multiple devices.\n");
     printf("\n");
     printf("Transmit options:\n");
     printf("  -c, --tx-count <count>        Number of times to send transmission.\n");
@@ -144,6 +175,20 @@ static void usage(const char *argv0)
     printf("Receive options:\n");
     printf("  -T, --rx-threshold <value>    On/Off threshold. Range is 0.0 to 1.0.\n");
     printf("                                  Default value: 0.1\n");
+    printf("  --rx-adaptive                 Track the noise floor and the mean\n");
+    printf("                                  magnitude of bursts, and place the\n");
+    printf("                                  threshold between them. The -T value\n");
+    printf("                                  is then the minimum threshold.\n");
+    printf("  --rx-hysteresis <fraction>    Clear the digital signal only below a\n");
+    printf("                                  lower threshold, at this fraction of\n");
+    printf("                                  the distance from the noise floor to\n");
+    printf("                                  the threshold. Range is 0.0 to 1.0.\n");
+    printf("                                  Default: 1.0 (no hysteresis)\n");
+    printf("  --rx-min-width <samples>      Remove pulses and gaps in the digital\n");
+    printf("                                  signal shorter than <samples>. This\n");
+    printf("                                  delays the signal by (<samples> - 1).\n");
+    printf("                                  Samples are counted after decimation.\n");
+    printf("                                  Default: 0 (off)\n");
     printf("  -F, --rx-filter <filename>    Use the specified filter. This may be\n");
     printf("                                  the full path or just name for filter files\n");
     printf("                                  in the OOKiedokie search path.\n");
@@ -159,6 +204,42 @@ static void usage(const char *argv0)
     printf("                                  rather than filtered samples.\n");
     printf("  --rx-fmt <fmt>                Configures how RX'd messages are formatted.\n");
     printf("                                  Options are: \"csv\" and \"pretty\" (default)\n");
+    printf("  --rx-fixed-point              Filter raw SC16Q11 samples using fixed point\n");
+    printf("                                  arithmetic, converting to floating point\n");
+    printf("                                  only after decimation.\n");
+    printf("  --rx-filter-plan              Print the RX filter's stages and the\n");
+    printf("                                  estimated real multiplies they require\n");
+    printf("                                  at the configured sample rate, then exit.\n");
+    printf("  --rx-filter-threads <n>       Run the RX filter's stages on up to <n>\n");
+    printf("                                  worker threads, in addition to the\n");
+    printf("                                  receiving thread. Default: 0\n");
+    printf("  --rx-filter-cpus <list>       Comma-separated list of CPUs to pin the\n");
+    printf("                                  RX filter's worker threads to.\n");
+    printf("  --rx-decode-threads <n>       When receiving for multiple devices, decode\n");
+    printf("                                  on up to <n> worker threads, in addition\n");
+    printf("                                  to the receiving thread. Default: 0\n");
+    printf("  --rx-no-dispatch              Pass every pulse to every device, rather\n");
+    printf("                                  than waking idle devices only for pulses\n");
+    printf("                                  matching their preamble.\n");
+    printf("  --rx-hypotheses <n>           Decode up to <n> concurrent hypotheses of\n");
+    printf("                                  where a message begins, to recover\n");
+    printf("                                  messages overlapping others. Default: 1\n");
+    printf("  --rx-state <file>             Resume decoding from the state saved in\n");
+    printf("                                  <file>, if it exists, and save the\n");
+    printf("                                  decoders' state to it upon exiting.\n");
+    printf("  --rx-dedup <samples>          Report repeats of a message received within\n");
+    printf("                                  <samples> of each other once, with a\n");
+    printf("                                  repeat count and the sample numbers of\n");
+    printf("                                  the first and last repeats. Samples are\n");
+    printf("                                  counted after decimation. Default: 0 (off)\n");
+    printf("  --rx-squelch <level>          Skip filtering and decoding of buffers\n");
+    printf("                                  whose peak I or Q magnitude is below\n");
+    printf("                                  <level>, from 0.0 to 1.0. This should be\n");
+    printf("                                  above the noise floor and below the\n");
+    printf("                                  weakest signal. Default: 0 (off)\n");
+    printf("  --rx-sm-interpret             Evaluate the device's state machine triggers\n");
+    printf("                                  one by one, rather than via its compiled\n");
+    printf("                                  transition table. Intended for debugging.\n");
     printf("\n");
     printf("SDR configuration options:\n");
     printf("  -A, --sdr-args <args>         SDR-specific arguments.\n");
@@ -244,14 +325,15 @@ static int get_rx_recorder(struct ookiedokie_cfg *cfg, char *arg)
 static int validate_cfg(struct ookiedokie_cfg *cfg)
 {
     int status = 0;
-    const bool have_device      = (cfg->device != NULL);
+    const bool have_device      = (cfg->num_devices != 0);
     const bool have_rx_filter   = (cfg->rx_filter != NULL);
     const bool have_rx_rec      = (cfg->rx_rec_filename != NULL);
     const bool have_rx_dig      = (cfg->rx_rec_dig != NULL);
 
     switch (cfg->direction) {
         case DIRECTION_RX:
-            if (!cfg->device && !have_rx_rec && !have_rx_dig) {
+            if (!have_device && !have_rx_rec && !have_rx_dig &&
+                !cfg->rx_filter_plan) {
                 fprintf(stderr, "Error: Either a target device or "
                                 "recording parameters must be specified.\n");
                 return -1;
@@ -263,6 +345,9 @@ static int validate_cfg(struct ookiedokie_cfg *cfg)
             if (!have_device) {
                 status = -1;
                 fprintf(stderr, "Error: A target device must be specified.\n");
+            } else if (cfg->num_devices > 1) {
+                status = -1;
+                fprintf(stderr, "Error: Only one device may be specified with --tx.\n");
             } else if (have_rx_rec) {
                 status = -1;
                 fprintf(stderr, "Error: --rx-rec cannot be specified with --tx\n");
@@ -336,18 +421,24 @@ static int process_cmdline(int argc, char *argv[], struct ookiedokie_cfg *cfg)
 
                 break;
 
-            case OPTION_DEVICE:
-                if (cfg->device) {
-                    fprintf(stderr, "Error: device already specified.\n");
+            case OPTION_DEVICE: {
+                char **tmp = realloc(cfg->devices, (cfg->num_devices + 1) *
+                                                   sizeof(cfg->devices[0]));
+                if (!tmp) {
+                    perror("realloc");
                     return CMDLINE_ERROR;
-                } else {
-                    cfg->device = strdup(optarg);
-                    if (!cfg->device) {
-                        perror("strdup");
-                        return CMDLINE_ERROR;
-                    }
                 }
+
+                cfg->devices = tmp;
+                cfg->devices[cfg->num_devices] = strdup(optarg);
+                if (!cfg->devices[cfg->num_devices]) {
+                    perror("strdup");
+                    return CMDLINE_ERROR;
+                }
+
+                cfg->num_devices++;
                 break;
+            }
 
             case OPTION_TX_DELAY_US:
                 cfg->tx_delay_us = str2uint(optarg, 0, UINT_MAX, &ok);
@@ -407,6 +498,111 @@ static int process_cmdline(int argc, char *argv[], struct ookiedokie_cfg *cfg)
                 cfg->rx_rec_input = true;
                 break;
 
+            case OPTION_RX_FIXED_POINT:
+                cfg->rx_fixed_point = true;
+                break;
+
+            case OPTION_RX_FILTER_PLAN:
+                cfg->rx_filter_plan = true;
+                break;
+
+            case OPTION_RX_SM_INTERPRET:
+                cfg->rx_sm_interpret = true;
+                break;
+
+            case OPTION_RX_DECODE_THREADS:
+                cfg->rx_decode_threads = str2uint(optarg, 0, UINT_MAX, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX decoder thread count: %s\n",
+                            optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_NO_DISPATCH:
+                cfg->rx_dispatch = false;
+                break;
+
+            case OPTION_RX_HYPOTHESES:
+                cfg->rx_hypotheses = str2uint(optarg, 1, UINT_MAX, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX hypothesis count: %s\n",
+                            optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_FILTER_THREADS:
+                cfg->rx_filter_threads = str2uint(optarg, 0, UINT_MAX, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX filter thread count: %s\n",
+                            optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_DEDUP:
+                cfg->rx_dedup_window = str2uint(optarg, 0, UINT_MAX, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX dedup window: %s\n", optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_ADAPTIVE:
+                cfg->rx_adaptive = true;
+                break;
+
+            case OPTION_RX_HYSTERESIS:
+                cfg->rx_hysteresis = (float) str2double(optarg, 0.0f, 1.0f, &ok);
+                if (!ok || cfg->rx_hysteresis == 0.0f) {
+                    fprintf(stderr, "Invalid RX hysteresis: %s\n", optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_MIN_WIDTH:
+                cfg->rx_min_width = str2uint(optarg, 0, UINT_MAX, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX minimum width: %s\n", optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_SQUELCH:
+                cfg->rx_squelch = (float) str2double(optarg, 0.0f, 1.0f, &ok);
+                if (!ok) {
+                    fprintf(stderr, "Invalid RX squelch level: %s\n", optarg);
+                    return CMDLINE_ERROR;
+                }
+                break;
+
+            case OPTION_RX_STATE:
+                if (cfg->rx_state != NULL) {
+                    fprintf(stderr, "Error: RX state file already specified.\n");
+                    return CMDLINE_ERROR;
+                } else {
+                    cfg->rx_state = strdup(optarg);
+                    if (!cfg->rx_state) {
+                        perror("strdup");
+                        return CMDLINE_ERROR;
+                    }
+                }
+                break;
+
+            case OPTION_RX_FILTER_CPUS:
+                if (cfg->rx_filter_cpus != NULL) {
+                    fprintf(stderr, "Error: RX filter CPUs already specified.\n");
+                    return CMDLINE_ERROR;
+                } else {
+                    cfg->rx_filter_cpus = strdup(optarg);
+                    if (!cfg->rx_filter_cpus) {
+                        perror("strdup");
+                        return CMDLINE_ERROR;
+                    }
+                }
+                break;
+
             case OPTION_RX_FILTER:
                 if (cfg->rx_filter != NULL) {
                     fprintf(stderr, "Error: RX filter already specified.\n");
@@ -567,12 +763,170 @@ static int process_cmdline(int argc, char *argv[], struct ookiedokie_cfg *cfg)
     return 0;
 }
 
+/* Run the filter's stages on cfg->rx_filter_threads worker threads, pinned
+ * to the CPUs in the cfg->rx_filter_cpus list. Threads beyond the end of
+ * the list are left unpinned. */
+static bool enable_filter_threads(struct fir_filter *filter,
+                                  const struct ookiedokie_cfg *cfg)
+{
+    char *list = NULL;
+    char *tok, *saveptr;
+    int *cpus = NULL;
+    unsigned int i;
+    bool ok = true;
+
+    if (cfg->rx_filter_cpus) {
+        cpus = malloc(cfg->rx_filter_threads * sizeof(cpus[0]));
+        list = strdup(cfg->rx_filter_cpus);
+        if (!cpus || !list) {
+            perror("malloc");
+            ok = false;
+            goto out;
+        }
+
+        for (i = 0; i < cfg->rx_filter_threads; i++) {
+            cpus[i] = -1;
+        }
+
+        tok = strtok_r(list, ",", &saveptr);
+        for (i = 0; tok != NULL; i++) {
+            int cpu = str2int(tok, 0, INT_MAX, &ok);
+            if (!ok) {
+                log_error("Invalid RX filter CPU: %s\n", tok);
+                goto out;
+            }
+
+            if (i < cfg->rx_filter_threads) {
+                cpus[i] = cpu;
+            } else {
+                log_warning("Ignoring RX filter CPU %d, as there are only "
+                            "%u worker threads.\n", cpu,
+                            cfg->rx_filter_threads);
+            }
+
+            tok = strtok_r(NULL, ",", &saveptr);
+        }
+    }
+
+    ok = fir_enable_pipeline(filter, cfg->rx_filter_threads, cpus, 0);
+
+out:
+    free(list);
+    free(cpus);
+    return ok;
+}
+
+/* Restore each device's decoder state from the snapshots in `filename`, as
+ * written by save_rx_state(). A missing file is not an error. */
+static bool load_rx_state(const char *filename, struct device **devs,
+                          unsigned int num_devices)
+{
+    FILE *f;
+    uint8_t *buf = NULL;
+    size_t len = 0, off = 0, n;
+    long size;
+    unsigned int i;
+    bool ok = false;
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        if (errno == ENOENT) {
+            log_debug("No RX state file; decoding from the start.\n");
+            return true;
+        }
+
+        log_error("Failed to open %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0) {
+        log_error("Failed to determine size of %s.\n", filename);
+        goto out;
+    }
+
+    len = (size_t) size;
+    buf = malloc(len + 1);
+    if (!buf) {
+        perror("malloc");
+        goto out;
+    }
+
+    if (fread(buf, 1, len, f) != len) {
+        log_error("Failed to read %s.\n", filename);
+        goto out;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        n = device_restore(devs[i], buf + off, len - off);
+        if (n == 0) {
+            log_error("Failed to restore %s decoder state from %s.\n",
+                      device_name(devs[i]), filename);
+            goto out;
+        }
+
+        off += n;
+    }
+
+    ok = true;
+
+out:
+    free(buf);
+    fclose(f);
+    return ok;
+}
+
+/* Save a snapshot of each device's decoder state to `filename` */
+static bool save_rx_state(const char *filename, struct device **devs,
+                          unsigned int num_devices)
+{
+    FILE *f;
+    uint8_t *buf;
+    size_t n;
+    unsigned int i;
+    bool ok = false;
+
+    f = fopen(filename, "wb");
+    if (!f) {
+        log_error("Failed to open %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        buf = malloc(device_snapshot_size(devs[i]));
+        if (!buf) {
+            perror("malloc");
+            goto out;
+        }
+
+        n = device_snapshot(devs[i], buf, device_snapshot_size(devs[i]));
+        if (n == 0 || fwrite(buf, 1, n, f) != n) {
+            log_error("Failed to save %s decoder state to %s.\n",
+                      device_name(devs[i]), filename);
+            free(buf);
+            goto out;
+        }
+
+        free(buf);
+    }
+
+    ok = true;
+
+out:
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+
+    return ok;
+}
+
 int main(int argc, char *argv[])
 {
     int status;
     struct sdr *sdr = NULL;
     struct sdr *rx_recorder = NULL;
-    struct device *dev = NULL;
+    struct device **devs = NULL;
+    unsigned int i;
     struct fir_filter *filter = NULL;
     struct ookiedokie_cfg cfg;
 
@@ -670,8 +1024,42 @@ int main(int argc, char *argv[])
         cfg.rx_rec_input = true;
     }
 
-    /* Load the state machine for the target device */
-    if (cfg.device) {
+    if (cfg.rx_fixed_point) {
+        if (filter == NULL) {
+            log_warning("--rx-fixed-point has no effect without a filter.\n");
+            cfg.rx_fixed_point = false;
+        } else if (!fir_enable_fixed_point(filter)) {
+            log_warning("Filter does not support fixed point operation. "
+                        "Using floating point.\n");
+            cfg.rx_fixed_point = false;
+        }
+    }
+
+    if (cfg.rx_filter_threads > 0) {
+        if (filter == NULL) {
+            log_warning("--rx-filter-threads has no effect without a filter.\n");
+        } else if (!enable_filter_threads(filter, &cfg)) {
+            status = EXIT_FAILURE;
+            goto out;
+        }
+    } else if (cfg.rx_filter_cpus) {
+        log_warning("--rx-filter-cpus has no effect without "
+                    "--rx-filter-threads.\n");
+    }
+
+    if (cfg.rx_filter_plan) {
+        if (filter) {
+            fir_print_plan(filter, stdout, cfg.samplerate);
+        } else {
+            log_warning("--rx-filter-plan has no effect without a filter.\n");
+        }
+
+        status = 0;
+        goto out;
+    }
+
+    /* Load the state machines for the target devices */
+    if (cfg.num_devices != 0) {
         unsigned int decimation;
 
         if (filter) {
@@ -680,21 +1068,52 @@ int main(int argc, char *argv[])
             decimation = 1;
         }
 
-        dev = device_init(cfg.device, cfg.samplerate / decimation);
-        if (!dev) {
+        devs = calloc(cfg.num_devices, sizeof(devs[0]));
+        if (!devs) {
+            perror("calloc");
             status = EXIT_FAILURE;
             goto out;
         }
+
+        for (i = 0; i < cfg.num_devices; i++) {
+            devs[i] = device_init(cfg.devices[i], cfg.samplerate / decimation);
+            if (!devs[i]) {
+                status = EXIT_FAILURE;
+                goto out;
+            }
+
+            if (cfg.rx_sm_interpret) {
+                device_use_sm_table(devs[i], false);
+            }
+
+            if (!device_set_hypotheses(devs[i], cfg.rx_hypotheses) ||
+                !device_set_dedup(devs[i], cfg.rx_dedup_window)) {
+                status = EXIT_FAILURE;
+                goto out;
+            }
+        }
     }
 
     switch (cfg.direction) {
         case DIRECTION_RX: {
-            status = ookiedokie_rx(sdr, filter, dev, rx_recorder, &cfg);
+            if (cfg.rx_state &&
+                !load_rx_state(cfg.rx_state, devs, cfg.num_devices)) {
+                status = EXIT_FAILURE;
+                goto out;
+            }
+
+            status = ookiedokie_rx(sdr, filter, devs, cfg.num_devices,
+                                   rx_recorder, &cfg);
+
+            if (status == 0 && cfg.rx_state &&
+                !save_rx_state(cfg.rx_state, devs, cfg.num_devices)) {
+                status = -1;
+            }
             break;
         }
 
         case DIRECTION_TX:
-            status = ookiedokie_tx(sdr, dev, &cfg);
+            status = ookiedokie_tx(sdr, devs[0], &cfg);
             break;
 
         default:
@@ -708,7 +1127,14 @@ int main(int argc, char *argv[])
     }
 
 out:
-    device_deinit(dev);
+    if (devs) {
+        for (i = 0; i < cfg.num_devices; i++) {
+            device_deinit(devs[i]);
+        }
+
+        free(devs);
+    }
+
     sdr_deinit(sdr);
     sdr_deinit(rx_recorder);
     ookiedokie_cfg_deinit(&cfg);
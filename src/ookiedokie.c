@@ -32,18 +32,60 @@
 #include "fir.h"
 #include "ookiedokie.h"
 #include "complexf.h"
+#include "sc16q11.h"
+#include "threshold.h"
+#include "decode_pool.h"
 #include "keyval_list.h"
 
 struct rx {
-    struct complexf *samples;
-    struct complexf *post_filter;
+    struct fir_filter *filter;
+    enum fir_envelope envelope;
+    struct sdr *recorder;
+    const struct ookiedokie_cfg *cfg;
+
+    struct complexf_planar samples;
+    int16_t *samples_sc16q11;   /* Raw samples, when filtering in fixed point */
+    struct complexf_planar post_filter;
+    struct complexf *to_record; /* Interleaved samples for the recorder */
+
+    /* Blocks whose peak is below the squelch level are neither filtered nor
+     * thresholded, unless they neighbour a block above it. A quiet block is
+     * held back until the next block is read, so that it may be filtered
+     * ahead of a block that turns out to be active. */
+    struct {
+        bool enabled;
+        float level;
+        unsigned int level_sc16q11;
+        struct complexf_planar samples;     /* Held block */
+        int16_t *samples_sc16q11;
+        bool held;              /* A quiet block is held in the above */
+        bool gap;               /* Blocks were skipped since the last one
+                                 * that was filtered */
+        bool prev_active;       /* The last block was above the level */
+        unsigned int decimation;
+        unsigned int phase;     /* Input samples toward the next output */
+        struct complexf_planar zeros;       /* Realigns the filter's phase */
+        int16_t *zeros_sc16q11;
+        uint64_t num_blocks;
+        uint64_t num_skipped;
+    } squelch;
 
     struct {
         FILE *out;
-        bool *samples;
+        struct threshold_slicer *slicer;    /* NULL for a fixed threshold */
+        uint64_t *samples;          /* Bit-packed; see threshold.h */
+        struct dig_run *runs;
         uint64_t sample_no;
         int8_t prev;
     } dig;
+
+    struct {
+        struct device **devices;
+        unsigned int count;
+        struct decode_pool *pool;
+        const struct keyval_list **values;  /* Per-device output */
+        bool *first_print;                  /* Per-device CSV heading state */
+    } dec;
 };
 
 struct tx {
@@ -76,20 +118,34 @@ static void rx_deinit(struct rx *rx)
             fclose(rx->dig.out);
         }
 
-        free(rx->samples);
+        complexf_planar_free(&rx->samples);
+        free(rx->samples_sc16q11);
+        complexf_planar_free(&rx->squelch.samples);
+        free(rx->squelch.samples_sc16q11);
+        complexf_planar_free(&rx->squelch.zeros);
+        free(rx->squelch.zeros_sc16q11);
+        threshold_slicer_deinit(rx->dig.slicer);
         free(rx->dig.samples);
-        free(rx->post_filter);
+        free(rx->dig.runs);
+        complexf_planar_free(&rx->post_filter);
+        free(rx->to_record);
+        decode_pool_deinit(rx->dec.pool);
+        free(rx->dec.values);
+        free(rx->dec.first_print);
         free(rx);
     }
 }
 
 static struct rx * rx_init(struct sdr *sdr,
                            struct fir_filter *filter,
-                           struct device *device,
+                           struct device **devices,
+                           unsigned int num_devices,
+                           struct sdr *recorder,
                            const struct ookiedokie_cfg *cfg)
 {
     int status = -1;
     struct rx *rx;
+    unsigned int i;
     const unsigned int num_samples = cfg->samples_per_buffer;
 
     rx = calloc(1, sizeof(rx[0]));
@@ -98,6 +154,11 @@ static struct rx * rx_init(struct sdr *sdr,
         return NULL;
     }
 
+    rx->filter = filter;
+    rx->envelope = filter ? fir_get_envelope(filter) : FIR_ENVELOPE_NONE;
+    rx->recorder = recorder;
+    rx->cfg = cfg;
+
     if (cfg->rx_rec_dig) {
         rx->dig.out = fopen(cfg->rx_rec_dig, "w");
         if (!rx->dig.out) {
@@ -111,24 +172,124 @@ static struct rx * rx_init(struct sdr *sdr,
     rx->dig.sample_no = 0;
     rx->dig.prev = false;
 
-    rx->samples = malloc(num_samples * sizeof(rx->samples[0]));
-    if (!rx->samples) {
+    if (cfg->rx_fixed_point) {
+        rx->samples_sc16q11 = malloc(2 * num_samples *
+                                     sizeof(rx->samples_sc16q11[0]));
+        if (!rx->samples_sc16q11) {
+            perror("malloc");
+            goto out;
+        }
+    } else if (!complexf_planar_alloc(&rx->samples, num_samples)) {
         perror("malloc");
         goto out;
     }
 
-    rx->post_filter = malloc(num_samples * sizeof(rx->post_filter[0]));
-    if (!rx->post_filter) {
+    if (cfg->rx_squelch > 0.0f) {
+        rx->squelch.enabled = true;
+        rx->squelch.level = cfg->rx_squelch;
+        rx->squelch.level_sc16q11 = (unsigned int) (cfg->rx_squelch * 2048.0f);
+        rx->squelch.decimation = filter ? fir_get_total_decimation(filter) : 1;
+
+        if (rx->squelch.decimation == 0) {
+            log_error("Failed to get filter decimation.\n");
+            goto out;
+        }
+
+        if (cfg->rx_fixed_point) {
+            rx->squelch.samples_sc16q11 =
+                malloc(2 * num_samples * sizeof(rx->samples_sc16q11[0]));
+
+            rx->squelch.zeros_sc16q11 =
+                calloc(2 * rx->squelch.decimation,
+                       sizeof(rx->squelch.zeros_sc16q11[0]));
+
+            if (!rx->squelch.samples_sc16q11 || !rx->squelch.zeros_sc16q11) {
+                perror("malloc");
+                goto out;
+            }
+        } else {
+            const size_t n = rx->squelch.decimation;
+
+            if (!complexf_planar_alloc(&rx->squelch.samples, num_samples) ||
+                !complexf_planar_alloc(&rx->squelch.zeros, n)) {
+                perror("malloc");
+                goto out;
+            }
+
+            memset(rx->squelch.zeros.real, 0, n * sizeof(float));
+            memset(rx->squelch.zeros.imag, 0, n * sizeof(float));
+        }
+    }
+
+    if (!complexf_planar_alloc(&rx->post_filter, num_samples)) {
         perror("malloc");
         goto out;
     }
 
-    rx->dig.samples = malloc(num_samples * sizeof(rx->dig.samples[0]));
+    rx->to_record = malloc(num_samples * sizeof(rx->to_record[0]));
+    if (!rx->to_record) {
+        perror("malloc");
+        goto out;
+    }
+
+    rx->dig.samples = malloc(dig_words(num_samples) *
+                             sizeof(rx->dig.samples[0]));
     if (!rx->dig.samples) {
         perror("malloc");
         goto out;
     }
 
+    rx->dig.runs = malloc(num_samples * sizeof(rx->dig.runs[0]));
+    if (!rx->dig.runs) {
+        perror("malloc");
+        goto out;
+    }
+
+    if (cfg->rx_adaptive || cfg->rx_hysteresis < 1.0f ||
+        cfg->rx_min_width > 1) {
+        struct threshold_params params;
+
+        params.level = cfg->rx_threshold;
+        params.hysteresis = cfg->rx_hysteresis;
+        params.min_width = cfg->rx_min_width;
+        params.adaptive = cfg->rx_adaptive;
+
+        /* See threshold() regarding the quantity compared */
+        rx->dig.slicer = threshold_slicer_init(&params,
+                              rx->envelope == FIR_ENVELOPE_NONE ?
+                                    THRESHOLD_POWER : THRESHOLD_REAL,
+                              rx->envelope != FIR_ENVELOPE_MAGNITUDE,
+                              num_samples);
+        if (!rx->dig.slicer) {
+            goto out;
+        }
+    }
+
+    if (num_devices != 0) {
+        rx->dec.devices = devices;
+        rx->dec.count = num_devices;
+
+        rx->dec.values = calloc(num_devices, sizeof(rx->dec.values[0]));
+        rx->dec.first_print = malloc(num_devices *
+                                     sizeof(rx->dec.first_print[0]));
+
+        if (!rx->dec.values || !rx->dec.first_print) {
+            perror("malloc");
+            goto out;
+        }
+
+        for (i = 0; i < num_devices; i++) {
+            rx->dec.first_print[i] = true;
+        }
+
+        rx->dec.pool = decode_pool_init(devices, num_devices,
+                                        cfg->rx_decode_threads,
+                                        cfg->rx_dispatch);
+        if (!rx->dec.pool) {
+            goto out;
+        }
+    }
+
 
     init_signal_handling();
 
@@ -143,42 +304,82 @@ out:
     return rx;
 }
 
+/* Record the digital samples at which the thresholded signal changes. Each
+ * transition is found by comparing every sample with its predecessor, a
+ * word at a time. */
 static void record_dig(struct rx *rx, unsigned int count)
 {
-    unsigned int i;
+    size_t w, i;
+    const uint64_t *dig = rx->dig.samples;
 
     if (rx->dig.sample_no == 0) {
-        rx->dig.prev = rx->dig.samples[0];
-        fprintf(rx->dig.out, "0, %c\n", rx->dig.samples[0] ? '1' : '0');
+        rx->dig.prev = dig[0] & 1;
+        fprintf(rx->dig.out, "0, %c\n", rx->dig.prev ? '1' : '0');
     }
 
-    for (i = 0; i < count; i++) {
-        const bool curr = rx->dig.samples[i];
-        const bool update = (curr != rx->dig.prev);
+    for (w = 0; w < dig_words(count); w++) {
+        const size_t start = w * DIG_WORD_BITS;
+        const size_t n = (count - start) < DIG_WORD_BITS ?
+                         (count - start) : DIG_WORD_BITS;
+        const uint64_t valid = (n == DIG_WORD_BITS) ? UINT64_MAX :
+                               (((uint64_t) 1 << n) - 1);
+        const uint64_t prev = (dig[w] << 1) | (uint64_t) rx->dig.prev;
+        uint64_t edges = (dig[w] ^ prev) & valid;
 
-        if (update) {
+        while (edges != 0) {
+            const unsigned int bit = __builtin_ctzll(edges);
+            const bool curr = (dig[w] >> bit) & 1;
+
+            i = start + bit;
             fprintf(rx->dig.out, "%"PRIu64", %c\n%"PRIu64", %c\n",
-                    rx->dig.sample_no + i - 1, rx->dig.prev   ? '1' : '0',
-                    rx->dig.sample_no + i, rx->dig.samples[i] ? '1' : '0');
+                    rx->dig.sample_no + i - 1, curr ? '0' : '1',
+                    rx->dig.sample_no + i,     curr ? '1' : '0');
 
-            rx->dig.prev = curr;
+            edges &= edges - 1;
         }
+
+        rx->dig.prev = (dig[w] >> (n - 1)) & 1;
     }
 
     rx->dig.sample_no += count;
 }
 
+/* Compare the magnitude of samples against the threshold, or pass them to
+ * the slicer if hysteresis or an adaptive level is used. The filter may have
+ * already performed envelope detection. */
 static inline void threshold(struct rx *rx, float threshold,
-                             struct complexf *input, unsigned int count)
+                             enum fir_envelope envelope,
+                             const struct complexf_planar *input,
+                             unsigned int count)
 {
-    unsigned int i;
+    if (rx->dig.slicer) {
+        threshold_slicer_process(rx->dig.slicer, input, count,
+                                 rx->dig.samples);
+        return;
+    }
+
+    switch (envelope) {
+        case FIR_ENVELOPE_MAGNITUDE:
+            threshold_to_dig(input, count, threshold, THRESHOLD_REAL,
+                             rx->dig.samples);
+            break;
 
-    for (i = 0; i < count; i++) {
-        rx->dig.samples[i] = complexf_magnitude(&input[i]) >= threshold;
+        case FIR_ENVELOPE_POWER:
+            threshold_to_dig(input, count, threshold * threshold,
+                             THRESHOLD_REAL, rx->dig.samples);
+            break;
+
+        default:
+            threshold_to_dig(input, count, threshold * threshold,
+                             THRESHOLD_POWER, rx->dig.samples);
     }
 }
 
-static void rx_print(enum ookiedokie_rx_fmt fmt, bool *first_print,
+/* Print a device's decoded message. If `device` is not NULL, the message is
+ * tagged with the device name, which is used to distinguish the output of
+ * multiple devices. */
+static void rx_print(enum ookiedokie_rx_fmt fmt, const char *device,
+                     bool *first_print,
                      const struct keyval_list *kv_list, size_t len)
 {
     size_t i;
@@ -188,6 +389,10 @@ static void rx_print(enum ookiedokie_rx_fmt fmt, bool *first_print,
 
             /* Print the field headings on the first print */
             if (*first_print) {
+                if (device) {
+                    printf("Device,");
+                }
+
                 for (i = 0; i < len; i++) {
                     const struct keyval *kv = keyval_list_at(kv_list, i);
                     const char sep = (i < (len - 1)) ? ',' : '\n';
@@ -198,6 +403,10 @@ static void rx_print(enum ookiedokie_rx_fmt fmt, bool *first_print,
             }
 
             /* Print the values on the rest */
+            if (device) {
+                printf("%s,", device);
+            }
+
             for (i = 0; i < len; i++) {
                 const struct keyval *kv = keyval_list_at(kv_list, i);
                 const char sep = (i < (len - 1)) ? ',' : '\n';
@@ -206,6 +415,10 @@ static void rx_print(enum ookiedokie_rx_fmt fmt, bool *first_print,
             break;
 
         case RX_FMT_PRETTY:
+            if (device) {
+                printf("%20s : %s\n", "Device", device);
+            }
+
             for (i = 0; i < len; i++) {
                 const struct keyval *kv = keyval_list_at(kv_list, i);
                 printf("%20s : %s\n", kv->key, kv->value);
@@ -219,74 +432,309 @@ static void rx_print(enum ookiedokie_rx_fmt fmt, bool *first_print,
     }
 }
 
-int ookiedokie_rx(struct sdr *sdr, struct fir_filter *filter,
-                  struct device *device, struct sdr *recorder,
-                  const struct ookiedokie_cfg *cfg)
+/* Pass a block of thresholded samples to the decoders, and print any
+ * messages they produce */
+static int decode(struct rx *rx, size_t num_runs)
 {
-    int status = -1;
-    struct rx *rx;
-    const struct keyval_list *values;
+    unsigned int i;
+    const unsigned int num_devices = rx->dec.count;
+
+    if (!decode_pool_process(rx->dec.pool, rx->dig.runs, num_runs,
+                             rx->dec.values)) {
+        return -1;
+    }
+
+    /* Only tag messages with the device name if it's ambiguous */
+    for (i = 0; i < num_devices; i++) {
+        const size_t num_values = keyval_list_size(rx->dec.values[i]);
+        const char *name = (num_devices > 1) ?
+                                device_name(rx->dec.devices[i]) : NULL;
+
+        if (num_values != 0) {
+            rx_print(rx->cfg->rx_fmt, name, &rx->dec.first_print[i],
+                     rx->dec.values[i], num_values);
+        }
+    }
+
+    return 0;
+}
+
+/* Record a block of raw samples. Exactly one of `samples_sc16q11` and
+ * `samples` is used, depending upon whether filtering is fixed point. */
+static int record_input(struct rx *rx, const int16_t *samples_sc16q11,
+                        const struct complexf_planar *samples)
+{
+    const unsigned int num_samples = rx->cfg->samples_per_buffer;
+
+    if (!rx->recorder || !rx->cfg->rx_rec_input) {
+        return 0;
+    }
+
+    /* The recorder accepts only interleaved floating point samples */
+    if (samples_sc16q11) {
+        sc16q11_to_complexf(samples_sc16q11, rx->to_record, num_samples);
+    } else {
+        complexf_interleave(samples, rx->to_record, num_samples);
+    }
+
+    return sdr_tx(rx->recorder, rx->to_record, num_samples);
+}
+
+/* Filter, threshold and decode a block of raw samples */
+static int process_block(struct rx *rx, const int16_t *samples_sc16q11,
+                         const struct complexf_planar *samples)
+{
+    int status;
+    size_t count;
+    const struct complexf_planar *to_threshold;
+    const struct ookiedokie_cfg *cfg = rx->cfg;
     const unsigned int num_samples = cfg->samples_per_buffer;
-    bool first_print = true;
+    const unsigned int num_devices = rx->dec.count;
 
-    rx = rx_init(sdr, filter, device, cfg);
-    if (!rx) {
-        log_error("Failed to initialize RX state.\n");
-        goto out;
+    status = record_input(rx, samples_sc16q11, samples);
+    if (status != 0) {
+        return status;
     }
 
-    while (g_running) {
-        unsigned int i;
-        size_t count;
-        struct complexf *to_threshold;
+    if (samples_sc16q11) {
+        to_threshold = &rx->post_filter;
+        count = fir_filter_and_decimate_sc16q11_planar(rx->filter,
+                                                       samples_sc16q11,
+                                                       num_samples,
+                                                       &rx->post_filter);
+    } else if (rx->filter) {
+        to_threshold = &rx->post_filter;
+        count = fir_filter_and_decimate_planar(rx->filter, samples,
+                                               num_samples,
+                                               &rx->post_filter);
+
+    } else {
+        to_threshold = samples;
+        count = num_samples;
+    }
 
-        status = sdr_rx(sdr, rx->samples, num_samples);
+    if (rx->squelch.enabled) {
+        rx->squelch.phase = (rx->squelch.phase + num_samples) %
+                            rx->squelch.decimation;
+    }
+
+    if (rx->recorder && !cfg->rx_rec_input) {
+        complexf_interleave(to_threshold, rx->to_record, count);
+
+        status = sdr_tx(rx->recorder, rx->to_record, count);
         if (status != 0) {
-            goto out;
+            return status;
         }
+    }
 
-        if (recorder && cfg->rx_rec_input) {
-            status = sdr_tx(recorder, rx->samples, num_samples);
-            if (status != 0) {
-                goto out;
-            }
+    if (num_devices != 0 || rx->dig.out) {
+        threshold(rx, cfg->rx_threshold, rx->envelope, to_threshold, count);
+    }
+
+    if (rx->dig.out) {
+        record_dig(rx, count);
+    }
+
+    if (num_devices != 0) {
+        status = decode(rx, dig_to_runs(rx->dig.samples, count, rx->dig.runs));
+    }
+
+    return status;
+}
+
+/* Account for a block below the squelch level without filtering it. The
+ * filter output is taken to be zero, which is below any threshold, so the
+ * decoders see a single low run spanning the block. */
+static int skip_block(struct rx *rx, const int16_t *samples_sc16q11,
+                      const struct complexf_planar *samples)
+{
+    int status;
+    size_t count;
+    const struct ookiedokie_cfg *cfg = rx->cfg;
+    const unsigned int num_samples = cfg->samples_per_buffer;
+
+    status = record_input(rx, samples_sc16q11, samples);
+    if (status != 0) {
+        return status;
+    }
+
+    count = (rx->squelch.phase + num_samples) / rx->squelch.decimation;
+    rx->squelch.phase = (rx->squelch.phase + num_samples) %
+                        rx->squelch.decimation;
+
+    rx->squelch.num_skipped++;
+
+    if (rx->recorder && !cfg->rx_rec_input) {
+        memset(rx->to_record, 0, count * sizeof(rx->to_record[0]));
+
+        status = sdr_tx(rx->recorder, rx->to_record, count);
+        if (status != 0) {
+            return status;
         }
+    }
 
-        if (filter) {
-            to_threshold = rx->post_filter;
-            count = fir_filter_and_decimate(filter, rx->samples, num_samples,
-                                            rx->post_filter);
+    /* A slicer may hold its output high into the block, if debouncing */
+    if (rx->dig.slicer) {
+        threshold_slicer_zeros(rx->dig.slicer, count, rx->dig.samples);
 
-        } else {
-            to_threshold = rx->samples;
-            count = num_samples;
+        if (rx->dig.out) {
+            record_dig(rx, count);
         }
 
-        if (recorder && !cfg->rx_rec_input) {
-            status = sdr_tx(recorder, rx->post_filter, count);
+        if (rx->dec.count != 0) {
+            status = decode(rx, dig_to_runs(rx->dig.samples, count,
+                                            rx->dig.runs));
+        }
+
+        return status;
+    }
+
+    if (rx->dig.out) {
+        memset(rx->dig.samples, 0,
+               dig_words(count) * sizeof(rx->dig.samples[0]));
+        record_dig(rx, count);
+    }
+
+    if (rx->dec.count != 0 && count != 0) {
+        rx->dig.runs[0].length = count;
+        rx->dig.runs[0].level = false;
+        status = decode(rx, 1);
+    }
+
+    return status;
+}
+
+/* Determine whether the block just read reaches the squelch level */
+static bool above_squelch(const struct rx *rx)
+{
+    const unsigned int num_samples = rx->cfg->samples_per_buffer;
+
+    if (rx->samples_sc16q11) {
+        return sc16q11_peak(rx->samples_sc16q11, num_samples) >=
+               rx->squelch.level_sc16q11;
+    } else {
+        return complexf_planar_peak(&rx->samples, num_samples) >=
+               rx->squelch.level;
+    }
+}
+
+/* Exchange the block just read with the held block */
+static void swap_held(struct rx *rx)
+{
+    int16_t *tmp_sc16q11 = rx->samples_sc16q11;
+    struct complexf_planar tmp = rx->samples;
+
+    rx->samples_sc16q11 = rx->squelch.samples_sc16q11;
+    rx->squelch.samples_sc16q11 = tmp_sc16q11;
+
+    rx->samples = rx->squelch.samples;
+    rx->squelch.samples = tmp;
+}
+
+/* Discard the filter history left from before skipped blocks, as it is not
+ * contiguous with the block to be filtered next. Zeros are then filtered to
+ * restore the decimation phase that filtering the skipped blocks would have
+ * left, so that the position of each output sample is unaffected. */
+static void resume_filter(struct rx *rx)
+{
+    const size_t n = rx->squelch.phase;
+
+    fir_reset(rx->filter);
+
+    if (n == 0) {
+        return;
+    }
+
+    /* No output is produced for fewer than `decimation` samples */
+    if (rx->squelch.zeros_sc16q11) {
+        fir_filter_and_decimate_sc16q11_planar(rx->filter,
+                                               rx->squelch.zeros_sc16q11, n,
+                                               &rx->post_filter);
+    } else {
+        fir_filter_and_decimate_planar(rx->filter, &rx->squelch.zeros, n,
+                                       &rx->post_filter);
+    }
+}
+
+/* Process the block just read, subject to the squelch. Blocks above the
+ * squelch level, and the block following each of them, are filtered. This
+ * allows the tail of a message to clear the filter. A quiet block is held
+ * until the next is read, and filtered ahead of it if that one is active, so
+ * that the filter's history is primed and the leading edge of the message is
+ * not lost. Held blocks that are followed by another quiet block are
+ * skipped. */
+static int squelch_block(struct rx *rx)
+{
+    int status = 0;
+    const bool active = above_squelch(rx);
+
+    rx->squelch.num_blocks++;
+
+    if (active || rx->squelch.prev_active) {
+        if (rx->squelch.held) {
+            if (rx->squelch.gap && rx->filter) {
+                resume_filter(rx);
+            }
+
+            status = process_block(rx, rx->squelch.samples_sc16q11,
+                                   &rx->squelch.samples);
+            rx->squelch.held = false;
             if (status != 0) {
-                goto out;
+                return status;
             }
         }
 
-        if (device || rx->dig.out) {
-            threshold(rx, cfg->rx_threshold, to_threshold, count);
+        status = process_block(rx, rx->samples_sc16q11, &rx->samples);
+        rx->squelch.gap = false;
+    } else {
+        if (rx->squelch.held) {
+            status = skip_block(rx, rx->squelch.samples_sc16q11,
+                                &rx->squelch.samples);
+            rx->squelch.gap = true;
         }
 
-        if (rx->dig.out) {
-            record_dig(rx, count);
+        swap_held(rx);
+        rx->squelch.held = true;
+    }
+
+    rx->squelch.prev_active = active;
+    return status;
+}
+
+int ookiedokie_rx(struct sdr *sdr, struct fir_filter *filter,
+                  struct device **devices, unsigned int num_devices,
+                  struct sdr *recorder, const struct ookiedokie_cfg *cfg)
+{
+    int status = -1;
+    struct rx *rx;
+    const unsigned int num_samples = cfg->samples_per_buffer;
+
+    rx = rx_init(sdr, filter, devices, num_devices, recorder, cfg);
+    if (!rx) {
+        log_error("Failed to initialize RX state.\n");
+        goto out;
+    }
+
+    while (g_running) {
+        if (rx->samples_sc16q11) {
+            status = sdr_rx_sc16q11(sdr, rx->samples_sc16q11, num_samples);
+        } else {
+            status = sdr_rx_planar(sdr, &rx->samples, num_samples);
         }
 
-        if (device) {
-            size_t num_values;
+        if (status != 0) {
+            goto out;
+        }
 
-            values = device_process(device, rx->dig.samples, count);
-            num_values = keyval_list_size(values);
-            if (num_values != 0) {
-                rx_print(cfg->rx_fmt, &first_print, values, num_values);
-            }
+        if (rx->squelch.enabled) {
+            status = squelch_block(rx);
+        } else {
+            status = process_block(rx, rx->samples_sc16q11, &rx->samples);
         }
 
+        if (status != 0) {
+            goto out;
+        }
     }
 
 out:
@@ -294,6 +742,33 @@ out:
         status = 0;
     }
 
+    if (rx && rx->squelch.enabled) {
+        if (status == 0 && rx->squelch.held) {
+            status = skip_block(rx, rx->squelch.samples_sc16q11,
+                                &rx->squelch.samples);
+        }
+
+        log_verbose("Squelch skipped %"PRIu64" of %"PRIu64" blocks.\n",
+                    rx->squelch.num_skipped, rx->squelch.num_blocks);
+    }
+
+    /* Report messages held back to merge their repeats */
+    if (status == 0) {
+        unsigned int i;
+
+        for (i = 0; i < num_devices; i++) {
+            const struct keyval_list *kv = device_flush(devices[i]);
+            const size_t num_values = keyval_list_size(kv);
+            const char *name = (num_devices > 1) ?
+                                    device_name(devices[i]) : NULL;
+
+            if (num_values != 0) {
+                rx_print(cfg->rx_fmt, name, &rx->dec.first_print[i],
+                         kv, num_values);
+            }
+        }
+    }
+
     rx_deinit(rx);
     return status;
 }
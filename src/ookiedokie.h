@@ -36,8 +36,12 @@
  * @param   filter      Decimating FIR filter to apply to samples. If NULL,
  *                      no filtering is performed.
  *
- * @param   device      Device handle used to decode samples. If NULL,
- *                      no decoding occurs.
+ * @param   devices     Handles of the devices to decode samples for. Each
+ *                      device decodes the same filtered and thresholded
+ *                      samples. Messages are tagged with the device name
+ *                      if there are multiple devices.
+ *
+ * @param   num_devices Number of devices. If 0, no decoding occurs.
  *
  * @param   recorder    File-backed "SDR" implementation used to
  *                      record samples. If NULL, no samples are recorded.
@@ -47,8 +51,8 @@
  * @return 0 on success or non-zero on error.
  */
 int ookiedokie_rx(struct sdr *sdr, struct fir_filter *filter,
-                  struct device *device, struct sdr *recorder,
-                  const struct ookiedokie_cfg *cfg);
+                  struct device **devices, unsigned int num_devices,
+                  struct sdr *recorder, const struct ookiedokie_cfg *cfg);
 
 /**
  * Transmit a message for the specified device type
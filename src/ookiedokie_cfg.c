@@ -68,16 +68,31 @@ int ookiedokie_cfg_init(struct ookiedokie_cfg *c)
         return -1;
     }
 
-    /* Target device */
-    c->device = NULL;
+    /* Target devices */
+    c->devices = NULL;
+    c->num_devices = 0;
 
     /* Receive items */
     c->rx_fmt = RX_FMT_INVALID;
     c->rx_threshold = DEFAULT_THRESHOLD;
+    c->rx_adaptive = false;
+    c->rx_hysteresis = 1.0f;
+    c->rx_min_width = 0;
     c->rx_rec_type = NULL;
     c->rx_rec_filename = NULL;
     c->rx_filter = NULL;
     c->rx_rec_input = false;
+    c->rx_fixed_point = false;
+    c->rx_filter_plan = false;
+    c->rx_filter_threads = 0;
+    c->rx_filter_cpus = NULL;
+    c->rx_decode_threads = 0;
+    c->rx_dispatch = true;
+    c->rx_hypotheses = 1;
+    c->rx_dedup_window = 0;
+    c->rx_squelch = 0.0f;
+    c->rx_state = NULL;
+    c->rx_sm_interpret = false;
     c->rx_rec_dig = NULL;
 
     /* Misc */
@@ -88,12 +103,20 @@ int ookiedokie_cfg_init(struct ookiedokie_cfg *c)
 
 void ookiedokie_cfg_deinit(struct ookiedokie_cfg *c)
 {
-    free((void*) c->device);
+    unsigned int i;
+
+    for (i = 0; i < c->num_devices; i++) {
+        free(c->devices[i]);
+    }
+
+    free(c->devices);
     keyval_list_deinit(c->device_params);
     free((void*) c->rx_rec_filename);
     free((void*) c->rx_rec_type);
     free((void*) c->rx_filter);
     free((void*) c->rx_rec_dig);
+    free((void*) c->rx_filter_cpus);
+    free((void*) c->rx_state);
     free((void*) c->sdr_args);
     free((void*) c->sdr_type);
 }
@@ -60,8 +60,10 @@ struct ookiedokie_cfg {
     unsigned int samplerate;        /**< SDR sample rate, in Hz */
     int gain;                       /**< SDR-specific gain value */
 
-    /* Target device */
-    const char *device;             /**< Name of target OOK device */
+    /* Target devices */
+    char **devices;                 /**< Names of target OOK devices. Only
+                                     *   one may be used for transmission. */
+    unsigned int num_devices;       /**< Number of target OOK devices */
 
     /* Transmit options */
     unsigned int tx_count;          /**< Number of times to re-transmit msg */
@@ -71,6 +73,13 @@ struct ookiedokie_cfg {
     /* Receive options */
     enum ookiedokie_rx_fmt rx_fmt;  /**< How to display received messages */
     float rx_threshold;             /**< RX sample magnitude threshold */
+    bool rx_adaptive;               /**< Adapt the threshold to the noise
+                                     *   floor and burst magnitude, using
+                                     *   rx_threshold as its minimum */
+    float rx_hysteresis;            /**< Lower threshold, as a fraction of
+                                     *   the distance from the noise floor
+                                     *   to the threshold */
+    unsigned int rx_min_width;      /**< Min digital pulse or gap width */
     const char *rx_rec_filename;    /**< Filename to record samples to */
     const char *rx_rec_type;        /**< File format type to record with */
     const char *rx_filter;          /**< Filename of RX filter to user */
@@ -78,6 +87,27 @@ struct ookiedokie_cfg {
     bool rx_rec_input;              /**< If true, record pre-filtered input,
                                      *   otherwise record post-filtered
                                      *   samples. */
+    bool rx_fixed_point;            /**< Filter SC16Q11 samples using
+                                     *   fixed point arithmetic */
+    bool rx_filter_plan;            /**< Print the RX filter's stages and
+                                     *   their estimated cost, then exit */
+    unsigned int rx_filter_threads; /**< # RX filter worker threads */
+    const char *rx_filter_cpus;     /**< Comma-separated list of CPUs to pin
+                                     *   RX filter worker threads to */
+    unsigned int rx_decode_threads; /**< # Decoder worker threads */
+    bool rx_dispatch;               /**< Wake idle devices only for pulses
+                                     *   matching their preamble */
+    unsigned int rx_hypotheses;     /**< Max # of concurrent hypotheses of
+                                     *   where a message begins */
+    unsigned int rx_dedup_window;   /**< Max samples between merged repeats
+                                     *   of a message, or 0 to disable */
+    float rx_squelch;               /**< Peak level below which buffers are
+                                     *   not filtered, or 0 to disable */
+    const char *rx_state;           /**< File to resume decoding state from,
+                                     *   and to save it to upon exit */
+    bool rx_sm_interpret;           /**< Use the state machine's reference
+                                     *   interpreter, rather than its
+                                     *   compiled transition table */
 
     /* Stream config - specific to SDR stream implementation  */
     unsigned int samples_per_buffer;    /**< # Samples per buffer */
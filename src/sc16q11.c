@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+
+#include "sc16q11.h"
+#include "log.h"
+
+#if ENABLE_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define HAVE_X86_IMPLS 1
+#   include <immintrin.h>
+#else
+#   define HAVE_X86_IMPLS 0
+#endif
+
+#ifndef ARRAY_SIZE
+#   define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
+#endif
+
+#define SCALE       2048.0f
+#define INV_SCALE   (1.0f / 2048.0f)
+
+typedef void (*to_complexf_fn)(const int16_t *in, struct complexf *out,
+                               size_t n);
+
+typedef void (*to_planar_fn)(const int16_t *in,
+                             const struct complexf_planar *out, size_t n);
+
+typedef void (*from_complexf_fn)(const struct complexf *in, int16_t *out,
+                                 size_t n);
+
+struct sc16q11_impl {
+    const char *name;
+    to_complexf_fn to_complexf;
+    to_planar_fn to_planar;
+    from_complexf_fn from_complexf;
+};
+
+static void to_complexf_scalar(const int16_t *in, struct complexf *out,
+                               size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i].real = (float) in[2 * i]     * INV_SCALE;
+        out[i].imag = (float) in[2 * i + 1] * INV_SCALE;
+    }
+}
+
+static void to_planar_scalar(const int16_t *in,
+                             const struct complexf_planar *out, size_t n)
+{
+    size_t i;
+    float * restrict re = out->real;
+    float * restrict im = out->imag;
+
+    for (i = 0; i < n; i++) {
+        re[i] = (float) in[2 * i]     * INV_SCALE;
+        im[i] = (float) in[2 * i + 1] * INV_SCALE;
+    }
+}
+
+/* The comparisons are ordered such that NaN saturates to SC16Q11_MAX, as
+ * it does in the SIMD implementations */
+static inline int16_t saturate(float x)
+{
+    x = x < (float) SC16Q11_MAX ? x : (float) SC16Q11_MAX;
+    x = x > (float) SC16Q11_MIN ? x : (float) SC16Q11_MIN;
+    return (int16_t) x;
+}
+
+static void from_complexf_scalar(const struct complexf *in, int16_t *out,
+                                 size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[2 * i]     = saturate(in[i].real * SCALE);
+        out[2 * i + 1] = saturate(in[i].imag * SCALE);
+    }
+}
+
+#if HAVE_X86_IMPLS
+
+/* Interleaved SC16Q11 and complexf samples share the same I, Q ordering, so
+ * these simply widen each 16-bit value */
+__attribute__((target("sse4.1")))
+static void to_complexf_sse41(const int16_t *in, struct complexf *out,
+                              size_t n)
+{
+    size_t i = 0;
+    float *f = (float *) out;
+    const __m128 scale = _mm_set1_ps(INV_SCALE);
+
+    for (; (i + 4) <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) &in[2 * i]);
+        const __m128i lo = _mm_cvtepi16_epi32(v);
+        const __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(v, 8));
+
+        _mm_storeu_ps(&f[2 * i],     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(&f[2 * i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+
+    to_complexf_scalar(&in[2 * i], &out[i], n - i);
+}
+
+/* Each sample is treated as a 32-bit word, with I in the low half and Q in
+ * the high half. Arithmetic shifts sign-extend each half in place. */
+__attribute__((target("sse4.1")))
+static void to_planar_sse41(const int16_t *in,
+                            const struct complexf_planar *out, size_t n)
+{
+    size_t i = 0;
+    const __m128 scale = _mm_set1_ps(INV_SCALE);
+    struct complexf_planar tail;
+
+    for (; (i + 4) <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) &in[2 * i]);
+        const __m128i re = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        const __m128i im = _mm_srai_epi32(v, 16);
+
+        _mm_storeu_ps(&out->real[i], _mm_mul_ps(_mm_cvtepi32_ps(re), scale));
+        _mm_storeu_ps(&out->imag[i], _mm_mul_ps(_mm_cvtepi32_ps(im), scale));
+    }
+
+    tail = complexf_planar_offset(out, i);
+    to_planar_scalar(&in[2 * i], &tail, n - i);
+}
+
+/* Clamping prior to truncation keeps out-of-range values from wrapping.
+ * minps returns its second operand when either is NaN. */
+__attribute__((target("sse4.1")))
+static inline __m128i saturate_sse41(__m128 x)
+{
+    x = _mm_min_ps(_mm_mul_ps(x, _mm_set1_ps(SCALE)),
+                   _mm_set1_ps((float) SC16Q11_MAX));
+    x = _mm_max_ps(x, _mm_set1_ps((float) SC16Q11_MIN));
+    return _mm_cvttps_epi32(x);
+}
+
+__attribute__((target("sse4.1")))
+static void from_complexf_sse41(const struct complexf *in, int16_t *out,
+                                size_t n)
+{
+    size_t i = 0;
+    const float *f = (const float *) in;
+
+    for (; (i + 4) <= n; i += 4) {
+        const __m128i lo = saturate_sse41(_mm_loadu_ps(&f[2 * i]));
+        const __m128i hi = saturate_sse41(_mm_loadu_ps(&f[2 * i + 4]));
+
+        _mm_storeu_si128((__m128i *) &out[2 * i], _mm_packs_epi32(lo, hi));
+    }
+
+    from_complexf_scalar(&in[i], &out[2 * i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void to_complexf_avx2(const int16_t *in, struct complexf *out,
+                             size_t n)
+{
+    size_t i = 0;
+    float *f = (float *) out;
+    const __m256 scale = _mm256_set1_ps(INV_SCALE);
+
+    for (; (i + 8) <= n; i += 8) {
+        const __m128i *v = (const __m128i *) &in[2 * i];
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(&v[0]));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(&v[1]));
+
+        _mm256_storeu_ps(&f[2 * i],
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(&f[2 * i + 8],
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+
+    to_complexf_scalar(&in[2 * i], &out[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void to_planar_avx2(const int16_t *in,
+                           const struct complexf_planar *out, size_t n)
+{
+    size_t i = 0;
+    const __m256 scale = _mm256_set1_ps(INV_SCALE);
+    struct complexf_planar tail;
+
+    for (; (i + 8) <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) &in[2 * i]);
+        const __m256i re = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+        const __m256i im = _mm256_srai_epi32(v, 16);
+
+        _mm256_storeu_ps(&out->real[i],
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(re), scale));
+        _mm256_storeu_ps(&out->imag[i],
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(im), scale));
+    }
+
+    tail = complexf_planar_offset(out, i);
+    to_planar_scalar(&in[2 * i], &tail, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i saturate_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_mul_ps(x, _mm256_set1_ps(SCALE)),
+                      _mm256_set1_ps((float) SC16Q11_MAX));
+    x = _mm256_max_ps(x, _mm256_set1_ps((float) SC16Q11_MIN));
+    return _mm256_cvttps_epi32(x);
+}
+
+/* packssdw operates on each 128-bit lane independently, so the 64-bit
+ * quarters of its result are reordered afterwards */
+__attribute__((target("avx2")))
+static void from_complexf_avx2(const struct complexf *in, int16_t *out,
+                               size_t n)
+{
+    size_t i = 0;
+    const float *f = (const float *) in;
+
+    for (; (i + 8) <= n; i += 8) {
+        const __m256i lo = saturate_avx2(_mm256_loadu_ps(&f[2 * i]));
+        const __m256i hi = saturate_avx2(_mm256_loadu_ps(&f[2 * i + 8]));
+        const __m256i packed = _mm256_packs_epi32(lo, hi);
+
+        _mm256_storeu_si256((__m256i *) &out[2 * i],
+                            _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+
+    from_complexf_scalar(&in[i], &out[2 * i], n - i);
+}
+
+static bool cpu_supports(const char *name)
+{
+    __builtin_cpu_init();
+
+    if (!strcmp(name, "sse4.1")) {
+        return __builtin_cpu_supports("sse4.1");
+    } else if (!strcmp(name, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    } else {
+        return !strcmp(name, "scalar");
+    }
+}
+
+#else
+
+static bool cpu_supports(const char *name)
+{
+    return !strcmp(name, "scalar");
+}
+
+#endif
+
+/* Listed in order of preference */
+static const struct sc16q11_impl impls[] = {
+#if HAVE_X86_IMPLS
+    { "avx2",   to_complexf_avx2,   to_planar_avx2,   from_complexf_avx2 },
+    { "sse4.1", to_complexf_sse41,  to_planar_sse41,  from_complexf_sse41 },
+#endif
+    { "scalar", to_complexf_scalar, to_planar_scalar, from_complexf_scalar },
+};
+
+static const struct sc16q11_impl *selected = NULL;
+
+static const struct sc16q11_impl * get_impl(void)
+{
+    size_t i;
+
+    if (selected == NULL) {
+        for (i = 0; i < ARRAY_SIZE(impls); i++) {
+            if (cpu_supports(impls[i].name)) {
+                selected = &impls[i];
+                log_debug("Using %s SC16Q11 conversions\n", selected->name);
+                break;
+            }
+        }
+    }
+
+    return selected;
+}
+
+bool sc16q11_select_impl(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(impls); i++) {
+        if (!strcasecmp(impls[i].name, name) && cpu_supports(impls[i].name)) {
+            selected = &impls[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void sc16q11_to_complexf(const int16_t *in, struct complexf *out, size_t n)
+{
+    get_impl()->to_complexf(in, out, n);
+}
+
+void sc16q11_to_complexf_planar(const int16_t *in,
+                                const struct complexf_planar *out, size_t n)
+{
+    get_impl()->to_planar(in, out, n);
+}
+
+void complexf_to_sc16q11(const struct complexf *in, int16_t *out, size_t n)
+{
+    get_impl()->from_complexf(in, out, n);
+}
+
+unsigned int sc16q11_peak(const int16_t *in, size_t n)
+{
+    size_t i;
+    int32_t peak = 0;
+
+    /* Written to be vectorized by the compiler */
+    for (i = 0; i < 2 * n; i++) {
+        const int32_t x = in[i];
+        const int32_t mag = x < 0 ? -x : x;
+        peak = mag > peak ? mag : peak;
+    }
+
+    return (unsigned int) peak;
+}
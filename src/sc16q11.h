@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef OOKIEDOKIE_SC16Q11_H_
+#define OOKIEDOKIE_SC16Q11_H_
+
+/* This file provides conversions between SC16Q11 samples (the bladeRF
+ * ADC/DAC format) and floating point samples. SIMD implementations are
+ * selected at run-time, based upon CPU support. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "complexf.h"
+
+/**
+ * Range of SC16Q11 sample values. These are 12-bit values, with 2048
+ * corresponding to 1.0.
+ */
+#define SC16Q11_MAX 2047
+#define SC16Q11_MIN -2048
+
+/**
+ * Convert an array of SC16Q11 values (bladeRF ADC/DAC format) to
+ * complexf values.
+ *
+ * @param[in]   in      Input SC16Q11 values (interleaved IQ)
+ * @param[out]  out     Output complexf values
+ * @param[in]   n       Number of samples to convert
+ */
+void sc16q11_to_complexf(const int16_t *in, struct complexf *out, size_t n);
+
+/**
+ * Convert an array of SC16Q11 values (bladeRF ADC/DAC format) to a planar
+ * buffer
+ *
+ * @param[in]   in      Input SC16Q11 values (interleaved IQ)
+ * @param[out]  out     Output planar buffer
+ * @param[in]   n       Number of samples to convert
+ */
+void sc16q11_to_complexf_planar(const int16_t *in,
+                                const struct complexf_planar *out, size_t n);
+
+/**
+ * Convert an array of complexf values to SC16Q11 values (bladeRF ADC/DAC
+ * format). Values are truncated towards zero, and those outside of
+ * [-1.0, 1.0) are saturated to [SC16Q11_MIN, SC16Q11_MAX].
+ *
+ * @param[in]   in      Input complexf values
+ * @param[out]  out     Output SC16Q11 values (interleaved IQ)
+ * @param[in]   n       Number of samples to convert
+ */
+void complexf_to_sc16q11(const struct complexf *in, int16_t *out, size_t n);
+
+/**
+ * Find the peak magnitude of the I and Q components of SC16Q11 samples. This
+ * is a cheap estimate of a block's signal level.
+ *
+ * @param[in]   in      Input SC16Q11 values (interleaved IQ)
+ * @param[in]   n       Number of samples to examine
+ *
+ * @return Largest absolute I or Q value, or 0 if `n` is 0
+ */
+unsigned int sc16q11_peak(const int16_t *in, size_t n);
+
+/**
+ * Select the conversion implementation to use, overriding the default
+ * selection of the fastest implementation supported by the host CPU. This
+ * is intended for testing and benchmarking.
+ *
+ * @param   name    "scalar", "sse4.1" or "avx2"
+ *
+ * @return true on success, false if the name is not valid or the
+ *         implementation is not supported by the host CPU
+ */
+bool sc16q11_select_impl(const char *name);
+
+#endif
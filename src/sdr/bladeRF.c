@@ -28,6 +28,7 @@
 #include "minmax.h"
 #include "ookiedokie_cfg.h"
 #include "complexf.h"
+#include "sc16q11.h"
 
 struct sdr_bladerf {
     struct bladerf *handle;
@@ -242,6 +243,62 @@ int sdr_bladerf_rx(void *dev, struct complexf *samples, unsigned int count)
     return status;
 }
 
+int sdr_bladerf_rx_planar(void *dev, const struct complexf_planar *samples,
+                          unsigned int count)
+{
+    int status = 0;
+    unsigned int to_read, total_read;
+    struct complexf_planar out;
+    struct sdr_bladerf *sdr = (struct sdr_bladerf *) dev;
+
+    total_read = 0;
+
+    while (status == 0 && total_read < count) {
+        to_read = uint_min(sdr->buf_len, count - total_read);
+
+        status = bladerf_sync_rx(sdr->handle, sdr->buf, to_read,
+                                 NULL, sdr->timeout_ms);
+
+        if (status != 0) {
+            log_error("RX failure: %s\n", bladerf_strerror(status));
+            continue;
+        }
+
+        out = complexf_planar_offset(samples, total_read);
+        sc16q11_to_complexf_planar(sdr->buf, &out, to_read);
+
+        total_read += to_read;
+    }
+
+    return status;
+}
+
+int sdr_bladerf_rx_sc16q11(void *dev, int16_t *samples, unsigned int count)
+{
+    int status = 0;
+    unsigned int to_read, total_read;
+    struct sdr_bladerf *sdr = (struct sdr_bladerf *) dev;
+
+    total_read = 0;
+
+    while (status == 0 && total_read < count) {
+        to_read = uint_min(sdr->buf_len, count - total_read);
+
+        status = bladerf_sync_rx(sdr->handle, samples, to_read,
+                                 NULL, sdr->timeout_ms);
+
+        if (status != 0) {
+            log_error("RX failure: %s\n", bladerf_strerror(status));
+            continue;
+        }
+
+        samples += 2 * to_read;
+        total_read += to_read;
+    }
+
+    return status;
+}
+
 int sdr_bladerf_tx(void *dev, struct complexf *samples, unsigned int count)
 {
     int status = 0;
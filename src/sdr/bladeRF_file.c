@@ -28,6 +28,7 @@
 #include "sdr.h"
 #include "ookiedokie_cfg.h"
 #include "complexf.h"
+#include "sc16q11.h"
 #include "minmax.h"
 #include "log.h"
 
@@ -125,6 +126,60 @@ int sdr_bladerf_file_rx(void *dev, struct complexf *samples, unsigned int count)
     return status;
 }
 
+int sdr_bladerf_file_rx_planar(void *dev,
+                               const struct complexf_planar *samples,
+                               unsigned int count)
+{
+    int status = 0;
+    size_t n;
+    unsigned int to_read, total_read;
+    struct complexf_planar out;
+    struct sdr_bladerf_file *sdr = (struct sdr_bladerf_file *) dev;
+
+    total_read = 0;
+
+    while (status == 0 && total_read < count) {
+        to_read = uint_min(sdr->buf_len, count - total_read);
+        log_verbose("Reading %u samples...\n", to_read);
+
+        n = fread(sdr->buf, 2 * sizeof(int16_t), to_read, sdr->file);
+        if (n == 0) {
+            status = SDR_FILE_EOF;
+        } else if (n < to_read) {
+            /* Zero out the remaining samples. We're about to hit an EOF. */
+            int16_t *to_zero = sdr->buf + (2 * n);
+            memset(to_zero, 0, 2 * sizeof(int16_t) * (to_read - n));
+        }
+
+        out = complexf_planar_offset(samples, total_read);
+        sc16q11_to_complexf_planar(sdr->buf, &out, to_read);
+
+        total_read += to_read;
+    }
+
+    return status;
+}
+
+int sdr_bladerf_file_rx_sc16q11(void *dev, int16_t *samples,
+                                unsigned int count)
+{
+    int status = 0;
+    size_t n;
+    struct sdr_bladerf_file *sdr = (struct sdr_bladerf_file *) dev;
+
+    log_verbose("Reading %u samples...\n", count);
+
+    n = fread(samples, 2 * sizeof(int16_t), count, sdr->file);
+    if (n == 0) {
+        status = SDR_FILE_EOF;
+    } else if (n < count) {
+        /* Zero out the remaining samples. We're about to hit an EOF. */
+        memset(samples + (2 * n), 0, 2 * sizeof(int16_t) * (count - n));
+    }
+
+    return status;
+}
+
 int sdr_bladerf_file_tx(void *dev, struct complexf *samples, unsigned int count)
 {
     int status = 0;
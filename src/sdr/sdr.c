@@ -97,6 +97,31 @@ struct sdr_interface
      */
     int (*rx)(void *handle, struct complexf *samples, unsigned int count);
 
+    /**
+     * Receive the specified number of samples, into a planar buffer
+     *
+     * @param[in]   dev         SDR handle
+     * @param[out]  samples     Buffer to store samples in
+     * @param[in]   count       Number of samples to receive
+     *
+     * @return 0 on success, non-zero on failure.
+     *         Non-zero error codes will propagate from the underlying SDR APIs.
+     */
+    int (*rx_planar)(void *handle, const struct complexf_planar *samples,
+                     unsigned int count);
+
+    /**
+     * Receive the specified number of samples, in the SC16Q11 format
+     *
+     * @param[in]   dev         SDR handle
+     * @param[out]  samples     Buffer to store interleaved IQ samples in
+     * @param[in]   count       Number of samples to receive
+     *
+     * @return 0 on success, non-zero on failure.
+     *         Non-zero error codes will propagate from the underlying SDR APIs.
+     */
+    int (*rx_sc16q11)(void *handle, int16_t *samples, unsigned int count);
+
     /**
      * Transmit the specified number of samples
      *
@@ -191,6 +216,17 @@ int sdr_rx(struct sdr *dev, struct complexf *samples, unsigned int count)
     return dev->iface->rx(dev->handle, samples, count);
 }
 
+int sdr_rx_planar(struct sdr *dev, const struct complexf_planar *samples,
+                  unsigned int count)
+{
+    return dev->iface->rx_planar(dev->handle, samples, count);
+}
+
+int sdr_rx_sc16q11(struct sdr *dev, int16_t *samples, unsigned int count)
+{
+    return dev->iface->rx_sc16q11(dev->handle, samples, count);
+}
+
 int sdr_tx(struct sdr *dev, const struct complexf *samples, unsigned int count)
 {
     return dev->iface->tx(dev->handle, samples, count);
@@ -63,6 +63,34 @@ struct sdr * sdr_init(const struct ookiedokie_cfg *config, bool file_only);
  */
 int sdr_rx(struct sdr *dev, struct complexf *samples, unsigned int count);
 
+/**
+ * Receive the specified number of samples, into a planar buffer
+ *
+ * @param[in]   dev         SDR handle
+ * @param[out]  samples     Buffer to store samples in
+ * @param[in]   count       Number of samples to receive
+ *
+ * @return 0 on success, non-zero on failure.
+ *         Non-zero error codes will propagate from the underlying SDR APIs.
+ */
+int sdr_rx_planar(struct sdr *dev, const struct complexf_planar *samples,
+                  unsigned int count);
+
+/**
+ * Receive the specified number of samples, in the SC16Q11 format used by
+ * fir_filter_and_decimate_sc16q11(). This avoids the conversion to
+ * floating point performed by sdr_rx().
+ *
+ * @param[in]   dev         SDR handle
+ * @param[out]  samples     Buffer to store interleaved IQ samples in.
+ *                          This must be large enough for 2 * count values.
+ * @param[in]   count       Number of samples to receive
+ *
+ * @return 0 on success, non-zero on failure.
+ *         Non-zero error codes will propagate from the underlying SDR APIs.
+ */
+int sdr_rx_sc16q11(struct sdr *dev, int16_t *samples, unsigned int count);
+
 /**
  * Transmit the specified number of samples
  *
@@ -33,6 +33,9 @@
     void * sdr_##name##_init(const struct ookiedokie_cfg *); \
     void sdr_##name##_deinit(void *); \
     int sdr_##name##_rx(void *, struct complexf *, unsigned int); \
+    int sdr_##name##_rx_planar(void *, const struct complexf_planar *, \
+                               unsigned int); \
+    int sdr_##name##_rx_sc16q11(void *, int16_t *, unsigned int); \
     int sdr_##name##_tx(void *, const struct complexf *, unsigned int); \
     int sdr_##name##_flush(void *) \
 
@@ -43,6 +46,8 @@
     .init               = sdr_##name_##_init, \
     .deinit             = sdr_##name_##_deinit, \
     .rx                 = sdr_##name_##_rx, \
+    .rx_planar          = sdr_##name_##_rx_planar, \
+    .rx_sc16q11         = sdr_##name_##_rx_sc16q11, \
     .tx                 = sdr_##name_##_tx, \
     .flush              = sdr_##name_##_flush, \
 }
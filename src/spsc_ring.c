@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "spsc_ring.h"
+
+/* Number of times to poll a ring before sleeping on it */
+#define SPIN_COUNT 4096
+
+#define CACHE_LINE 64
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define cpu_relax() __builtin_ia32_pause()
+#else
+#   define cpu_relax()
+#endif
+
+/* The head and tail counters increase monotonically, and are reduced modulo
+ * the number of slots to yield slot indices. Each is written by only one
+ * thread, and is kept on its own cache line. */
+struct spsc_ring {
+    size_t head __attribute__((aligned(CACHE_LINE)));   /* Producer */
+    size_t tail __attribute__((aligned(CACHE_LINE)));   /* Consumer */
+
+    size_t num_slots __attribute__((aligned(CACHE_LINE)));
+
+    /* Used only to sleep. `waiting` counts the sleeping threads. Both
+     * threads may briefly wait at once, as one may not yet have woken when
+     * the other finds the ring full or empty, so they are woken together. */
+    int waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct spsc_ring * spsc_ring_init(size_t num_slots)
+{
+    struct spsc_ring *ring;
+
+    if (num_slots == 0 || (num_slots & (num_slots - 1)) != 0) {
+        return NULL;
+    }
+
+    if (posix_memalign((void **) &ring, CACHE_LINE, sizeof(*ring)) != 0) {
+        return NULL;
+    }
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->num_slots = num_slots;
+    ring->waiting = 0;
+
+    if (pthread_mutex_init(&ring->lock, NULL) != 0) {
+        free(ring);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&ring->cond, NULL) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        free(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void spsc_ring_deinit(struct spsc_ring *ring)
+{
+    if (ring) {
+        pthread_cond_destroy(&ring->cond);
+        pthread_mutex_destroy(&ring->lock);
+        free(ring);
+    }
+}
+
+static inline bool has_space(struct spsc_ring *ring)
+{
+    return ring->head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) <
+           ring->num_slots;
+}
+
+static inline bool has_data(struct spsc_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail;
+}
+
+/* Wait for `ready` to hold. The other thread's update to the ring and our
+ * increment of `waiting` are sequentially consistent, so either it observes
+ * that we are waiting and wakes us, or we observe its update. */
+static void wait_for(struct spsc_ring *ring,
+                     bool (*ready)(struct spsc_ring *ring))
+{
+    unsigned int i;
+
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (ready(ring)) {
+            return;
+        }
+
+        cpu_relax();
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    __atomic_add_fetch(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+
+    while (!ready(ring)) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+
+    __atomic_sub_fetch(&ring->waiting, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+static void wake(struct spsc_ring *ring)
+{
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+size_t spsc_ring_acquire(struct spsc_ring *ring)
+{
+    wait_for(ring, has_space);
+    return ring->head & (ring->num_slots - 1);
+}
+
+void spsc_ring_publish(struct spsc_ring *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    wake(ring);
+}
+
+size_t spsc_ring_peek(struct spsc_ring *ring)
+{
+    wait_for(ring, has_data);
+    return ring->tail & (ring->num_slots - 1);
+}
+
+void spsc_ring_release(struct spsc_ring *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+    wake(ring);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+/* This file provides a single-producer, single-consumer ring of slot
+ * indices, used to pass blocks of data between a pair of threads without
+ * locking. The ring only tracks which slots are full; the caller owns the
+ * slots' contents, typically an array indexed by the value returned from
+ * spsc_ring_acquire() or spsc_ring_peek().
+ *
+ * A thread waiting on the ring spins briefly, and then sleeps until the
+ * other thread updates the ring. */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Opaque handle to a ring */
+struct spsc_ring;
+
+/**
+ * Allocate and initialize a ring
+ *
+ * @param   num_slots   Number of slots. This must be a power of two.
+ *
+ * @return Ring handle on success, or NULL on failure
+ */
+struct spsc_ring * spsc_ring_init(size_t num_slots);
+
+/**
+ * Deallocate a ring. Neither thread may be using it.
+ */
+void spsc_ring_deinit(struct spsc_ring *ring);
+
+/**
+ * Producer: Wait for an empty slot
+ *
+ * @return Index of the slot, to be filled and then passed to the consumer
+ *         via spsc_ring_publish()
+ */
+size_t spsc_ring_acquire(struct spsc_ring *ring);
+
+/**
+ * Producer: Pass the slot returned by spsc_ring_acquire() to the consumer
+ */
+void spsc_ring_publish(struct spsc_ring *ring);
+
+/**
+ * Consumer: Wait for a full slot. Slots are received in the order in which
+ * they were published.
+ *
+ * @return Index of the slot, to be returned to the producer via
+ *         spsc_ring_release() once its contents have been consumed
+ */
+size_t spsc_ring_peek(struct spsc_ring *ring);
+
+/**
+ * Consumer: Return the slot returned by spsc_ring_peek() to the producer
+ */
+void spsc_ring_release(struct spsc_ring *ring);
+
+#endif
@@ -30,9 +30,16 @@
 #include "state_machine.h"
 #include "log.h"
 
+/* Range of sample counts, inclusive, that match an expected duration */
+struct window {
+    uint64_t min;
+    uint64_t max;
+};
+
 struct trigger {
     enum sm_trigger_cond condition;
     uint64_t duration_us;               // TODO document this
+    struct window window;               /* duration_us, in samples */
 
     enum sm_trigger_action action;
     struct state *next_state;
@@ -44,6 +51,10 @@ struct state {
     uint64_t duration_us;       // TODO make this doubles for sub-us values
     uint64_t timeout_us;
 
+    /* The above, in samples. The timeout is UINT64_MAX if there is none. */
+    struct window window;
+    uint64_t timeout;
+
     struct trigger *triggers;
     size_t num_triggers;
 };
@@ -54,6 +65,35 @@ struct state {
 /* TODO: Make this run-time or device-configurable */
 #define TOLERANCE 0.15
 
+/* Events that may occur at a sample, besides "always", which occurs at every
+ * sample. Each combination of these has an entry per state in the compiled
+ * transition table. */
+#define EVENT_PULSE_START   (1 << 0)
+#define EVENT_PULSE_END     (1 << 1)
+#define EVENT_TIMEOUT       (1 << 2)
+#define EVENT_MSG_COMPLETE  (1 << 3)
+#define NUM_EVENT_SETS      (1 << 4)
+
+/* The triggers of a state that a set of events may activate, in priority
+ * order. Which of these fires depends only upon their duration windows. */
+struct transition {
+    const struct trigger **triggers;
+    unsigned int num_triggers;
+};
+
+/* A concurrent instance of the receiver, which began at a different edge.
+ * See sm_set_hypotheses(). */
+struct hypothesis {
+    struct state *curr_state;
+    uint64_t elapsed;
+    unsigned int num_bits;
+    unsigned int run_offset;
+    uint64_t count_monotonic;
+
+    uint64_t start;             /* Sample at which this instance began */
+    uint8_t *data;
+};
+
 struct state_machine
 {
     struct state *states;
@@ -68,19 +108,101 @@ struct state_machine
 
     bool prev_bit;
 
-    double elapsed_us;          /* us elapsed since last transition */
+    uint64_t elapsed;           /* Samples elapsed since last transition */
     uint64_t count_monotonic;   /* Monotonic sample counter for debug */
 
+    unsigned int run_offset;    /* Samples of the current run processed by
+                                 * sm_process_runs() */
+    unsigned int output_offset; /* See sm_output_offset() */
+
+    /* Compiled transitions, indexed by (state * NUM_EVENT_SETS + events).
+     * If NULL, triggers are found by scanning each state's list. */
+    struct transition *table;
+    const struct trigger **table_triggers;
+    bool use_table;
+
+    /* State awaiting the first pulse of a message, and the range of that
+     * pulse's lengths which may be accepted. See find_preamble(). */
+    const struct state *entry;
+    uint64_t preamble_min;
+    uint64_t preamble_max;
+
+    /* Concurrent receiver instances, oldest first. When in use, the fields
+     * above describing the receiver's progress are loaded from an instance
+     * while it processes a run, and `data` points to its buffer. */
+    struct hypothesis *hyp;
+    unsigned int num_hyp;
+    unsigned int max_hyp;
+    uint8_t *hyp_data;          /* Backing storage for each instance's data */
+    uint8_t *output;            /* Caller's data buffer */
+    bool hyp_prev_bit;          /* Level of the run before the current one */
+    bool hyp_run_started;       /* Current run has been partially processed */
+    uint64_t hyp_samples;       /* Samples in all runs fully processed */
+    uint64_t last_output;       /* Sample at which output was last ready */
+
     unsigned int sample_rate;
 };
 
 /* Convert sample count to duration in us */
-static inline double to_duration_us(struct state_machine *sm,
-                                    unsigned int samples)
+static inline double to_duration_us(const struct state_machine *sm,
+                                    uint64_t samples)
 {
     return ((double) samples / (double) sm->sample_rate) * 1e6;
 }
 
+/* Smallest sample count that lasts at least the specified duration */
+static uint64_t samples_at_least(const struct state_machine *sm,
+                                 double duration_us)
+{
+    uint64_t n = (uint64_t) (duration_us * ((double) sm->sample_rate / 1e6));
+
+    /* Correct for any rounding in the estimate */
+    while (n > 0 && to_duration_us(sm, n - 1) >= duration_us) {
+        n--;
+    }
+
+    while (to_duration_us(sm, n) < duration_us) {
+        n++;
+    }
+
+    return n;
+}
+
+/* Largest sample count that lasts at most the specified duration */
+static uint64_t samples_at_most(const struct state_machine *sm,
+                                double duration_us)
+{
+    uint64_t n = (uint64_t) (duration_us * ((double) sm->sample_rate / 1e6));
+
+    while (n > 0 && to_duration_us(sm, n) > duration_us) {
+        n--;
+    }
+
+    while (to_duration_us(sm, n + 1) <= duration_us) {
+        n++;
+    }
+
+    return n;
+}
+
+/* Range of sample counts within TOLERANCE of the specified duration.
+ * A duration of 0 implies "any duration". */
+static struct window to_window(const struct state_machine *sm,
+                               uint64_t duration_us)
+{
+    struct window w = { 0, UINT64_MAX };
+
+    if (duration_us != 0) {
+        const float min = duration_us - (TOLERANCE * duration_us);
+        const float max = duration_us + (TOLERANCE * duration_us);
+
+        w.min = samples_at_least(sm, min);
+        w.max = samples_at_most(sm, max);
+    }
+
+    return w;
+}
+
 /* Convert duration to sample count
  *
  * TODO overflow check
@@ -102,15 +224,8 @@ static bool matches_state_duration(const struct state_machine *sm, bool check)
     bool match = true;
 
     if (check) {
-        const struct state *s = sm->curr_state;
-
-        /* 0 implies "any duration" */
-        if (s->duration_us != 0.0f) {
-            const float min = s->duration_us - (TOLERANCE * s->duration_us);
-            const float max = s->duration_us + (TOLERANCE * s->duration_us);
-
-            match = (sm->elapsed_us >= min) && (sm->elapsed_us <= max);
-        }
+        const struct window *w = &sm->curr_state->window;
+        match = (sm->elapsed >= w->min) && (sm->elapsed <= w->max);
     }
 
     return match;
@@ -119,17 +234,8 @@ static bool matches_state_duration(const struct state_machine *sm, bool check)
 static bool matches_trigger_duration(const struct state_machine *sm,
                                      const struct trigger *trig)
 {
-    bool match = true;
-
-    /* 0 Implies "any duration" */
-    if (trig->duration_us != 0) {
-        const float min = trig->duration_us - (TOLERANCE * trig->duration_us);
-        const float max = trig->duration_us + (TOLERANCE * trig->duration_us);
-
-        match = (sm->elapsed_us >= min) && (sm->elapsed_us <= max);
-    }
-
-    return match;
+    return (sm->elapsed >= trig->window.min) &&
+           (sm->elapsed <= trig->window.max);
 }
 
 struct state_machine * sm_init(unsigned int num_states,
@@ -208,6 +314,537 @@ bool sm_initialized(struct state_machine *sm)
     return true;
 }
 
+/* Does the trigger's condition hold, given a set of events? */
+static bool trigger_activated_by(const struct trigger *t, unsigned int events)
+{
+    switch (t->condition) {
+        case SM_TRIGGER_COND_ALWAYS:
+            return true;
+
+        case SM_TRIGGER_COND_PULSE_START:
+            return (events & EVENT_PULSE_START) != 0;
+
+        case SM_TRIGGER_COND_PULSE_END:
+            return (events & EVENT_PULSE_END) != 0;
+
+        case SM_TRIGGER_COND_TIMEOUT:
+            return (events & EVENT_TIMEOUT) != 0;
+
+        case SM_TRIGGER_COND_MSG_COMPLETE:
+            return (events & EVENT_MSG_COMPLETE) != 0;
+
+        default:
+            return false;
+    }
+}
+
+/* Does the trigger return the state machine to idle, without side effects? */
+static bool trigger_returns_to_idle(const struct state_machine *sm,
+                                    const struct trigger *t,
+                                    const struct state *entry)
+{
+    return t->action == SM_TRIGGER_ACTION_NONE &&
+           (t->next_state == &sm->states[STATE_RESET] ||
+            t->next_state == entry);
+}
+
+/* Determine the range of first pulse lengths, in samples, that the state
+ * machine might accept when idle. Any other pulse is guaranteed to return it
+ * to idle by the end of the pulse, so it need not process them.
+ *
+ * This is supported for state machines of the form:
+ *  - The reset state always transitions to an "entry" state.
+ *  - The entry state transitions on a pulse start, which takes precedence over
+ *    any timeouts back to reset. It has no other triggers.
+ *  - The pulse state has a bounded duration. It has a pulse end trigger,
+ *    which has no duration of its own, and any timeouts return to reset.
+ *
+ * Otherwise, sm->entry is left NULL. */
+static void find_preamble(struct state_machine *sm)
+{
+    unsigned int i;
+    const struct state *reset = &sm->states[STATE_RESET];
+    const struct state *entry, *pulse = NULL;
+    const struct trigger *t;
+    bool have_pulse_end = false;
+
+    sm->entry = NULL;
+
+    if (reset->num_triggers != 1) {
+        return;
+    }
+
+    t = &reset->triggers[0];
+    if (t->condition != SM_TRIGGER_COND_ALWAYS || t->duration_us != 0 ||
+        t->action != SM_TRIGGER_ACTION_NONE || t->next_state == reset) {
+        return;
+    }
+
+    entry = t->next_state;
+
+    for (i = 0; i < entry->num_triggers; i++) {
+        t = &entry->triggers[i];
+
+        if (t->condition == SM_TRIGGER_COND_PULSE_START && pulse == NULL) {
+            if (t->duration_us != 0 || t->action != SM_TRIGGER_ACTION_NONE) {
+                return;
+            }
+
+            pulse = t->next_state;
+        } else if (t->condition != SM_TRIGGER_COND_TIMEOUT ||
+                   !trigger_returns_to_idle(sm, t, entry) ||
+                   (pulse == NULL && entry->timeout != UINT64_MAX)) {
+            return;
+        }
+    }
+
+    if (pulse == NULL || pulse == reset || pulse == entry ||
+        pulse->window.max == UINT64_MAX) {
+        return;
+    }
+
+    for (i = 0; i < pulse->num_triggers; i++) {
+        t = &pulse->triggers[i];
+
+        switch (t->condition) {
+            case SM_TRIGGER_COND_PULSE_END:
+                if (t->duration_us != 0) {
+                    return;
+                }
+                have_pulse_end = true;
+                break;
+
+            /* Neither can fire during the first pulse */
+            case SM_TRIGGER_COND_PULSE_START:
+            case SM_TRIGGER_COND_MSG_COMPLETE:
+                break;
+
+            case SM_TRIGGER_COND_TIMEOUT:
+                if (!trigger_returns_to_idle(sm, t, entry)) {
+                    return;
+                }
+                break;
+
+            default:
+                return;
+        }
+    }
+
+    if (!have_pulse_end) {
+        return;
+    }
+
+    /* The pulse end trigger fires at the first sample after the pulse, at
+     * which point one fewer sample than the pulse length has elapsed */
+    sm->entry = entry;
+    sm->preamble_min = pulse->window.min + 1;
+    sm->preamble_max = pulse->window.max + 1;
+
+    log_verbose("Preamble pulse length: [%"PRIu64", %"PRIu64"] samples\n",
+                sm->preamble_min, sm->preamble_max);
+}
+
+bool sm_compile(struct state_machine *sm)
+{
+    unsigned int s, e, t;
+    size_t num_entries = 0;
+    const struct trigger **next;
+
+    if (!sm_initialized(sm)) {
+        return false;
+    }
+
+    for (s = 0; s < sm->num_states; s++) {
+        const struct state *state = &sm->states[s];
+
+        for (t = 0; t < state->num_triggers; t++) {
+            const enum sm_trigger_cond cond = state->triggers[t].condition;
+
+            if (cond < SM_TRIGGER_COND_ALWAYS ||
+                cond > SM_TRIGGER_COND_MSG_COMPLETE) {
+                log_error("{%s} Invalid trigger condition: %d\n",
+                          state->name, cond);
+                return false;
+            }
+        }
+
+        num_entries += NUM_EVENT_SETS * state->num_triggers;
+    }
+
+    free(sm->table);
+    free(sm->table_triggers);
+
+    sm->table = calloc(sm->num_states * NUM_EVENT_SETS, sizeof(sm->table[0]));
+    sm->table_triggers = calloc(num_entries, sizeof(sm->table_triggers[0]));
+
+    if (!sm->table || (num_entries != 0 && !sm->table_triggers)) {
+        perror("calloc");
+        free(sm->table);
+        free(sm->table_triggers);
+        sm->table = NULL;
+        sm->table_triggers = NULL;
+        sm->use_table = false;
+        return false;
+    }
+
+    /* Each entry lists the triggers whose conditions hold for its events,
+     * in the order in which the state lists them */
+    next = sm->table_triggers;
+    for (s = 0; s < sm->num_states; s++) {
+        const struct state *state = &sm->states[s];
+
+        for (e = 0; e < NUM_EVENT_SETS; e++) {
+            struct transition *trans = &sm->table[s * NUM_EVENT_SETS + e];
+            trans->triggers = next;
+
+            for (t = 0; t < state->num_triggers; t++) {
+                if (trigger_activated_by(&state->triggers[t], e)) {
+                    trans->triggers[trans->num_triggers++] =
+                        &state->triggers[t];
+                }
+            }
+
+            next += trans->num_triggers;
+        }
+    }
+
+    find_preamble(sm);
+
+    sm->use_table = true;
+    return true;
+}
+
+bool sm_preamble(const struct state_machine *sm,
+                 uint64_t *min_len, uint64_t *max_len)
+{
+    if (sm->entry == NULL) {
+        return false;
+    }
+
+    *min_len = sm->preamble_min;
+    *max_len = sm->preamble_max;
+    return true;
+}
+
+static inline bool is_idle_state(const struct state_machine *sm,
+                                 const struct state *s)
+{
+    return s == &sm->states[STATE_RESET] || s == sm->entry;
+}
+
+bool sm_idle(const struct state_machine *sm)
+{
+    if (sm->entry == NULL) {
+        return false;
+    } else if (sm->hyp != NULL) {
+        return sm->num_hyp == 1 && sm->hyp[0].run_offset == 0 &&
+               is_idle_state(sm, sm->hyp[0].curr_state);
+    } else {
+        return sm->run_offset == 0 && is_idle_state(sm, sm->curr_state);
+    }
+}
+
+void sm_reset(struct state_machine *sm)
+{
+    sm->curr_state = &sm->states[STATE_RESET];
+    sm->prev_bit = false;
+    sm->elapsed = 0;
+    sm->run_offset = 0;
+
+    if (sm->hyp != NULL) {
+        sm->num_hyp = 1;
+        sm->hyp[0].curr_state = sm->curr_state;
+        sm->hyp[0].elapsed = 0;
+        sm->hyp[0].run_offset = 0;
+        sm->hyp[0].start = sm->hyp_samples;
+        sm->hyp_prev_bit = false;
+        sm->hyp_run_started = false;
+    }
+}
+
+bool sm_set_hypotheses(struct state_machine *sm, unsigned int max)
+{
+    const size_t num_bytes = (sm->max_bits + 7) / 8;
+    unsigned int i;
+
+    if (max <= 1 || sm->hyp != NULL) {
+        return true;
+    }
+
+    /* New instances are started on pulses that might begin a message */
+    if (sm->entry == NULL) {
+        log_debug("State machine has no recognizable preamble; "
+                  "not decoding concurrent hypotheses.\n");
+        return true;
+    }
+
+    sm->hyp = calloc(max, sizeof(sm->hyp[0]));
+    sm->hyp_data = calloc(max, num_bytes);
+    if (!sm->hyp || !sm->hyp_data) {
+        perror("calloc");
+        free(sm->hyp);
+        free(sm->hyp_data);
+        sm->hyp = NULL;
+        sm->hyp_data = NULL;
+        return false;
+    }
+
+    for (i = 0; i < max; i++) {
+        sm->hyp[i].data = &sm->hyp_data[i * num_bytes];
+    }
+
+    /* Carry on from the receiver's current progress */
+    sm->max_hyp = max;
+    sm->num_hyp = 1;
+    sm->hyp[0].curr_state = sm->curr_state;
+    sm->hyp[0].elapsed = sm->elapsed;
+    sm->hyp[0].num_bits = sm->num_bits;
+    sm->hyp[0].run_offset = sm->run_offset;
+    sm->hyp[0].count_monotonic = sm->count_monotonic;
+    memcpy(sm->hyp[0].data, sm->data, num_bytes);
+
+    sm->output = sm->data;
+    sm->hyp_prev_bit = sm->prev_bit;
+    sm->hyp_run_started = sm->run_offset != 0;
+    sm->last_output = UINT64_MAX;
+
+    return true;
+}
+
+/* Snapshot layout. The header is followed by a record per instance, each of
+ * which is followed by the instance's (max_bits + 7) / 8 bytes of data. */
+#define SNAPSHOT_MAGIC      0x534b4f4f  /* "OOKS" */
+#define SNAPSHOT_VERSION    1
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              /* Size of the entire snapshot, in bytes */
+    uint32_t fingerprint;       /* See fingerprint() */
+    uint32_t num_instances;
+    uint32_t prev_bit;
+    uint64_t samples;           /* sm->hyp_samples */
+    uint64_t last_output;       /* sm->last_output */
+};
+
+struct snapshot_instance {
+    uint32_t state;             /* Index of the current state */
+    uint32_t num_bits;
+    uint64_t elapsed;
+    uint64_t count_monotonic;
+    uint64_t start;
+};
+
+/* FNV-1a hash */
+static uint32_t hash(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+/* Hash of the states and triggers, in samples, such that a snapshot is only
+ * restored into an equivalent state machine */
+static uint32_t fingerprint(const struct state_machine *sm)
+{
+    uint32_t h = 2166136261u;
+    unsigned int s, t;
+
+    h = hash(h, &sm->num_states, sizeof(sm->num_states));
+    h = hash(h, &sm->max_bits, sizeof(sm->max_bits));
+
+    for (s = 0; s < sm->num_states; s++) {
+        const struct state *state = &sm->states[s];
+
+        h = hash(h, state->name, strlen(state->name));
+        h = hash(h, &state->window, sizeof(state->window));
+        h = hash(h, &state->timeout, sizeof(state->timeout));
+
+        for (t = 0; t < state->num_triggers; t++) {
+            const struct trigger *trig = &state->triggers[t];
+            const uint32_t fields[3] = {
+                trig->condition, trig->action,
+                (uint32_t) (trig->next_state - sm->states)
+            };
+
+            h = hash(h, fields, sizeof(fields));
+            h = hash(h, &trig->window, sizeof(trig->window));
+        }
+    }
+
+    return h;
+}
+
+static inline size_t snapshot_len(const struct state_machine *sm,
+                                  unsigned int num_instances)
+{
+    return sizeof(struct snapshot_header) + num_instances *
+           (sizeof(struct snapshot_instance) + (sm->max_bits + 7) / 8);
+}
+
+size_t sm_snapshot_size(const struct state_machine *sm)
+{
+    return snapshot_len(sm, (sm->hyp != NULL) ? sm->max_hyp : 1);
+}
+
+size_t sm_snapshot(const struct state_machine *sm, void *buf, size_t len)
+{
+    const size_t num_bytes = (sm->max_bits + 7) / 8;
+    const unsigned int n = (sm->hyp != NULL) ? sm->num_hyp : 1;
+    struct snapshot_header hdr;
+    uint8_t *out = (uint8_t *) buf;
+    unsigned int i;
+
+    if (len < snapshot_len(sm, n)) {
+        log_error("Insufficient space for state machine snapshot.\n");
+        return 0;
+    }
+
+    if ((sm->hyp != NULL) ? sm->hyp_run_started : (sm->run_offset != 0)) {
+        log_error("Cannot snapshot state machine partway through a run.\n");
+        return 0;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.size = (uint32_t) snapshot_len(sm, n);
+    hdr.fingerprint = fingerprint(sm);
+    hdr.num_instances = n;
+
+    if (sm->hyp != NULL) {
+        hdr.prev_bit = sm->hyp_prev_bit;
+        hdr.samples = sm->hyp_samples;
+        hdr.last_output = sm->last_output;
+    } else {
+        hdr.prev_bit = sm->prev_bit;
+        hdr.last_output = UINT64_MAX;
+    }
+
+    memcpy(out, &hdr, sizeof(hdr));
+    out += sizeof(hdr);
+
+    for (i = 0; i < n; i++) {
+        struct snapshot_instance inst;
+        const uint8_t *data;
+
+        memset(&inst, 0, sizeof(inst));
+
+        if (sm->hyp != NULL) {
+            const struct hypothesis *h = &sm->hyp[i];
+            inst.state = (uint32_t) (h->curr_state - sm->states);
+            inst.num_bits = h->num_bits;
+            inst.elapsed = h->elapsed;
+            inst.count_monotonic = h->count_monotonic;
+            inst.start = h->start;
+            data = h->data;
+        } else {
+            inst.state = (uint32_t) (sm->curr_state - sm->states);
+            inst.num_bits = sm->num_bits;
+            inst.elapsed = sm->elapsed;
+            inst.count_monotonic = sm->count_monotonic;
+            data = sm->data;
+        }
+
+        memcpy(out, &inst, sizeof(inst));
+        out += sizeof(inst);
+        memcpy(out, data, num_bytes);
+        out += num_bytes;
+    }
+
+    return hdr.size;
+}
+
+size_t sm_restore(struct state_machine *sm, const void *buf, size_t len)
+{
+    const size_t num_bytes = (sm->max_bits + 7) / 8;
+    const unsigned int capacity = (sm->hyp != NULL) ? sm->max_hyp : 1;
+    const uint8_t *in = (const uint8_t *) buf;
+    struct snapshot_header hdr;
+    struct snapshot_instance inst;
+    unsigned int i;
+
+    if (len < sizeof(hdr)) {
+        log_error("State machine snapshot is truncated.\n");
+        return 0;
+    }
+
+    memcpy(&hdr, in, sizeof(hdr));
+
+    if (hdr.magic != SNAPSHOT_MAGIC || hdr.version != SNAPSHOT_VERSION) {
+        log_error("Invalid state machine snapshot.\n");
+        return 0;
+    } else if (hdr.fingerprint != fingerprint(sm)) {
+        log_error("State machine snapshot is of a different state machine.\n");
+        return 0;
+    } else if (hdr.num_instances == 0 || hdr.num_instances > capacity) {
+        log_error("State machine snapshot has %u hypotheses; up to %u "
+                  "are supported.\n", hdr.num_instances, capacity);
+        return 0;
+    } else if (hdr.size != snapshot_len(sm, hdr.num_instances) ||
+               len < hdr.size) {
+        log_error("State machine snapshot is truncated.\n");
+        return 0;
+    }
+
+    /* Validate all instances before modifying anything */
+    in += sizeof(hdr);
+    for (i = 0; i < hdr.num_instances; i++) {
+        memcpy(&inst, in + i * (sizeof(inst) + num_bytes), sizeof(inst));
+        if (inst.state >= sm->num_states || inst.num_bits > sm->max_bits) {
+            log_error("State machine snapshot is corrupt.\n");
+            return 0;
+        }
+    }
+
+    for (i = 0; i < hdr.num_instances; i++) {
+        const uint8_t *data = in + sizeof(inst);
+
+        memcpy(&inst, in, sizeof(inst));
+        in += sizeof(inst) + num_bytes;
+
+        if (sm->hyp != NULL) {
+            struct hypothesis *h = &sm->hyp[i];
+            h->curr_state = &sm->states[inst.state];
+            h->num_bits = inst.num_bits;
+            h->elapsed = inst.elapsed;
+            h->count_monotonic = inst.count_monotonic;
+            h->start = inst.start;
+            h->run_offset = 0;
+            memcpy(h->data, data, num_bytes);
+        } else {
+            sm->curr_state = &sm->states[inst.state];
+            sm->num_bits = inst.num_bits;
+            sm->elapsed = inst.elapsed;
+            sm->count_monotonic = inst.count_monotonic;
+            sm->run_offset = 0;
+            memcpy(sm->data, data, num_bytes);
+        }
+    }
+
+    if (sm->hyp != NULL) {
+        sm->num_hyp = hdr.num_instances;
+        sm->hyp_prev_bit = hdr.prev_bit != 0;
+        sm->hyp_run_started = false;
+        sm->hyp_samples = hdr.samples;
+        sm->last_output = hdr.last_output;
+    } else {
+        sm->prev_bit = hdr.prev_bit != 0;
+    }
+
+    return hdr.size;
+}
+
+void sm_use_table(struct state_machine *sm, bool enable)
+{
+    sm->use_table = enable && (sm->table != NULL);
+}
+
 /* Get a pointer to the specified state. If it's not in our state list,
  * we'll reserve room for it and return a pointer to it.
  *
@@ -275,6 +912,10 @@ bool sm_add_state(struct state_machine *sm, const char *name,
 
     s->duration_us = duration_us;
     s->timeout_us = timeout_us;
+
+    s->window = to_window(sm, duration_us);
+    s->timeout = (timeout_us != 0) ? samples_at_least(sm, timeout_us) :
+                                     UINT64_MAX;
     s->num_triggers = num_triggers;
 
     if (s->num_triggers != 0) {
@@ -320,6 +961,7 @@ bool sm_add_state_trigger(struct state_machine *sm,
 
             s->triggers[i].condition = condition;
             s->triggers[i].duration_us = duration_us;
+            s->triggers[i].window = to_window(sm, duration_us);
             s->triggers[i].action = action;
             s->triggers[i].next_state = get_or_reserve_state(sm, next_state);
             return s->triggers[i].next_state != NULL;
@@ -418,14 +1060,19 @@ static inline enum sm_process_result handle_actions(struct state_machine *sm,
     return result;
 }
 
-static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm,
-                                                        bool b)
+/* Find the trigger that fires at the current sample, if any, by evaluating
+ * each of the current state's triggers in turn. This is the reference for
+ * find_trigger_compiled().
+ *
+ * Returns false if an invalid trigger is encountered. */
+static inline bool find_trigger_interpreted(const struct state_machine *sm,
+                                            bool b,
+                                            const struct trigger **active,
+                                            bool *check_duration)
 {
     unsigned int i;
     const unsigned int num_triggers = sm->curr_state->num_triggers;
     const struct trigger *active_trigger = NULL;
-    bool check_duration = false;
-    enum sm_process_result result = SM_PROCESS_RESULT_NO_OUTPUT;
 
     for (i = 0; i < num_triggers && active_trigger == NULL; i++) {
         const struct trigger *t = &sm->curr_state->triggers[i];
@@ -441,7 +1088,7 @@ static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm
                 case SM_TRIGGER_COND_PULSE_START:
                     if (sm->prev_bit == false && b == true) {
                         active_trigger = t;
-                        check_duration = true;
+                        *check_duration = true;
                         log_verbose("{%s} Pulse Start trigger @ sample %"PRIu64"\n",
                                     sm->curr_state->name, sm->count_monotonic);
                     }
@@ -450,15 +1097,14 @@ static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm
                 case SM_TRIGGER_COND_PULSE_END:
                     if (sm->prev_bit == true && b == false) {
                         active_trigger = t;
-                        check_duration = true;
+                        *check_duration = true;
                         log_verbose("{%s} Pulse End trigger @ sample %"PRIu64"\n",
                                     sm->curr_state->name, sm->count_monotonic);
                     }
                     break;
 
                 case SM_TRIGGER_COND_TIMEOUT:
-                    if (sm->curr_state->timeout_us != 0 &&
-                        sm->elapsed_us >= sm->curr_state->timeout_us) {
+                    if (sm->elapsed >= sm->curr_state->timeout) {
 
                         active_trigger = t;
                         log_verbose("{%s} Timeout trigger @ sample %"PRIu64"\n",
@@ -477,11 +1123,69 @@ static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm
                 default:
                     log_critical("Invalid trigger encoutered in state %s: %d\n",
                                 sm->curr_state->name, t->condition);
-                    return SM_PROCESS_RESULT_ERROR;
+                    return false;
             }
         }
     }
 
+    *active = active_trigger;
+    return true;
+}
+
+/* Find the trigger that fires at the current sample, if any, via the
+ * compiled transition table */
+static inline const struct trigger *
+find_trigger_compiled(const struct state_machine *sm, bool b,
+                      bool *check_duration)
+{
+    unsigned int i, events = 0;
+    const struct transition *trans;
+
+    if (sm->prev_bit != b) {
+        events |= b ? EVENT_PULSE_START : EVENT_PULSE_END;
+    }
+
+    if (sm->elapsed >= sm->curr_state->timeout) {
+        events |= EVENT_TIMEOUT;
+    }
+
+    if (sm->num_bits >= sm->max_bits) {
+        events |= EVENT_MSG_COMPLETE;
+    }
+
+    trans = &sm->table[(sm->curr_state - sm->states) * NUM_EVENT_SETS + events];
+
+    for (i = 0; i < trans->num_triggers; i++) {
+        const struct trigger *t = trans->triggers[i];
+
+        if (matches_trigger_duration(sm, t)) {
+            log_verbose("{%s} Trigger (condition=%d) @ sample %"PRIu64"\n",
+                        sm->curr_state->name, t->condition,
+                        sm->count_monotonic);
+
+            *check_duration = (t->condition == SM_TRIGGER_COND_PULSE_START ||
+                               t->condition == SM_TRIGGER_COND_PULSE_END);
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm,
+                                                        bool b)
+{
+    const struct trigger *active_trigger = NULL;
+    bool check_duration = false;
+    enum sm_process_result result = SM_PROCESS_RESULT_NO_OUTPUT;
+
+    if (sm->use_table) {
+        active_trigger = find_trigger_compiled(sm, b, &check_duration);
+    } else if (!find_trigger_interpreted(sm, b, &active_trigger,
+                                         &check_duration)) {
+        return SM_PROCESS_RESULT_ERROR;
+    }
+
     if (active_trigger != NULL) {
         bool expected_duration = matches_state_duration(sm, check_duration);
 
@@ -499,7 +1203,7 @@ static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm
         } else {
             result = SM_PROCESS_RESULT_ERROR;
             log_debug("{%s} Encountered invalid duration: %f, expected %f. ",
-                      sm->curr_state->name, sm->elapsed_us,
+                      sm->curr_state->name, to_duration_us(sm, sm->elapsed),
                       (double) sm->curr_state->duration_us);
         }
 
@@ -508,10 +1212,10 @@ static inline enum sm_process_result handle_rx_triggers(struct state_machine *sm
             sm->curr_state = &sm->states[STATE_RESET];
         }
 
-        sm->elapsed_us = 0;
+        sm->elapsed = 0;
 
     } else {
-        sm->elapsed_us += to_duration_us(sm, 1);
+        sm->elapsed++;
     }
 
     sm->count_monotonic++;
@@ -538,7 +1242,8 @@ static int process(struct state_machine *sm, bool bits)
     return handle_rx_triggers(sm, bits);
 }
 
-enum sm_process_result sm_process(struct state_machine *sm, const bool *data,
+enum sm_process_result sm_process(struct state_machine *sm,
+                                  const uint64_t *data, unsigned int offset,
                                   unsigned int count, unsigned int *num_proc)
 {
     unsigned int i;
@@ -547,14 +1252,347 @@ enum sm_process_result sm_process(struct state_machine *sm, const bool *data,
     assert(sm->curr_state != NULL);
 
     for (i = 0; i < count && result == SM_PROCESS_RESULT_NO_OUTPUT; i++) {
-        result = process(sm, data[i]);
-        sm->prev_bit = data[i];
+        const unsigned int n = offset + i;
+        const bool bit = (data[n / 64] >> (n % 64)) & 1;
+
+        result = process(sm, bit);
+        sm->prev_bit = bit;
     }
 
     *num_proc = i;
     return result;
 }
 
+/* Number of upcoming samples for which none of the current state's triggers
+ * can fire, provided the samples continue the level of the previous one.
+ *
+ * Pulse triggers require an edge, and the remaining conditions only change
+ * with elapsed time, so this is the number of samples before the earliest
+ * time at which any other trigger could fire. */
+static uint64_t quiet_samples(const struct state_machine *sm)
+{
+    unsigned int i;
+    uint64_t quiet = UINT64_MAX;
+    const struct state *s = sm->curr_state;
+
+    for (i = 0; i < s->num_triggers; i++) {
+        const struct trigger *t = &s->triggers[i];
+        uint64_t start = 0;
+
+        switch (t->condition) {
+            case SM_TRIGGER_COND_ALWAYS:
+                break;
+
+            case SM_TRIGGER_COND_PULSE_START:
+            case SM_TRIGGER_COND_PULSE_END:
+                continue;
+
+            case SM_TRIGGER_COND_TIMEOUT:
+                if (s->timeout == UINT64_MAX) {
+                    continue;
+                }
+                start = s->timeout;
+                break;
+
+            case SM_TRIGGER_COND_MSG_COMPLETE:
+                if (sm->num_bits < sm->max_bits) {
+                    continue;
+                }
+                break;
+
+            default:
+                /* Leave it to handle_rx_triggers() to report this */
+                return 0;
+        }
+
+        /* This trigger's window has already passed */
+        if (sm->elapsed > t->window.max) {
+            continue;
+        }
+
+        if (t->window.min > start) {
+            start = t->window.min;
+        }
+
+        if (start <= sm->elapsed) {
+            return 0;
+        } else if (start - sm->elapsed < quiet) {
+            quiet = start - sm->elapsed;
+        }
+    }
+
+    return quiet;
+}
+
+/* Process samples of a run, from sm->run_offset, until the end of the run or
+ * a result other than SM_PROCESS_RESULT_NO_OUTPUT */
+static enum sm_process_result process_run(struct state_machine *sm,
+                                          bool bit, unsigned int length)
+{
+    enum sm_process_result result = SM_PROCESS_RESULT_NO_OUTPUT;
+
+    while (sm->run_offset < length) {
+        /* Skip ahead to the next sample at which a trigger may fire.
+         * The reset state is excluded, as process() runs its triggers
+         * twice per sample. */
+        if (bit == sm->prev_bit &&
+            sm->curr_state != &sm->states[STATE_RESET]) {
+
+            uint64_t skip = quiet_samples(sm);
+
+            if (skip > length - sm->run_offset) {
+                skip = length - sm->run_offset;
+            }
+
+            sm->elapsed += skip;
+            sm->count_monotonic += skip;
+            sm->run_offset += skip;
+
+            if (sm->run_offset == length) {
+                break;
+            }
+        }
+
+        result = process(sm, bit);
+        sm->prev_bit = bit;
+        sm->run_offset++;
+
+        if (result != SM_PROCESS_RESULT_NO_OUTPUT) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+static void load_hypothesis(struct state_machine *sm,
+                            const struct hypothesis *h, bool bit)
+{
+    sm->curr_state = h->curr_state;
+    sm->elapsed = h->elapsed;
+    sm->num_bits = h->num_bits;
+    sm->run_offset = h->run_offset;
+    sm->count_monotonic = h->count_monotonic;
+    sm->data = h->data;
+    sm->prev_bit = (h->run_offset == 0) ? sm->hyp_prev_bit : bit;
+}
+
+static void save_hypothesis(const struct state_machine *sm,
+                            struct hypothesis *h)
+{
+    h->curr_state = sm->curr_state;
+    h->elapsed = sm->elapsed;
+    h->num_bits = sm->num_bits;
+    h->run_offset = sm->run_offset;
+    h->count_monotonic = sm->count_monotonic;
+}
+
+/* Remove hypotheses for which keep() is false, preserving the order of the
+ * rest. Their data buffers are retained for reuse. */
+static void remove_hypotheses(struct state_machine *sm,
+                              bool (*keep)(const struct state_machine *sm,
+                                           unsigned int i, const void *arg),
+                              const void *arg)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < sm->num_hyp; i++) {
+        if (keep(sm, i, arg)) {
+            struct hypothesis tmp = sm->hyp[n];
+            sm->hyp[n++] = sm->hyp[i];
+            sm->hyp[i] = tmp;
+        }
+    }
+
+    sm->num_hyp = n;
+}
+
+/* Keep hypotheses that began no later than the specified sample */
+static bool began_before(const struct state_machine *sm, unsigned int i,
+                         const void *arg)
+{
+    return sm->hyp[i].start <= *(const uint64_t *) arg;
+}
+
+/* Keep hypotheses unless they duplicate an older one. Idle instances are
+ * equivalent, as their next transition is on the next pulse. */
+static bool is_unique(const struct state_machine *sm, unsigned int i,
+                      const void *arg)
+{
+    const struct hypothesis *h = &sm->hyp[i];
+    const bool idle = is_idle_state(sm, h->curr_state);
+    unsigned int j;
+
+    (void) arg;
+
+    for (j = 0; j < i; j++) {
+        const struct hypothesis *o = &sm->hyp[j];
+
+        if (idle && is_idle_state(sm, o->curr_state)) {
+            return false;
+        }
+
+        if (o->curr_state == h->curr_state && o->elapsed == h->elapsed &&
+            o->num_bits == h->num_bits &&
+            !memcmp(o->data, h->data, (sm->max_bits + 7) / 8)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Start a hypothesis at a pulse that may be the start of a message. This is
+ * unnecessary if an idle instance will already treat it as such. */
+static void start_hypothesis(struct state_machine *sm,
+                             const struct dig_run *runs, unsigned int r,
+                             unsigned int count)
+{
+    const unsigned int length = runs[r].length;
+    struct hypothesis *h;
+    unsigned int i;
+
+    if (!runs[r].level || sm->hyp_prev_bit || sm->num_hyp == sm->max_hyp) {
+        return;
+    }
+
+    /* The pulse is too long, or too short unless it continues into the
+     * next call */
+    if (length > sm->preamble_max ||
+        (length < sm->preamble_min && r + 1 < count)) {
+        return;
+    }
+
+    for (i = 0; i < sm->num_hyp; i++) {
+        if (is_idle_state(sm, sm->hyp[i].curr_state)) {
+            return;
+        }
+    }
+
+    h = &sm->hyp[sm->num_hyp++];
+    h->curr_state = &sm->states[STATE_RESET];
+    h->elapsed = 0;
+    h->num_bits = 0;
+    h->run_offset = 0;
+    h->count_monotonic = sm->hyp[0].count_monotonic;
+    h->start = sm->hyp_samples;
+
+    log_verbose("Started hypothesis %u @ sample %"PRIu64"\n",
+                sm->num_hyp - 1, h->start);
+}
+
+/* sm_process_runs(), for each of the concurrent hypotheses. A hypothesis
+ * which encounters an invalid duration returns to its reset state and
+ * continues, so errors are not reported. */
+static enum sm_process_result process_runs_hypotheses(
+                                            struct state_machine *sm,
+                                            const struct dig_run *runs,
+                                            unsigned int count,
+                                            unsigned int *num_proc)
+{
+    const size_t num_bytes = (sm->max_bits + 7) / 8;
+    unsigned int r, i;
+
+    for (r = 0; r < count; r++) {
+        const bool bit = runs[r].level;
+        const unsigned int length = runs[r].length;
+
+        if (!sm->hyp_run_started) {
+            start_hypothesis(sm, runs, r, count);
+            sm->hyp_run_started = true;
+        }
+
+        for (i = 0; i < sm->num_hyp; i++) {
+            struct hypothesis *h = &sm->hyp[i];
+
+            while (h->run_offset < length) {
+                enum sm_process_result result;
+                uint64_t pos, start;
+
+                load_hypothesis(sm, h, bit);
+                result = process_run(sm, bit, length);
+                save_hypothesis(sm, h);
+
+                if (result != SM_PROCESS_RESULT_OUTPUT_READY) {
+                    continue;
+                }
+
+                /* Merge output duplicated by another hypothesis */
+                pos = sm->hyp_samples + h->run_offset;
+                if (pos == sm->last_output &&
+                    !memcmp(sm->output, h->data, num_bytes)) {
+                    continue;
+                }
+
+                memcpy(sm->output, h->data, num_bytes);
+                sm->last_output = pos;
+                sm->output_offset = h->run_offset;
+
+                /* Hypotheses started within this message are moot */
+                start = h->start;
+                remove_hypotheses(sm, began_before, &start);
+
+                *num_proc = r;
+                return SM_PROCESS_RESULT_OUTPUT_READY;
+            }
+        }
+
+        for (i = 0; i < sm->num_hyp; i++) {
+            sm->hyp[i].run_offset = 0;
+        }
+
+        remove_hypotheses(sm, is_unique, NULL);
+
+        sm->hyp_prev_bit = bit;
+        sm->hyp_run_started = false;
+        sm->hyp_samples += length;
+    }
+
+    *num_proc = r;
+    return SM_PROCESS_RESULT_NO_OUTPUT;
+}
+
+enum sm_process_result sm_process_runs(struct state_machine *sm,
+                                       const struct dig_run *runs,
+                                       unsigned int count,
+                                       unsigned int *num_proc)
+{
+    unsigned int r;
+    enum sm_process_result result = SM_PROCESS_RESULT_NO_OUTPUT;
+
+    assert(sm->curr_state != NULL);
+
+    if (sm->hyp != NULL) {
+        return process_runs_hypotheses(sm, runs, count, num_proc);
+    }
+
+    for (r = 0; r < count && result == SM_PROCESS_RESULT_NO_OUTPUT; r++) {
+        const unsigned int length = runs[r].length;
+
+        result = process_run(sm, runs[r].level, length);
+
+        /* Resume a partially processed run on the next call */
+        if (result == SM_PROCESS_RESULT_OUTPUT_READY &&
+            sm->run_offset < length) {
+            break;
+        }
+
+        sm->run_offset = 0;
+    }
+
+    if (result == SM_PROCESS_RESULT_OUTPUT_READY) {
+        sm->output_offset = sm->run_offset;
+    }
+
+    *num_proc = r;
+    return result;
+}
+
+unsigned int sm_output_offset(const struct state_machine *sm)
+{
+    return sm->output_offset;
+}
+
 
 
 
@@ -883,6 +1921,10 @@ void sm_deinit(struct state_machine *sm)
         }
 
         free(sm->states);
+        free(sm->table);
+        free(sm->table_triggers);
+        free(sm->hyp);
+        free(sm->hyp_data);
         free(sm);
     }
 }
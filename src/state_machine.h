@@ -23,9 +23,11 @@
 #define OOKIEDOKIE_STATE_MACHINE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "complexf.h"
+#include "threshold.h"
 
 /**
  * State machine trigger conditions
@@ -78,7 +80,8 @@ struct state_machine;
  *                          asserting that output data is available.
  *
  * @param   sample_rate     Sample rate of input. Used internally to convert
- *                          sample counts to microseconds.
+ *                          the durations and timeouts of states and triggers
+ *                          to sample counts, as they are added.
  *
  * @return state_machine handle on success, or NULL if an error occurred.
  */
@@ -153,12 +156,152 @@ enum sm_trigger_action sm_trigger_action_value(const char *string);
  */
 bool sm_initialized(struct state_machine *sm);
 
+/**
+ * Compile the state machine's states and triggers into a transition table,
+ * indexed by state and by the set of events (pulse start/end, timeout,
+ * message completion) occurring at a sample. Each entry lists the triggers
+ * those events could activate, in priority order, such that processing a
+ * sample requires a single lookup rather than a scan of every trigger.
+ *
+ * Once compiled, the table is used when processing received samples. This
+ * must be called after all sm_add_state() and sm_add_state_trigger() calls.
+ *
+ * @param   sm      State machine to compile
+ *
+ * @return true on success, or false if the state machine is not fully
+ *         initialized, is invalid, or if memory allocation failed.
+ */
+bool sm_compile(struct state_machine *sm);
+
+/**
+ * Get the range of lengths of the first pulse of a message that the state
+ * machine may accept, as determined by sm_compile(). When the state machine
+ * is idle (see sm_idle()), any other pulse is guaranteed to return it to
+ * idle, so such pulses need not be passed to it.
+ *
+ * This is only available for state machines whose reset state leads to a
+ * state awaiting a pulse, whose duration is bounded.
+ *
+ * @param[in]   sm          State machine
+ * @param[out]  min_len     Minimum pulse length, in samples
+ * @param[out]  max_len     Maximum pulse length, in samples
+ *
+ * @return true if the range is available, false otherwise
+ */
+bool sm_preamble(const struct state_machine *sm,
+                 uint64_t *min_len, uint64_t *max_len);
+
+/**
+ * Determine whether the state machine is idle: it is awaiting the first
+ * pulse of a message, and has fully processed the last run passed to
+ * sm_process_runs(). This is always false if sm_preamble() is not available.
+ *
+ * @param   sm      State machine
+ *
+ * @return true if idle, false otherwise
+ */
+bool sm_idle(const struct state_machine *sm);
+
+/**
+ * Return the state machine to its reset state, as though the last sample
+ * processed was a 0. An idle state machine (see sm_idle()) may be reset in
+ * order to resume processing at the start of a pulse, having skipped the
+ * samples before it.
+ *
+ * @param   sm      State machine
+ */
+void sm_reset(struct state_machine *sm);
+
+/**
+ * Decode up to `max` concurrent hypotheses of where a message begins.
+ *
+ * Ordinarily, a pulse of unexpected duration returns the state machine to
+ * its reset state, and that pulse is discarded. If it was the first pulse
+ * of a message overlapping the one that failed, that message is lost. With
+ * hypotheses enabled, a new receiver instance is started at each pulse whose
+ * length is within the preamble range (see sm_preamble()), unless an idle
+ * instance exists to accept it. Each instance is independent. When one
+ * outputs a message, instances started after it are discarded, as are
+ * instances that become identical to an older one.
+ *
+ * This has no effect if sm_preamble() is not available, or if `max` is 1 or
+ * less. It must be called after sm_compile(), and may only be called once.
+ *
+ * @param   sm      State machine to update
+ * @param   max     Maximum number of concurrent instances
+ *
+ * @return true on success, false if memory allocation failed
+ */
+bool sm_set_hypotheses(struct state_machine *sm, unsigned int max);
+
+/**
+ * Get the maximum size of a snapshot of the state machine, as produced by
+ * sm_snapshot()
+ *
+ * @param   sm      State machine
+ *
+ * @return Snapshot size, in bytes
+ */
+size_t sm_snapshot_size(const struct state_machine *sm);
+
+/**
+ * Capture the receive state of a state machine: its current state(s), elapsed
+ * sample counts, partially received data, and the last sample's level. The
+ * snapshot is plain data, and may be restored into this or another instance
+ * of the same state machine via sm_restore(), such that the latter continues
+ * receiving where the former stopped.
+ *
+ * Snapshots use the host's byte order and are not portable between hosts.
+ * A snapshot must be taken between sm_process_runs() calls, after all runs
+ * passed to it were processed.
+ *
+ * @param[in]   sm      State machine
+ * @param[out]  buf     Buffer to write the snapshot to
+ * @param[in]   len     Length of `buf`, in bytes. A buffer of
+ *                      sm_snapshot_size() bytes is always sufficient.
+ *
+ * @return Number of bytes written, or 0 if `buf` is too small or the state
+ *         machine is partway through a run
+ */
+size_t sm_snapshot(const struct state_machine *sm, void *buf, size_t len);
+
+/**
+ * Restore the receive state captured by sm_snapshot(). The state machine must
+ * have the same states, triggers and sample rate as the one the snapshot was
+ * taken of, and if the snapshot holds more than one hypothesis, at least as
+ * many must be enabled via sm_set_hypotheses().
+ *
+ * @param   sm      State machine to update
+ * @param   buf     Snapshot
+ * @param   len     Length of `buf`, in bytes. This may exceed the length of
+ *                  the snapshot.
+ *
+ * @return Number of bytes of `buf` consumed, or 0 if the snapshot is invalid
+ *         or does not match the state machine, in which case the state
+ *         machine is left unmodified.
+ */
+size_t sm_restore(struct state_machine *sm, const void *buf, size_t len);
+
+/**
+ * Select whether received samples are processed using the transition table
+ * built by sm_compile(), or by evaluating each of the current state's
+ * triggers in turn. The latter is the reference implementation, and is
+ * intended for debugging. The results of the two are identical.
+ *
+ * @param   sm      State machine to update
+ * @param   enable  Use the table, if sm_compile() succeeded
+ */
+void sm_use_table(struct state_machine *sm, bool enable);
+
 /**
  * Process received samples.
  *
  * @param[in]   sm          State machine to pass samples through
- * @param[in]   data        Data to process
- * @param[in]   count       Number of values in data
+ * @param[in]   data        Bit-packed digital samples. Sample i is bit
+ *                          (i % 64) of data[i / 64], where bit 0 is the
+ *                          least significant bit.
+ * @param[in]   offset      Index of the first sample in `data` to process
+ * @param[in]   count       Number of samples to process
  * @param[out]  num_proc    Actual number of items processed (<= count).
  *
  * @return An sm_process_result value denoting the result of the operation.
@@ -168,11 +311,59 @@ bool sm_initialized(struct state_machine *sm);
  *
  * @note When SM_PROCESS_RESULT_OUTPUT_READY is returned, num_processed
  *       will be set to <= count; you many need to call this function again
- *       with &data[num_processed], (count - *num_processed).
+ *       with (offset + *num_proc), (count - *num_proc).
  */
-enum sm_process_result sm_process(struct state_machine *sm, const bool *data,
+enum sm_process_result sm_process(struct state_machine *sm,
+                                  const uint64_t *data, unsigned int offset,
                                   unsigned int count, unsigned int *num_proc);
 
+/**
+ * Process received samples, as runs of identical samples.
+ *
+ * This is equivalent to sm_process(), but the state machine's triggers are
+ * only evaluated at the edges between runs and at the samples where a timeout
+ * or trigger duration may be reached. This is considerably cheaper than
+ * evaluating them for every sample, as signals tend to be flat for long
+ * periods.
+ *
+ * @param[in]   sm          State machine to pass samples through
+ * @param[in]   runs        Runs of samples, as produced by dig_to_runs().
+ *                          Adjacent runs may have the same level.
+ * @param[in]   count       Number of runs to process
+ * @param[out]  num_proc    Number of runs fully processed (<= count).
+ *
+ * @return An sm_process_result value denoting the result of the operation.
+ *
+ * @note When SM_PROCESS_RESULT_OUTPUT_READY is returned, the data buffer
+ *       passed to sm_init *must* be read before another call to
+ *       sm_process_runs().
+ *
+ * @note When SM_PROCESS_RESULT_OUTPUT_READY is returned, call this function
+ *       again with &runs[*num_proc], (count - *num_proc). If output became
+ *       ready partway through a run, that run is not included in *num_proc,
+ *       and processing resumes after the last sample processed.
+ *
+ * @note When SM_PROCESS_RESULT_ERROR is returned, the remainder of the run
+ *       being processed is discarded. This is never returned when
+ *       hypotheses are enabled via sm_set_hypotheses().
+ */
+enum sm_process_result sm_process_runs(struct state_machine *sm,
+                                       const struct dig_run *runs,
+                                       unsigned int count,
+                                       unsigned int *num_proc);
+
+/**
+ * Get the position at which output last became ready. When sm_process_runs()
+ * returns SM_PROCESS_RESULT_OUTPUT_READY, output became ready once this many
+ * samples of runs[*num_proc] had been processed, following all of the runs
+ * counted in *num_proc. This may be 0, or the length of runs[*num_proc].
+ *
+ * @param   sm      State machine
+ *
+ * @return Number of samples
+ */
+unsigned int sm_output_offset(const struct state_machine *sm);
+
 /**
  * Generate samples for the provided data. This function expects to
  * receive all data in a single call.
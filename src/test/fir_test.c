@@ -26,12 +26,14 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <errno.h>
+#include <time.h>
 #include <jansson.h>
 
 #include "conversions.h"
 #include "fir.h"
 #include "find.h"
 #include "log.h"
+#include "sc16q11.h"
 
 #define BUF_LEN 4096
 
@@ -47,6 +49,24 @@ void usage(const char *argv0)
     printf("[count] is the number of samples to process during each filtering "
            "operation.\n");
     printf("\n");
+    printf("The FIR_KERNEL environment variable may be set to one of the\n");
+    printf("following to override the default convolution kernel:\n");
+    printf("  scalar, sse2, avx2, avx512\n");
+    printf("\n");
+    printf("If the FIR_FIXED_POINT environment variable is set to 1, input\n");
+    printf("samples are converted to SC16Q11 and filtered in fixed point.\n");
+    printf("\n");
+    printf("Samples are filtered in planar form. If the FIR_INTERLEAVED\n");
+    printf("environment variable is set to 1, interleaved samples are\n");
+    printf("provided to the filter, via its compatibility wrapper.\n");
+    printf("\n");
+    printf("If the FIR_THREADS environment variable is set to a value N\n");
+    printf("greater than 0, the filter's stages are run on the calling\n");
+    printf("thread and up to N worker threads.\n");
+    printf("\n");
+    printf("If the FIR_PRINT_PLAN environment variable is set to 1, the\n");
+    printf("filter's stages and their estimated cost are printed to stderr.\n");
+    printf("\n");
 }
 
 struct complexf * load_input(const char *filename, size_t *input_len)
@@ -132,6 +152,13 @@ out:
     return ret;
 }
 
+static double elapsed_sec(const struct timespec *start,
+                          const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
 void setup_log_level()
 {
     bool ok;
@@ -153,6 +180,7 @@ int main(int argc, char *argv[])
 {
     int status = 0;
     unsigned int total_decimation = 1;
+    const char *kernel;
 
     FILE *outfile = NULL;
     struct fir_filter *filter = NULL;
@@ -160,6 +188,16 @@ int main(int argc, char *argv[])
     struct complexf *sig_in = NULL;
     size_t sig_in_len = 0;
 
+    const char *fixed_env;
+    int16_t *sig_in_sc16 = NULL;
+
+    const char *interleaved_env;
+    const char *plan_env;
+    const char *threads_env;
+    bool interleaved = false;
+    struct complexf_planar planar_in = { NULL, NULL };
+    struct complexf_planar planar_out = { NULL, NULL };
+
     struct complexf *sig_out = NULL;
     size_t sig_out_len = 0;
 
@@ -167,6 +205,9 @@ int main(int argc, char *argv[])
     size_t to_proc = 0;
     size_t n_out= 0;
 
+    struct timespec start, end;
+    double filter_time = 0;
+
     /* How many input samples we process per filtering operation */
     unsigned int chunk_size = 32;
 
@@ -199,6 +240,13 @@ int main(int argc, char *argv[])
         goto out;
     }
 
+    kernel = getenv("FIR_KERNEL");
+    if (kernel && !fir_set_kernel(filter, kernel)) {
+        log_error("Failed to select FIR kernel: %s\n", kernel);
+        status = EXIT_FAILURE;
+        goto out;
+    }
+
     total_decimation = fir_get_total_decimation(filter);
     if (total_decimation == 0) {
         log_error("Bug: Filter contains invalid decimation value!\n");
@@ -218,6 +266,61 @@ int main(int argc, char *argv[])
 
     log_info("Loaded %zd input samples from %s\n", sig_in_len, argv[2]);
 
+    fixed_env = getenv("FIR_FIXED_POINT");
+    if (fixed_env && !strcmp(fixed_env, "1")) {
+        if (!fir_enable_fixed_point(filter)) {
+            log_error("Failed to enable fixed point operation.\n");
+            status = EXIT_FAILURE;
+            goto out;
+        }
+
+        sig_in_sc16 = malloc(2 * sig_in_len * sizeof(sig_in_sc16[0]));
+        if (!sig_in_sc16) {
+            log_error("Failed to allocate SC16Q11 input buffer: %s\n",
+                      strerror(errno));
+            status = EXIT_FAILURE;
+            goto out;
+        }
+
+        complexf_to_sc16q11(sig_in, sig_in_sc16, sig_in_len);
+    }
+
+    threads_env = getenv("FIR_THREADS");
+    if (threads_env) {
+        bool ok;
+        unsigned int threads = str2uint(threads_env, 0, UINT_MAX, &ok);
+
+        if (!ok) {
+            log_error("Invalid FIR_THREADS value: %s\n", threads_env);
+            status = EXIT_FAILURE;
+            goto out;
+        }
+
+        if (!fir_enable_pipeline(filter, threads, NULL, 0)) {
+            log_error("Failed to enable pipelined operation.\n");
+            status = EXIT_FAILURE;
+            goto out;
+        }
+    }
+
+    plan_env = getenv("FIR_PRINT_PLAN");
+    if (plan_env && !strcmp(plan_env, "1")) {
+        fir_print_plan(filter, stderr, 0);
+    }
+
+    interleaved_env = getenv("FIR_INTERLEAVED");
+    interleaved = interleaved_env && !strcmp(interleaved_env, "1");
+
+    if (!interleaved && !sig_in_sc16) {
+        if (!complexf_planar_alloc(&planar_in, sig_in_len)) {
+            log_error("Failed to allocate planar input buffer.\n");
+            status = EXIT_FAILURE;
+            goto out;
+        }
+
+        complexf_deinterleave(sig_in, &planar_in, sig_in_len);
+    }
+
     outfile = fopen(argv[3], "wb");
     if (!outfile) {
         log_error("Failed to open %s: %s\n", argv[3], strerror(errno));
@@ -239,6 +342,12 @@ int main(int argc, char *argv[])
         goto out;
     }
 
+    if (!interleaved && !complexf_planar_alloc(&planar_out, sig_out_len)) {
+        log_error("Failed to allocate planar output buffer.\n");
+        status = EXIT_FAILURE;
+        goto out;
+    }
+
     log_verbose("Top-level output buffer @ %p\n", sig_out);
 
     log_info("Processing input at %u samples per call.\n", chunk_size);
@@ -250,7 +359,32 @@ int main(int argc, char *argv[])
             to_proc = chunk_size;
         }
 
-        n_out = fir_filter_and_decimate(filter, &sig_in[i], to_proc, sig_out);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (sig_in_sc16 && interleaved) {
+            n_out = fir_filter_and_decimate_sc16q11(filter, &sig_in_sc16[2 * i],
+                                                    to_proc, sig_out);
+        } else if (sig_in_sc16) {
+            n_out = fir_filter_and_decimate_sc16q11_planar(filter,
+                                                           &sig_in_sc16[2 * i],
+                                                           to_proc,
+                                                           &planar_out);
+        } else if (interleaved) {
+            n_out = fir_filter_and_decimate(filter, &sig_in[i], to_proc,
+                                            sig_out);
+        } else {
+            const struct complexf_planar x = complexf_planar_offset(&planar_in,
+                                                                    i);
+
+            n_out = fir_filter_and_decimate_planar(filter, &x, to_proc,
+                                                   &planar_out);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        filter_time += elapsed_sec(&start, &end);
+
+        if (!interleaved) {
+            complexf_interleave(&planar_out, sig_out, n_out);
+        }
 
         if (n_out != 0) {
             size_t j, w;
@@ -274,6 +408,11 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (filter_time > 0) {
+        log_info("Filtered %zd samples in %.6f s (%.3f Msps)\n",
+                 sig_in_len, filter_time, sig_in_len / filter_time / 1e6);
+    }
+
 out:
     free(sig_out);
 
@@ -282,6 +421,9 @@ out:
     }
 
     free(sig_in);
+    free(sig_in_sc16);
+    complexf_planar_free(&planar_in);
+    complexf_planar_free(&planar_out);
     fir_deinit(filter);
 
     return status;
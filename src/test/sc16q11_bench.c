@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+
+#include "conversions.h"
+#include "complexf.h"
+#include "sc16q11.h"
+#include "log.h"
+
+#define DEFAULT_SAMPLES     (1 << 16)
+#define DEFAULT_ITERATIONS  2000
+
+static const char *impls[] = { "scalar", "sse4.1", "avx2" };
+
+void usage(const char *argv0)
+{
+    printf("Benchmark the SC16Q11 <-> complexf conversions.\n");
+    printf("\n");
+    printf("Usage: %s [samples] [iterations]\n", argv0);
+    printf("\n");
+    printf("Each conversion is run [iterations] times on a buffer of\n");
+    printf("[samples] samples, for each implementation supported by the\n");
+    printf("host CPU. Defaults: %d samples, %d iterations.\n",
+           DEFAULT_SAMPLES, DEFAULT_ITERATIONS);
+    printf("\n");
+    printf("Prior to timing, each implementation's output is checked\n");
+    printf("against that of the scalar implementation.\n");
+    printf("\n");
+}
+
+static double elapsed_sec(const struct timespec *start,
+                          const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Report the rate at which samples were converted, along with the memory
+ * bandwidth this corresponds to. Each sample is read in one format and
+ * written in the other. */
+static void report(const char *impl, const char *conversion,
+                   size_t samples, unsigned int iterations, double t)
+{
+    const double total = (double) samples * iterations;
+    const size_t bytes = 2 * sizeof(int16_t) + sizeof(struct complexf);
+
+    printf("%-7s %-20s %9.1f Msps  %7.2f GB/s\n", impl, conversion,
+           total / t / 1e6, total * bytes / t / 1e9);
+}
+
+static bool check(const char *impl, size_t n,
+                  const struct complexf *in, const int16_t *in_sc16,
+                  struct complexf *ref, struct complexf *out,
+                  const struct complexf_planar *ref_planar,
+                  const struct complexf_planar *out_planar,
+                  int16_t *ref_sc16, int16_t *out_sc16)
+{
+    bool ok = true;
+
+    sc16q11_select_impl("scalar");
+    sc16q11_to_complexf(in_sc16, ref, n);
+    sc16q11_to_complexf_planar(in_sc16, ref_planar, n);
+    complexf_to_sc16q11(in, ref_sc16, n);
+
+    sc16q11_select_impl(impl);
+    sc16q11_to_complexf(in_sc16, out, n);
+    sc16q11_to_complexf_planar(in_sc16, out_planar, n);
+    complexf_to_sc16q11(in, out_sc16, n);
+
+    if (memcmp(ref, out, n * sizeof(out[0]))) {
+        log_error("%s: sc16q11_to_complexf() output mismatch\n", impl);
+        ok = false;
+    }
+
+    if (memcmp(ref_planar->real, out_planar->real, n * sizeof(float)) ||
+        memcmp(ref_planar->imag, out_planar->imag, n * sizeof(float))) {
+        log_error("%s: sc16q11_to_complexf_planar() output mismatch\n", impl);
+        ok = false;
+    }
+
+    if (memcmp(ref_sc16, out_sc16, 2 * n * sizeof(out_sc16[0]))) {
+        log_error("%s: complexf_to_sc16q11() output mismatch\n", impl);
+        ok = false;
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int status = EXIT_SUCCESS;
+    size_t i, samples = DEFAULT_SAMPLES;
+    unsigned int iterations = DEFAULT_ITERATIONS;
+    unsigned int it;
+    bool ok;
+    struct timespec start, end;
+
+    struct complexf *in = NULL;
+    struct complexf *ref = NULL;
+    struct complexf *out = NULL;
+    int16_t *in_sc16 = NULL;
+    int16_t *ref_sc16 = NULL;
+    int16_t *out_sc16 = NULL;
+    struct complexf_planar ref_planar = { NULL, NULL };
+    struct complexf_planar out_planar = { NULL, NULL };
+
+    if (argc > 1) {
+        if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+            usage(argv[0]);
+            return 0;
+        }
+
+        samples = str2uint(argv[1], 1, UINT_MAX, &ok);
+        if (!ok) {
+            log_error("Invalid sample count: %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc > 2) {
+        iterations = str2uint(argv[2], 1, UINT_MAX, &ok);
+        if (!ok) {
+            log_error("Invalid iteration count: %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    in       = malloc(samples * sizeof(in[0]));
+    ref      = malloc(samples * sizeof(ref[0]));
+    out      = malloc(samples * sizeof(out[0]));
+    in_sc16  = malloc(2 * samples * sizeof(in_sc16[0]));
+    ref_sc16 = malloc(2 * samples * sizeof(ref_sc16[0]));
+    out_sc16 = malloc(2 * samples * sizeof(out_sc16[0]));
+
+    if (!in || !ref || !out || !in_sc16 || !ref_sc16 || !out_sc16 ||
+        !complexf_planar_alloc(&ref_planar, samples) ||
+        !complexf_planar_alloc(&out_planar, samples)) {
+        log_error("Failed to allocate buffers.\n");
+        status = EXIT_FAILURE;
+        goto out;
+    }
+
+    /* Cover the full SC16Q11 range, along with floating point values
+     * beyond [-1.0, 1.0) that must be saturated */
+    srand(0);
+    for (i = 0; i < samples; i++) {
+        in[i].real = 2.5f * ((float) rand() / RAND_MAX - 0.5f);
+        in[i].imag = 2.5f * ((float) rand() / RAND_MAX - 0.5f);
+        in_sc16[2 * i]     = (int16_t) (rand() % 4096 - 2048);
+        in_sc16[2 * i + 1] = (int16_t) (rand() % 4096 - 2048);
+    }
+
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        const char *impl = impls[i];
+
+        if (!sc16q11_select_impl(impl)) {
+            printf("%-7s not supported by this CPU\n", impl);
+            continue;
+        }
+
+        if (!check(impl, samples, in, in_sc16, ref, out,
+                   &ref_planar, &out_planar, ref_sc16, out_sc16)) {
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (it = 0; it < iterations; it++) {
+            sc16q11_to_complexf(in_sc16, out, samples);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        report(impl, "sc16q11_to_complexf", samples, iterations,
+               elapsed_sec(&start, &end));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (it = 0; it < iterations; it++) {
+            sc16q11_to_complexf_planar(in_sc16, &out_planar, samples);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        report(impl, "sc16q11_to_planar", samples, iterations,
+               elapsed_sec(&start, &end));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (it = 0; it < iterations; it++) {
+            complexf_to_sc16q11(in, out_sc16, samples);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        report(impl, "complexf_to_sc16q11", samples, iterations,
+               elapsed_sec(&start, &end));
+    }
+
+out:
+    free(in);
+    free(ref);
+    free(out);
+    free(in_sc16);
+    free(ref_sc16);
+    free(out_sc16);
+    complexf_planar_free(&ref_planar);
+    complexf_planar_free(&out_planar);
+
+    return status;
+}
@@ -0,0 +1,722 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "threshold.h"
+#include "log.h"
+
+#if ENABLE_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define HAVE_X86_IMPLS 1
+#   include <immintrin.h>
+#else
+#   define HAVE_X86_IMPLS 0
+#endif
+
+#ifndef ARRAY_SIZE
+#   define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
+#endif
+
+/* Produce `n` full words of digital samples. Any samples remaining after the
+ * last full word are handled by pack_word(). */
+typedef void (*threshold_fn)(const float *re, const float *im, size_t n,
+                             float level, enum threshold_mode mode,
+                             uint64_t *out);
+
+/* Statistics of a block of samples, used to adapt a slicer's levels */
+struct block_stats {
+    float noise_sum;        /* Sum of the values below the lower level */
+    size_t noise_count;     /* Number of values below the lower level */
+    float burst_sum;        /* Sum of the values at or above the upper level */
+    size_t burst_count;     /* Number of values at or above the upper level */
+};
+
+/* Accumulate statistics of `n` full words' worth of samples. Any samples
+ * remaining after the last full word are handled by stats_n(). */
+typedef void (*stats_fn)(const float *re, const float *im, size_t n,
+                         float below, float above,
+                         enum threshold_mode mode, struct block_stats *st);
+
+struct threshold_impl {
+    const char *name;
+    threshold_fn fn;
+    stats_fn stats;
+};
+
+struct threshold_slicer {
+    struct threshold_params params;
+    enum threshold_mode mode;
+    bool power;
+    unsigned int width;     /* Minimum run length, at least 1 */
+
+    uint64_t *hi;           /* Samples at or above the upper level */
+    uint64_t *lo;           /* Samples at or above the lower level */
+
+    float noise;            /* Noise floor magnitude */
+    float burst;            /* Burst magnitude */
+    float upper;            /* Levels, in terms of the compared quantity */
+    float lower;
+
+    bool level;             /* Output of the hysteresis comparison */
+    uint64_t since;         /* Sample at which `level` last changed */
+    bool out_level;         /* Output level, once runs are debounced */
+    uint64_t pos;           /* Number of samples processed */
+};
+
+/* Time constants, in samples, of the tracking of the noise floor and of
+ * the burst magnitude, and of the decay of the latter between bursts */
+#define NOISE_TIME_CONSTANT 65536.0f
+#define BURST_TIME_CONSTANT 256.0f
+#define BURST_DECAY         65536.0f
+
+/* Minimum ratio of the upper level to the noise floor, as magnitudes. This
+ * keeps the noise itself from being sliced between bursts. */
+#define NOISE_MARGIN        3.0f
+
+/* Placement of the upper level between the noise floor and the burst */
+#define BURST_FRACTION      0.5f
+
+/* Pack up to DIG_WORD_BITS samples into a word */
+static inline uint64_t pack_word(const float *re, const float *im, size_t n,
+                                 float level, enum threshold_mode mode)
+{
+    size_t i;
+    uint64_t word = 0;
+
+    if (mode == THRESHOLD_POWER) {
+        for (i = 0; i < n; i++) {
+            const float p = re[i] * re[i] + im[i] * im[i];
+            word |= (uint64_t) (p >= level) << i;
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            word |= (uint64_t) (re[i] >= level) << i;
+        }
+    }
+
+    return word;
+}
+
+static void threshold_scalar(const float *re, const float *im, size_t n,
+                             float level, enum threshold_mode mode,
+                             uint64_t *out)
+{
+    size_t w;
+
+    for (w = 0; w < n; w++) {
+        out[w] = pack_word(&re[w * DIG_WORD_BITS], &im[w * DIG_WORD_BITS],
+                           DIG_WORD_BITS, level, mode);
+    }
+}
+
+static inline void stats_n(const float *re, const float *im, size_t n,
+                           float below, float above,
+                           enum threshold_mode mode, struct block_stats *st)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        const float x = (mode == THRESHOLD_POWER) ?
+                        re[i] * re[i] + im[i] * im[i] : re[i];
+
+        if (x < below) {
+            st->noise_sum += x;
+            st->noise_count++;
+        }
+
+        if (x >= above) {
+            st->burst_sum += x;
+            st->burst_count++;
+        }
+    }
+}
+
+static void stats_scalar(const float *re, const float *im, size_t n,
+                         float below, float above,
+                         enum threshold_mode mode, struct block_stats *st)
+{
+    stats_n(re, im, n * DIG_WORD_BITS, below, above, mode, st);
+}
+
+#if HAVE_X86_IMPLS
+
+/* Each comparison yields a mask per lane, which movmskps gathers into the
+ * low bits of an integer, in lane order */
+__attribute__((target("sse2")))
+static void threshold_sse2(const float *re, const float *im, size_t n,
+                           float level, enum threshold_mode mode,
+                           uint64_t *out)
+{
+    size_t w, i;
+    const __m128 t = _mm_set1_ps(level);
+
+    for (w = 0; w < n; w++, re += DIG_WORD_BITS, im += DIG_WORD_BITS) {
+        uint64_t word = 0;
+
+        for (i = 0; i < DIG_WORD_BITS; i += 4) {
+            __m128 x = _mm_loadu_ps(&re[i]);
+
+            if (mode == THRESHOLD_POWER) {
+                const __m128 y = _mm_loadu_ps(&im[i]);
+                x = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+            }
+
+            word |= (uint64_t) _mm_movemask_ps(_mm_cmpge_ps(x, t)) << i;
+        }
+
+        out[w] = word;
+    }
+}
+
+__attribute__((target("avx2")))
+static void threshold_avx2(const float *re, const float *im, size_t n,
+                           float level, enum threshold_mode mode,
+                           uint64_t *out)
+{
+    size_t w, i;
+    const __m256 t = _mm256_set1_ps(level);
+
+    for (w = 0; w < n; w++, re += DIG_WORD_BITS, im += DIG_WORD_BITS) {
+        uint64_t word = 0;
+
+        for (i = 0; i < DIG_WORD_BITS; i += 8) {
+            __m256 x = _mm256_loadu_ps(&re[i]);
+
+            if (mode == THRESHOLD_POWER) {
+                const __m256 y = _mm256_loadu_ps(&im[i]);
+                x = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+            }
+
+            word |= (uint64_t) (uint32_t)
+                    _mm256_movemask_ps(_mm256_cmp_ps(x, t, _CMP_GE_OQ)) << i;
+        }
+
+        out[w] = word;
+    }
+}
+
+/* The sums of values below the lower level, and at or above the upper
+ * level, are accumulated by masking off the others */
+__attribute__((target("sse2")))
+static void stats_sse2(const float *re, const float *im, size_t n,
+                       float below, float above,
+                       enum threshold_mode mode, struct block_stats *st)
+{
+    size_t i, j;
+    float noise[4], burst[4];
+    const __m128 lo = _mm_set1_ps(below);
+    const __m128 hi = _mm_set1_ps(above);
+    __m128 noise_sum = _mm_setzero_ps();
+    __m128 burst_sum = _mm_setzero_ps();
+
+    for (i = 0; i < n * DIG_WORD_BITS; i += 4) {
+        __m128 x = _mm_loadu_ps(&re[i]);
+        __m128 lt, ge;
+
+        if (mode == THRESHOLD_POWER) {
+            const __m128 y = _mm_loadu_ps(&im[i]);
+            x = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        }
+
+        lt = _mm_cmplt_ps(x, lo);
+        ge = _mm_cmpge_ps(x, hi);
+        noise_sum = _mm_add_ps(noise_sum, _mm_and_ps(x, lt));
+        burst_sum = _mm_add_ps(burst_sum, _mm_and_ps(x, ge));
+        st->noise_count += __builtin_popcount(_mm_movemask_ps(lt));
+        st->burst_count += __builtin_popcount(_mm_movemask_ps(ge));
+    }
+
+    _mm_storeu_ps(noise, noise_sum);
+    _mm_storeu_ps(burst, burst_sum);
+
+    for (j = 0; j < 4; j++) {
+        st->noise_sum += noise[j];
+        st->burst_sum += burst[j];
+    }
+}
+
+__attribute__((target("avx2")))
+static void stats_avx2(const float *re, const float *im, size_t n,
+                       float below, float above,
+                       enum threshold_mode mode, struct block_stats *st)
+{
+    size_t i, j;
+    float noise[8], burst[8];
+    const __m256 lo = _mm256_set1_ps(below);
+    const __m256 hi = _mm256_set1_ps(above);
+    __m256 noise_sum = _mm256_setzero_ps();
+    __m256 burst_sum = _mm256_setzero_ps();
+
+    for (i = 0; i < n * DIG_WORD_BITS; i += 8) {
+        __m256 x = _mm256_loadu_ps(&re[i]);
+        __m256 lt, ge;
+
+        if (mode == THRESHOLD_POWER) {
+            const __m256 y = _mm256_loadu_ps(&im[i]);
+            x = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        }
+
+        lt = _mm256_cmp_ps(x, lo, _CMP_LT_OQ);
+        ge = _mm256_cmp_ps(x, hi, _CMP_GE_OQ);
+        noise_sum = _mm256_add_ps(noise_sum, _mm256_and_ps(x, lt));
+        burst_sum = _mm256_add_ps(burst_sum, _mm256_and_ps(x, ge));
+        st->noise_count += __builtin_popcount(_mm256_movemask_ps(lt));
+        st->burst_count += __builtin_popcount(_mm256_movemask_ps(ge));
+    }
+
+    _mm256_storeu_ps(noise, noise_sum);
+    _mm256_storeu_ps(burst, burst_sum);
+
+    for (j = 0; j < 8; j++) {
+        st->noise_sum += noise[j];
+        st->burst_sum += burst[j];
+    }
+}
+
+/* AVX-512 comparisons write a mask register directly */
+__attribute__((target("avx512f")))
+static void threshold_avx512(const float *re, const float *im, size_t n,
+                             float level, enum threshold_mode mode,
+                             uint64_t *out)
+{
+    size_t w, i;
+    const __m512 t = _mm512_set1_ps(level);
+
+    for (w = 0; w < n; w++, re += DIG_WORD_BITS, im += DIG_WORD_BITS) {
+        uint64_t word = 0;
+
+        for (i = 0; i < DIG_WORD_BITS; i += 16) {
+            __m512 x = _mm512_loadu_ps(&re[i]);
+
+            if (mode == THRESHOLD_POWER) {
+                const __m512 y = _mm512_loadu_ps(&im[i]);
+                x = _mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y));
+            }
+
+            word |= (uint64_t) _mm512_cmp_ps_mask(x, t, _CMP_GE_OQ) << i;
+        }
+
+        out[w] = word;
+    }
+}
+
+__attribute__((target("avx512f")))
+static void stats_avx512(const float *re, const float *im, size_t n,
+                         float below, float above,
+                         enum threshold_mode mode, struct block_stats *st)
+{
+    size_t i, j;
+    float noise[16], burst[16];
+    const __m512 lo = _mm512_set1_ps(below);
+    const __m512 hi = _mm512_set1_ps(above);
+    __m512 noise_sum = _mm512_setzero_ps();
+    __m512 burst_sum = _mm512_setzero_ps();
+
+    for (i = 0; i < n * DIG_WORD_BITS; i += 16) {
+        __m512 x = _mm512_loadu_ps(&re[i]);
+        __mmask16 lt, ge;
+
+        if (mode == THRESHOLD_POWER) {
+            const __m512 y = _mm512_loadu_ps(&im[i]);
+            x = _mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y));
+        }
+
+        lt = _mm512_cmp_ps_mask(x, lo, _CMP_LT_OQ);
+        ge = _mm512_cmp_ps_mask(x, hi, _CMP_GE_OQ);
+        noise_sum = _mm512_mask_add_ps(noise_sum, lt, noise_sum, x);
+        burst_sum = _mm512_mask_add_ps(burst_sum, ge, burst_sum, x);
+        st->noise_count += __builtin_popcount(lt);
+        st->burst_count += __builtin_popcount(ge);
+    }
+
+    _mm512_storeu_ps(noise, noise_sum);
+    _mm512_storeu_ps(burst, burst_sum);
+
+    for (j = 0; j < 16; j++) {
+        st->noise_sum += noise[j];
+        st->burst_sum += burst[j];
+    }
+}
+
+static bool cpu_supports(const char *name)
+{
+    __builtin_cpu_init();
+
+    if (!strcmp(name, "sse2")) {
+        return __builtin_cpu_supports("sse2");
+    } else if (!strcmp(name, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    } else if (!strcmp(name, "avx512")) {
+        return __builtin_cpu_supports("avx512f");
+    } else {
+        return !strcmp(name, "scalar");
+    }
+}
+
+#else
+
+static bool cpu_supports(const char *name)
+{
+    return !strcmp(name, "scalar");
+}
+
+#endif
+
+/* Listed in order of preference */
+static const struct threshold_impl impls[] = {
+#if HAVE_X86_IMPLS
+    { "avx512", threshold_avx512,   stats_avx512 },
+    { "avx2",   threshold_avx2,     stats_avx2 },
+    { "sse2",   threshold_sse2,     stats_sse2 },
+#endif
+    { "scalar", threshold_scalar,   stats_scalar },
+};
+
+static const struct threshold_impl * get_impl(void)
+{
+    size_t i;
+    static const struct threshold_impl *selected = NULL;
+
+    if (selected == NULL) {
+        for (i = 0; i < ARRAY_SIZE(impls); i++) {
+            if (cpu_supports(impls[i].name)) {
+                selected = &impls[i];
+                log_debug("Using %s thresholding\n", selected->name);
+                break;
+            }
+        }
+    }
+
+    return selected;
+}
+
+void threshold_to_dig(const struct complexf_planar *in, size_t n,
+                      float level, enum threshold_mode mode, uint64_t *out)
+{
+    const size_t full = n / DIG_WORD_BITS;
+    const size_t rem  = n % DIG_WORD_BITS;
+    const size_t done = full * DIG_WORD_BITS;
+
+    get_impl()->fn(in->real, in->imag, full, level, mode, out);
+
+    if (rem != 0) {
+        out[full] = pack_word(&in->real[done], &in->imag[done], rem,
+                              level, mode);
+    }
+}
+
+size_t dig_to_runs(const uint64_t *dig, size_t n, struct dig_run *runs)
+{
+    size_t w, start = 0, num_runs = 0;
+    bool level;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    /* Track the level of the current run, such that bit 0 of each word is
+     * compared with the last sample of the previous word */
+    level = dig[0] & 1;
+
+    for (w = 0; w < dig_words(n); w++) {
+        const size_t base = w * DIG_WORD_BITS;
+        const size_t bits = (n - base < DIG_WORD_BITS) ? n - base :
+                                                         DIG_WORD_BITS;
+
+        const uint64_t valid = (bits == DIG_WORD_BITS) ?
+                                    UINT64_MAX : (UINT64_C(1) << bits) - 1;
+
+        const uint64_t prev = (dig[w] << 1) | (uint64_t) level;
+        uint64_t edges = (dig[w] ^ prev) & valid;
+
+        while (edges != 0) {
+            const size_t i = base + __builtin_ctzll(edges);
+
+            runs[num_runs].length = i - start;
+            runs[num_runs].level = level;
+            num_runs++;
+
+            start = i;
+            level = !level;
+            edges &= edges - 1;
+        }
+    }
+
+    runs[num_runs].length = n - start;
+    runs[num_runs].level = level;
+    return num_runs + 1;
+}
+
+/* Convert a level or statistic from the compared quantity to a magnitude,
+ * and back */
+static inline float to_magnitude(const struct threshold_slicer *s, float x)
+{
+    return s->power ? sqrtf(x) : x;
+}
+
+static inline float from_magnitude(const struct threshold_slicer *s, float x)
+{
+    return s->power ? x * x : x;
+}
+
+/* Update the levels used for the next `n` samples. `st` is NULL if these
+ * are zeros, for which no statistics are gathered. */
+static void update_levels(struct threshold_slicer *s,
+                          const struct block_stats *st, size_t n)
+{
+    const struct threshold_params *p = &s->params;
+    float upper = p->level;
+    float lower;
+
+    if (p->adaptive) {
+        if (st && st->noise_count != 0) {
+            const float mean = to_magnitude(s, st->noise_sum /
+                                               st->noise_count);
+            const float a = 1.0f - expf(-(float) st->noise_count /
+                                        NOISE_TIME_CONSTANT);
+
+            s->noise += a * (mean - s->noise);
+        }
+
+        /* The burst magnitude decays toward the noise floor between bursts,
+         * so that a drop in the signal level is followed */
+        s->burst = s->noise + (s->burst - s->noise) *
+                              expf(-(float) n / BURST_DECAY);
+
+        /* Like the noise floor, it is the mean of the samples in question,
+         * rather than their peak, which noise would inflate */
+        if (st && st->burst_count != 0) {
+            const float mean = to_magnitude(s, st->burst_sum /
+                                               st->burst_count);
+            const float a = 1.0f - expf(-(float) st->burst_count /
+                                        BURST_TIME_CONSTANT);
+
+            s->burst += a * (mean - s->burst);
+        }
+
+        if (s->burst < s->noise) {
+            s->burst = s->noise;
+        }
+
+        if (NOISE_MARGIN * s->noise > upper) {
+            upper = NOISE_MARGIN * s->noise;
+        }
+
+        if (s->noise + BURST_FRACTION * (s->burst - s->noise) > upper) {
+            upper = s->noise + BURST_FRACTION * (s->burst - s->noise);
+        }
+    }
+
+    lower = s->noise + p->hysteresis * (upper - s->noise);
+
+    /* Guard against rounding placing the lower level above the upper one */
+    s->upper = from_magnitude(s, upper);
+    s->lower = (p->hysteresis < 1.0f && lower < upper) ?
+                    from_magnitude(s, lower) : s->upper;
+}
+
+/* Set bits [start, end) of a bit-packed stream */
+static void set_bits(uint64_t *dig, size_t start, size_t end)
+{
+    while (start < end) {
+        const size_t w = start / DIG_WORD_BITS;
+        const size_t b = start % DIG_WORD_BITS;
+        const size_t len = (end - start < DIG_WORD_BITS - b) ?
+                                end - start : DIG_WORD_BITS - b;
+        const uint64_t mask = (len == DIG_WORD_BITS) ? UINT64_MAX :
+                              (((UINT64_C(1) << len) - 1) << b);
+
+        dig[w] |= mask;
+        start += len;
+    }
+}
+
+/* Write the output up to sample `q` of the block, from `*cursor`. The output
+ * follows the hysteresis comparison once it has held a level for `width`
+ * samples, which removes shorter runs. */
+static void advance(struct threshold_slicer *s, uint64_t *out, size_t q,
+                    size_t *cursor)
+{
+    if (s->out_level != s->level) {
+        /* The sample at which the level has been held for `width` samples.
+         * This is never before the cursor, as the cursor is at or after
+         * the most recent change of level. */
+        const uint64_t at = s->since + s->width - 1;
+
+        if (at < s->pos + q) {
+            const size_t r = at - s->pos;
+
+            if (s->out_level) {
+                set_bits(out, *cursor, r);
+            }
+
+            *cursor = r;
+            s->out_level = s->level;
+        }
+    }
+
+    if (s->out_level) {
+        set_bits(out, *cursor, q);
+    }
+
+    *cursor = q;
+}
+
+/* Apply hysteresis and debouncing to the comparisons against the upper and
+ * lower levels. Only changes of level are visited, word by word. */
+static void slice(struct threshold_slicer *s, const uint64_t *hi,
+                  const uint64_t *lo, size_t n, uint64_t *out)
+{
+    size_t w;
+    size_t cursor = 0;
+
+    memset(out, 0, dig_words(n) * sizeof(out[0]));
+
+    for (w = 0; w < dig_words(n); w++) {
+        const size_t base = w * DIG_WORD_BITS;
+        const size_t bits = (n - base < DIG_WORD_BITS) ? n - base :
+                                                         DIG_WORD_BITS;
+
+        const uint64_t valid = (bits == DIG_WORD_BITS) ?
+                                    UINT64_MAX : (UINT64_C(1) << bits) - 1;
+
+        unsigned int p = 0;
+
+        for (;;) {
+            /* The level is set by a sample at or above the upper level, and
+             * cleared by one below the lower level. As the former is also
+             * at or above the lower level, a change is never immediately
+             * followed by another at the same sample. */
+            const uint64_t changes = (s->level ? ~lo[w] : hi[w]) &
+                                     valid & (UINT64_MAX << p);
+
+            if (changes == 0) {
+                break;
+            }
+
+            p = __builtin_ctzll(changes);
+            advance(s, out, base + p, &cursor);
+
+            s->level = !s->level;
+            s->since = s->pos + base + p;
+        }
+    }
+
+    advance(s, out, n, &cursor);
+    s->pos += n;
+}
+
+struct threshold_slicer * threshold_slicer_init(
+                                        const struct threshold_params *params,
+                                        enum threshold_mode mode, bool power,
+                                        size_t max_samples)
+{
+    struct threshold_slicer *s;
+
+    if (params->hysteresis <= 0.0f || params->hysteresis > 1.0f) {
+        log_error("Invalid threshold hysteresis: %f\n", params->hysteresis);
+        return NULL;
+    }
+
+    s = calloc(1, sizeof(s[0]));
+    if (!s) {
+        perror("calloc");
+        return NULL;
+    }
+
+    s->params = *params;
+    s->mode = mode;
+    s->power = power || mode == THRESHOLD_POWER;
+    s->width = params->min_width > 1 ? params->min_width : 1;
+
+    s->hi = malloc(dig_words(max_samples) * sizeof(s->hi[0]));
+    s->lo = malloc(dig_words(max_samples) * sizeof(s->lo[0]));
+    if (!s->hi || !s->lo) {
+        perror("malloc");
+        threshold_slicer_deinit(s);
+        return NULL;
+    }
+
+    update_levels(s, NULL, 0);
+    return s;
+}
+
+void threshold_slicer_deinit(struct threshold_slicer *slicer)
+{
+    if (slicer) {
+        free(slicer->hi);
+        free(slicer->lo);
+        free(slicer);
+    }
+}
+
+void threshold_slicer_process(struct threshold_slicer *slicer,
+                              const struct complexf_planar *in, size_t n,
+                              uint64_t *out)
+{
+    const uint64_t *lo = slicer->hi;
+
+    if (slicer->params.adaptive) {
+        const size_t full = n / DIG_WORD_BITS;
+        const size_t done = full * DIG_WORD_BITS;
+        struct block_stats st = { 0.0f, 0, 0.0f, 0 };
+
+        /* The noise floor and burst magnitude are estimated from the samples
+         * below the previous block's lower level, and at or above its upper
+         * level, respectively */
+        get_impl()->stats(in->real, in->imag, full, slicer->lower,
+                          slicer->upper, slicer->mode, &st);
+
+        stats_n(&in->real[done], &in->imag[done], n - done, slicer->lower,
+                slicer->upper, slicer->mode, &st);
+
+        update_levels(slicer, &st, n);
+    }
+
+    threshold_to_dig(in, n, slicer->upper, slicer->mode, slicer->hi);
+
+    if (slicer->lower != slicer->upper) {
+        threshold_to_dig(in, n, slicer->lower, slicer->mode, slicer->lo);
+        lo = slicer->lo;
+    }
+
+    slice(slicer, slicer->hi, lo, n, out);
+}
+
+void threshold_slicer_zeros(struct threshold_slicer *slicer, size_t n,
+                            uint64_t *out)
+{
+    if (slicer->params.adaptive) {
+        update_levels(slicer, NULL, n);
+    }
+
+    memset(slicer->hi, (0.0f >= slicer->upper) ? 0xff : 0,
+           dig_words(n) * sizeof(slicer->hi[0]));
+
+    memset(slicer->lo, (0.0f >= slicer->lower) ? 0xff : 0,
+           dig_words(n) * sizeof(slicer->lo[0]));
+
+    slice(slicer, slicer->hi, slicer->lo, n, out);
+}
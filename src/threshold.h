@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2015 Jon Szymaniak <jon.szymaniak@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef OOKIEDOKIE_THRESHOLD_H_
+#define OOKIEDOKIE_THRESHOLD_H_
+
+/* This file provides the conversion of received samples to a stream of
+ * digital samples, by comparing them against a threshold. SIMD
+ * implementations are selected at run-time, based upon CPU support.
+ *
+ * Digital samples are bit-packed into 64-bit words. Sample i of a stream is
+ * bit (i % 64) of word (i / 64), where bit 0 is the least significant bit. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "complexf.h"
+
+/**
+ * Number of digital samples per word
+ */
+#define DIG_WORD_BITS 64
+
+/**
+ * Quantity compared against the threshold
+ */
+enum threshold_mode {
+    THRESHOLD_POWER,    /**< Power of complex samples, real^2 + imag^2 */
+    THRESHOLD_REAL,     /**< Real component only. This is used when the
+                         *   filter has already performed envelope
+                         *   detection. */
+};
+
+/**
+ * A run of identical digital samples
+ */
+struct dig_run {
+    unsigned int length;    /**< Number of samples in the run */
+    bool level;             /**< Value of the samples */
+};
+
+/**
+ * @return Number of words required to hold `n` digital samples
+ */
+static inline size_t dig_words(size_t n)
+{
+    return (n + DIG_WORD_BITS - 1) / DIG_WORD_BITS;
+}
+
+/**
+ * @return Digital sample `i` of a bit-packed stream
+ */
+static inline bool dig_sample(const uint64_t *dig, size_t i)
+{
+    return (dig[i / DIG_WORD_BITS] >> (i % DIG_WORD_BITS)) & 1;
+}
+
+/**
+ * Compare samples against a threshold, producing bit-packed digital samples.
+ * A digital sample is 1 if its input is greater than or equal to `level`.
+ *
+ * To threshold the magnitude of complex samples without computing a square
+ * root, use THRESHOLD_POWER with the square of the magnitude threshold.
+ *
+ * @param[in]   in      Input samples. The imaginary component is unused
+ *                      with THRESHOLD_REAL.
+ * @param[in]   n       Number of samples
+ * @param[in]   level   Threshold level
+ * @param[in]   mode    Quantity to compare against `level`
+ * @param[out]  out     Digital samples. This must hold dig_words(n) words.
+ *                      Unused bits of the last word are cleared.
+ */
+void threshold_to_dig(const struct complexf_planar *in, size_t n,
+                      float level, enum threshold_mode mode, uint64_t *out);
+
+/**
+ * Parameters of a slicer, which thresholds successive blocks of samples with
+ * hysteresis, optionally adapting its levels to the signal
+ */
+struct threshold_params {
+    float level;            /**< Upper threshold level, as a magnitude. When
+                             *   `adaptive` is set, this is the minimum. */
+    float hysteresis;       /**< Lower level, as a fraction of the distance
+                             *   from the noise floor to the upper level. A
+                             *   sample at or above the upper level sets the
+                             *   output, and one below the lower level
+                             *   clears it. 1.0 disables hysteresis. */
+    unsigned int min_width; /**< Runs of fewer samples than this are
+                             *   removed, and the output is delayed by
+                             *   (min_width - 1) samples. 0 or 1 disables
+                             *   this. */
+    bool adaptive;          /**< Track the noise floor and the mean
+                             *   magnitude of bursts, and place the upper
+                             *   level between them */
+};
+
+/** Opaque handle to a slicer */
+struct threshold_slicer;
+
+/**
+ * Create a slicer
+ *
+ * @param   params      Slicer parameters
+ * @param   mode        Quantity compared against the levels
+ * @param   power       Whether the compared quantity is a power, in which
+ *                      case the levels are squared. This is always the
+ *                      case for THRESHOLD_POWER.
+ * @param   max_samples Maximum number of samples per block
+ *
+ * @return Slicer on success, NULL on failure. The caller is responsible for
+ *         calling threshold_slicer_deinit().
+ */
+struct threshold_slicer * threshold_slicer_init(
+                                        const struct threshold_params *params,
+                                        enum threshold_mode mode, bool power,
+                                        size_t max_samples);
+
+/**
+ * Deinitialize and deallocate a slicer
+ *
+ * @param   slicer  Slicer to deinitialize. May be NULL.
+ */
+void threshold_slicer_deinit(struct threshold_slicer *slicer);
+
+/**
+ * Threshold a block of samples, continuing from the previous block.
+ *
+ * @param[in]   slicer  Slicer
+ * @param[in]   in      Input samples
+ * @param[in]   n       Number of samples. This must not exceed the
+ *                      `max_samples` provided to threshold_slicer_init().
+ * @param[out]  out     Digital samples. This must hold dig_words(n) words.
+ *                      Unused bits of the last word are cleared.
+ */
+void threshold_slicer_process(struct threshold_slicer *slicer,
+                              const struct complexf_planar *in, size_t n,
+                              uint64_t *out);
+
+/**
+ * Equivalent of threshold_slicer_process() for a block of zero-valued
+ * samples, which are not provided. The noise floor estimate is unaffected.
+ *
+ * @param[in]   slicer  Slicer
+ * @param[in]   n       Number of samples
+ * @param[out]  out     Digital samples. This must hold dig_words(n) words.
+ */
+void threshold_slicer_zeros(struct threshold_slicer *slicer, size_t n,
+                            uint64_t *out);
+
+/**
+ * Convert bit-packed digital samples to runs of identical samples.
+ *
+ * The first run always begins at sample 0, so it may continue the last run
+ * produced from the previous block of samples.
+ *
+ * @param[in]   dig     Bit-packed digital samples
+ * @param[in]   n       Number of samples
+ * @param[out]  runs    Runs of samples. In the worst case there is a run per
+ *                      sample, so this must hold `n` entries.
+ *
+ * @return Number of runs written to `runs`
+ */
+size_t dig_to_runs(const uint64_t *dig, size_t n, struct dig_run *runs);
+
+#endif